@@ -1,322 +1,3091 @@
 #include "RUDP_API.h"
+#include "RUDP_Uring.h"
 
-#define MAX_BUFFER_SIZE 2048
+#define IP_UDP_HEADERS 28 // IPv4 and UDP headers in front of every packet
+#define MAX_BUFFER_SIZE (RUDP_MAX_MTU - IP_UDP_HEADERS - 20) // Content of a packet of RUDP_MAX_MTU bytes (after its 20-byte header)
 #define MAX_RETRANSMISSION_ATTEMPTS 10
+#define RUDP_VERSION 3
 
-// RUDP Header
-typedef struct UDP_Header {
-    unsigned short Length; // 2 Bytes (Byte 0, Byte 1) for length of data
-    unsigned short Checksum; // 2 Bytes (Byte 2, Byte 3) for checksum
-    char Flag; // 1 Byte for: SYN = 'S', ACK = 'A', Data = 'D', FIN = 'F'
+// Retransmission timeout bounds (in microseconds), the RTO itself is measured per connection
+#define INITIAL_RTO_US 200000 // Until the first RTT sample
+#define MIN_RTO_US 2000
+#define MAX_RTO_US 4000000
+
+// A packet is lost once this many packets that were sent after it are acknowledged
+#define DUP_THRESHOLD 3
+
+// Packets whose pacing time is within this quantum are sent together in one batch
+#define PACING_QUANTUM_US 100
+
+// rudp_send_fd maps and sends a file in slices of this many bytes
+#define FILE_SLICE (1 << 30)
+
+// UDP segmentation offload (GSO on send, GRO on receive), the options are missing from older headers
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#define GSO_MAX_BYTES 65507 // Largest UDP payload, the limit for a buffer before the kernel splits it
+#define GSO_MAX_SEGMENTS 64
+#define GRO_BUFFER_SIZE 65535 // A receive buffer must hold a whole coalesced buffer
+#define GRO_BATCH 8 // Receive buffers when GRO is on, each one may hold tens of packets
+#define CONTROL_SIZE CMSG_SPACE(sizeof(int))
+
+// io_uring engine: datagrams are received into URING_BUFFERS provided buffers (URING_GRO_BUFFERS with GRO, they're
+// larger), and up to URING_SENDS batches of sends (a chain of RUDP_MAX_BATCH requests at most) are in flight while the
+// next one is filled
+#define URING_BUFFERS 256
+#define URING_GRO_BUFFERS 64
+#define URING_BUFFER_GROUP 0
+#define URING_SENDS 3
+
+// Path MTU discovery (DPLPMTUD, RFC 8899): a probe that gets no reply is sent PROBE_ATTEMPTS times before its size is
+// considered too large, the search stops once the gap to the largest size that may still work is below PMTU_STEP,
+// and a search for a larger MTU (the path may have changed) starts again after PMTU_RAISE_US
+#define PROBE_ATTEMPTS 3
+#define PMTU_STEP 32
+#define PMTU_RAISE_US 600000000
+// A chunk larger than the base MTU that is retransmitted this many times may be lost in a black hole: a router
+// that drops packets too large for it without telling (the path MTU got smaller)
+#define PMTU_BLACKHOLE_ATTEMPTS (MAX_RETRANSMISSION_ATTEMPTS / 2)
+
+// Forward error correction: a data packet of a block carries its length in front of its data in the parity packets,
+// the Receiver keeps the parity sums of this many blocks at once, and the Sender sends FEC_MARGIN times the packets
+// a block is expected to lose
+#define FEC_LENGTH_SIZE 2
+#define FEC_UNIT_SIZE (FEC_LENGTH_SIZE + MAX_BUFFER_SIZE)
+#define FEC_BLOCKS 8
+#define FEC_MARGIN 2
+
+// Delayed ACK: in-order data is acknowledged once every ACK_EVERY packets, or ACK_DELAY_US after the first packet
+// that wasn't acknowledged. The delay must stay below MIN_RTO_US, or the Sender would time out waiting for it.
+#define DEFAULT_ACK_EVERY 16
+#define DEFAULT_ACK_DELAY_US 1000
+
+// Server: a connection that gets no packets for this long is dropped (its Sender crashed or gave up)
+#define IDLE_TIMEOUT_US 30000000
+#define EXPIRY_INTERVAL_US 1000000 // Idle connections are looked for once a second
+#define SERVER_POLL_BUDGET 16 // recvmmsg calls in one rudpServer_poll, so a busy socket doesn't starve the timers
+#define INITIAL_BUCKETS 64
+
+// RUDP Header, laid out exactly as it is sent on the wire (packed, multi-byte fields in network byte order).
+// Only the header and Length bytes of Content are sent: control packets (SYN/ACK/FIN) are header-only.
+typedef struct __attribute__((packed)) UDP_Header {
+    uint8_t Version; // 1 Byte (Byte 0) for the protocol version, packets of another version are dropped
+    char Flag; // 1 Byte (Byte 1) for: SYN = 'S', ACK = 'A', Data = 'D', FIN = 'F', PMTU probe = 'P', FEC parity = 'R'
+    uint16_t Length; // 2 Bytes (Byte 2, Byte 3) for length of data
+    uint16_t Window; // 2 Bytes (Byte 4, Byte 5) for the window (in packets) the peer advertises in SYN and its ACK
+    uint16_t Options; // 2 Bytes (Byte 6, Byte 7) for option bits (OPTION_*), in SYN and its ACK they are negotiated
+    uint32_t Seq; // 4 Bytes (Byte 8 - Byte 11) for sequence number of SYN/Data/FIN, or the cumulative ACK (every packet before it arrived)
+    uint32_t ConnID; // 4 Bytes (Byte 12 - Byte 15) for the connection ID the Sender picked, with its address it tells connections apart
+    uint32_t Checksum; // 4 Bytes (Byte 16 - Byte 19) for checksum (16 bits) or CRC32C of the header and the data
     char Content [MAX_BUFFER_SIZE];
 } Packet;
 
+#define HEADER_SIZE (offsetof(Packet, Content))
+
+// The packet is protected by CRC32C instead of the checksum. A Sender sets it in its SYN to ask for CRC32C,
+// and the Receiver in the ACK of the SYN if it agrees.
+#define OPTION_CRC32C 0x0001
+
+// Asks the Receiver to acknowledge the data packet at once instead of delaying the ACK. The Sender sets it on packets
+// after which it has to wait: the last packet of a message, the one that fills the window, and retransmissions.
+#define OPTION_ACK_NOW 0x0002
+
+// A PMTU probe of the Sender is padded to the size it probes for, and carries a probe ID in Seq instead of a sequence
+// number: it isn't data, so its loss is neither retransmitted nor a congestion signal. The Receiver answers a probe
+// that arrived with a header-only probe of the same ID.
+
+// Forward error correction (see RUDP_FEC.h), the Sender sets one of them in its SYN and the Receiver in the ACK of the
+// SYN if it agrees. Data packets then carry in Window their index in their block (high byte) and the number of parity
+// packets of the block (low byte, 0 for a block without parity), the block starts at Seq - index. A parity packet 'R'
+// has the first sequence number of its block in Seq, the number of data packets of the block (high byte), its number of
+// parity packets (bits 4-7) and its row (bits 0-3) in Window, and in Content the parity of the block's data packets,
+// every one of them taken as its length (2 bytes, network byte order) followed by its data and zeros.
+#define OPTION_FEC_XOR 0x0004
+#define OPTION_FEC_RS 0x0008
+#define OPTION_FEC (OPTION_FEC_XOR | OPTION_FEC_RS)
+#define FEC_OPTION_MODE(options) ((options) & OPTION_FEC_RS ? RUDP_FEC_RS : (options) & OPTION_FEC_XOR ? RUDP_FEC_XOR : RUDP_FEC_OFF)
+
+// Resumable transfers (see rudpConn_set_resume): a SYN with it carries in its Content the data the Sender set, and the
+// ACK of the SYN the data the Receiver set instead of a SACK bitmap (it's set only while no data packet arrived).
+// Unlike the other options it isn't negotiated, it only tells what the Content of the SYN or the ACK is.
+#define OPTION_RESUME 0x0010
+
+// Compressed session chunks (see rudpConn_set_compression): the Sender sets it in its SYN if it would send them, and the
+// Receiver in the ACK of the SYN if its application reads them. The packets themselves don't change.
+#define OPTION_COMPRESS 0x0020
+
+// The Content of an ACK is a SACK bitmap of the packets after the cumulative ACK that arrived out of order:
+// bit i % 8 of byte i / 8 stands for packet Seq + 1 + i. Trailing zero bytes aren't sent, an in-order ACK is header-only.
+
+// Sender's window slot: a data packet that was sent and waits for its ACK
+typedef struct _sendSlot {
+    int attempts; // Number of retransmissions, an ACK of a retransmitted packet isn't an RTT sample (Karn's rule)
+    int acked;
+    uint64_t sent_at; // Time of the last transmission, the packet is retransmitted at sent_at + RTO
+    unsigned long tx_order; // Order of the last transmission among all transmissions of the connection
+    const char *data; // Content of the packet, in the user's buffer
+    unsigned short length;
+    uint16_t fec_tag; // Window of the packet with FEC: its index in its block and the parity packets of the block
+    int holed; // An ACK reported it missing (FEC loss estimate)
+    unsigned long fec_sent; // tx_count once the parity packets of its block were sent, 0 while the block is open
+} sendSlot;
+
+// A message queued to be sent: its buffers, and the sequence number after its last chunk. A message is split to chunks
+// as it's sent, the size of a chunk follows the path MTU, so its end is known once its last chunk got a sequence number.
+typedef struct _sendRequest {
+    struct iovec *iov; // Copy of the caller's array (allocated with the request), the buffers themselves aren't copied
+    int iovcnt;
+    int64_t bytes;
+    unsigned int end;
+    int segmented; // Every chunk of the message has its sequence number, end is known
+    uint64_t id; // Passed to on_send
+    int notify; // Queued by the asynchronous API, its completion is reported to on_send
+    struct _sendRequest *next;
+} sendRequest;
+
+// States of a connection driven by the asynchronous API
+#define CONN_IDLE 0 // Not connected, or used with the blocking API
+#define CONN_CONNECTING 1 // The SYN waits for its ACK
+#define CONN_OPEN 2
+#define CONN_CLOSING 3 // The FIN is sent once the queued messages are acknowledged
+#define CONN_CLOSED 4
+#define CONN_FAILED 5
+
+// Receiver's reassembly slot: a data packet that arrived and wasn't delivered to the user yet.
+// The slot holds the buffer the packet was received into, the receive batch got a spare buffer in exchange.
+typedef struct _recvSlot {
+    int present;
+    unsigned short length;
+    unsigned short delivered; // Bytes of the content that were already copied to the user
+    Packet *packet;
+} recvSlot;
+
+// Receiver's FEC block: the parity sums of the data packets of the block that arrived and of its parity packets.
+// Row j holds parity packet j plus the data packets that arrived, each times its coefficient, so it's left with the
+// sum of the lost packets only.
+typedef struct _fecBlock {
+    int used;
+    unsigned int first; // Sequence number of the first data packet of the block
+    unsigned int count; // Data packets in the block, 0 until a parity packet tells
+    unsigned int parity; // Parity packets of the block
+    uint64_t received; // Bit i: data packet first + i is in the sums
+    unsigned int rows; // Bit j: parity packet j is in the sums
+    size_t length; // Bytes of every row in use, the ones after it aren't zeroed yet
+    unsigned int capacity; // Rows allocated
+    uint8_t *sums; // FEC_UNIT_SIZE bytes per row
+} fecBlock;
+
+// Datagrams that are sent or received with a single sendmmsg/recvmmsg call
+typedef struct _ioBatch {
+    size_t buffer_size; // Every message has its own buffer (iov[2 * i]), a packet or several ones coalesced by GRO
+    unsigned int size;
+    struct mmsghdr *msgs;
+    struct iovec *iov; // Two for every message: its buffer (the header, or the whole packet), then data sent straight from user memory
+    struct sockaddr_storage *addrs; // Sources of the received datagrams
+    char *control; // Ancillary data of every message (UDP_SEGMENT / UDP_GRO), CONTROL_SIZE bytes each
+    struct mmsghdr *gso_msgs; // Send batch with GSO: consecutive packets grouped into one message
+    unsigned int count; // Datagrams in the batch
+    unsigned int pos; // Next received datagram to process
+    unsigned int last; // Datagram of the last packet rx_next returned
+    size_t offset; // Offset of the next packet inside a received datagram coalesced by GRO
+    int in_place; // The datagrams are read in the io_uring engine's buffers (see uring_receive), rx_take can't take them
+} ioBatch;
+
+// A send batch the io_uring engine submitted: its messages, buffers and the memory they point to stay untouched until
+// the kernel completed all of its requests
+typedef struct _uringSend {
+    ioBatch batch;
+    struct mmsghdr *msgs; // The messages of the chain: the batch's own, or its GSO messages (from the first one not sent yet)
+    unsigned int count;
+    int gso; // msgs are GSO messages
+    unsigned int pending; // Requests that didn't complete yet, the batch is free once it's 0
+    unsigned int failed; // 1 + the request of the chain that failed, 0 if none did
+    int error;
+} uringSend;
+
+// The rings of a connection with RUDP_ENGINE_URING. Sends and receives have their own ring, so reaping the completions
+// of the sends never takes a received datagram out of order.
+typedef struct _uringEngine {
+    rudpUring tx;
+    rudpUring rx;
+    rudpUringBuffers buffers; // Where the multishot recvmsg puts the datagrams: a header, the address, the ancillary data, the packet
+    struct msghdr msg; // Sizes of the address and the ancillary data in every buffer
+    int armed; // The multishot recvmsg is active (it stops when the buffers run out)
+    uringSend sends[URING_SENDS];
+    int tx_error; // A send failed for good, the next flush fails with it
+    uint32_t held[RUDP_MAX_BATCH]; // Completion flags of the buffers the messages of the receive batch point into
+    void *own[RUDP_MAX_BATCH]; // The receive batch's own buffers, given back to it once the held ones are recycled
+    unsigned int held_count;
+} uringEngine;
+
+#define BATCH_PACKET(b, i) ((Packet *)(b)->iov[2 * (i)].iov_base)
+#define TX_SIZE(b, i) ((b)->iov[2 * (i)].iov_len + (b)->iov[2 * (i) + 1].iov_len) // Size of a queued packet on the wire
+
+// RUDP connection state
+typedef struct _rudpConn {
+    int sockfd;
+    uint32_t conn_id; // Picked by the Sender, every packet of the connection carries it
+    uint16_t options; // Options of the packets the connection sends (OPTION_CRC32C, OPTION_FEC_* and OPTION_COMPRESS once they're negotiated)
+    uint16_t peer_options; // Options of the last ACK, in the ACK of the SYN the ones the Receiver agreed to
+    struct sockaddr_storage peer; // Address of the other side of the connection
+    socklen_t peer_len;
+    unsigned int window; // Max packets in flight (Sender) or buffered out of order (Receiver)
+    unsigned int next_seq; // Sender: sequence number of the next new data packet
+    unsigned int send_base; // Sender: oldest data packet that wasn't acknowledged
+    unsigned int in_flight; // Sender: data packets that were sent and weren't acknowledged
+    sendRequest *send_head; // Sender: queue of messages, the oldest one wasn't acknowledged yet
+    sendRequest *send_tail;
+    sendRequest *send_cursor; // Message of the next new chunk, the buffer of the chunk and its offset there (NULL if none)
+    int cursor_buffer;
+    size_t cursor_offset;
+    unsigned int expected_seq; // Receiver: sequence number of the next in-order data packet
+    unsigned int peer_window; // Window the peer advertised in its last SYN/ACK
+    int64_t srtt; // Smoothed RTT (microseconds), 0 until the first sample
+    int64_t rttvar; // RTT variation (microseconds)
+    int64_t rto; // Current retransmission timeout (microseconds), doubled on every timeout
+    const ccOps *cc_ops; // Congestion controller
+    ccState cc;
+    uint64_t next_send_at; // Pacing: time the next packet may be sent
+    unsigned int recovery_point; // Losses of packets before it belong to the last loss event
+    unsigned long tx_count; // Transmissions so far
+    unsigned long retransmits;
+    unsigned long acks; // Sender: ACKs received
+    rudpConnStats stats; // See rudpConn_stats, the RTT fields are computed from rtt_sum when they're asked for
+    uint64_t rtt_sum;
+    const uint8_t *sack; // Sender: SACK bitmap of the last ACK (in the receive batch, valid until the next got_ACK)
+    unsigned int sack_bytes;
+    sendSlot *send_slots; // Indexed by seq % window
+    recvSlot *recv_slots; // Indexed by seq % window
+    Packet **spare_packets; // Free buffers of the reassembly buffer, at most window buffers ever exist
+    unsigned int spare_count;
+    int fin_received; // Receiver: a FIN arrived and is acknowledged once the data before it is delivered
+    unsigned int fin_seq;
+    unsigned int ack_every; // Receiver: delayed ACK policy, see rudpConn_set_delayed_ack
+    unsigned int ack_delay; // Microseconds
+    unsigned int unacked; // Receiver: in-order data packets that weren't acknowledged yet
+    uint64_t ack_deadline; // Time the ACK of the oldest of them is due
+    int ack_now; // An ACK is sent with the next batch, whatever the policy says
+    unsigned int batch; // Max datagrams per sendmmsg/recvmmsg
+    unsigned int mtu; // Sender: MTU the data packets are sized to, see rudpConn_set_mtu
+    unsigned int mss; // Sender: data bytes of a packet of mtu bytes
+    int pmtu_fixed; // The MTU isn't searched for: set by the user, or the path isn't probed (see pmtu_blackhole)
+    unsigned int pmtu_max; // Largest MTU that may work: smaller than the size of every probe that got no reply
+    unsigned int probe_size; // The probe that waits for its reply (0 if none), with its ID and the time it was sent
+    unsigned int probe_id;
+    uint64_t probe_sent_at;
+    int probe_attempts;
+    int probe_failed; // A probe of the search got no reply, the next sizes halve the gap instead of trying pmtu_max
+    uint64_t pmtu_raise_at; // The search is done, it starts again at this time (0 while searching)
+    int fec_mode; // Sender: RUDP_FEC_*, see rudpConn_set_fec
+    unsigned int fec_block; // Data packets per block
+    unsigned int fec_parity; // Parity packets per block, the most with adaptive
+    int fec_adaptive;
+    unsigned int fec_first; // Sender: the block being sent, its parity packets and the parity sums of its chunks so far
+    unsigned int fec_count;
+    unsigned int fec_rows;
+    size_t fec_length;
+    uint8_t *fec_sums; // fec_parity rows of FEC_UNIT_SIZE bytes
+    double fec_loss; // Estimated loss rate, from the chunks ACKs reported missing
+    unsigned long fec_holes;
+    unsigned long fec_holes_seen; // fec_holes when the last block ended
+    unsigned long parity_sent;
+    fecBlock *fec_blocks; // Receiver: FEC_BLOCKS blocks whose lost packets may be rebuilt
+    Packet *fec_packet; // A rebuilt packet
+    unsigned long fec_recovered;
+    int gso; // Send with UDP_SEGMENT
+    int gro; // UDP_GRO is enabled on the socket
+    int nonblocking; // Server socket: a full send buffer drops packets instead of blocking
+    ioBatch *tx; // Packets queued to be sent (the connections of a server share the batches of the server)
+    ioBatch *rx; // Packets received and not processed yet
+    uringEngine *uring; // The rings of the socket with RUDP_ENGINE_URING, NULL with the system calls
+    struct _rudpServer *server; // The server that owns the connection, NULL for the blocking API
+    struct _rudpConn *hash_next; // Next connection in the same bucket of the server's table
+    struct _rudpConn *ack_next; // Next connection in the server's list of connections with an ACK pending
+    int ack_listed;
+    int state; // Asynchronous API: CONN_*, and the SYN/FIN that waits for its ACK (control_flag is 0 if none)
+    rudpAsyncCallbacks async;
+    void *async_user;
+    char control_flag;
+    unsigned int control_seq;
+    uint64_t control_sent_at;
+    int control_attempts;
+    uint64_t last_active; // Time the last packet of the connection arrived
+    void *user;
+    unsigned char *resume; // Data sent in the SYN (Sender) or the ACK of the SYN (Receiver), see rudpConn_set_resume
+    size_t resume_len;
+    unsigned char *peer_resume; // Data the peer sent in its SYN or the ACK of the SYN
+    size_t peer_resume_len;
+} rudpConn;
+
+// Many connections served over one socket, looked up by (address of the Sender, connection ID)
+struct _rudpServer {
+    rudpConn *io; // Owns the socket and the batches, every connection sends and receives through them
+    rudpServerCallbacks callbacks;
+    void *user;
+    unsigned int window; // Window offered to new connections
+    rudpConn **buckets; // Hash table of the connections, chained through hash_next
+    unsigned int bucket_count; // Power of 2
+    unsigned int size;
+    uint64_t next_expiry; // Next time idle connections are looked for
+    rudpConn *ack_list; // Connections whose ACK is delayed, chained through ack_next
+};
+
 // Creating a RUDP socket
 int rudp_socket() {
     int soc = socket(AF_INET, SOCK_DGRAM, 0); // Create a UDP socket for IPv4
     if (soc == -1) {
-        perror("Socket creation failed");
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Socket creation failed");
+        return -1;
+    }
+    return soc;
+}
+
+static void batch_free(ioBatch *b) {
+    for (unsigned int i = 0; b->iov != NULL && i < b->size; i++)
+        free(b->iov[2 * i].iov_base);
+    free(b->msgs);
+    free(b->iov);
+    free(b->addrs);
+    free(b->control);
+    free(b->gso_msgs);
+    memset(b, 0, sizeof(ioBatch));
+}
+
+// Allocate a batch of size buffers, every message points to its own buffer, address and ancillary data.
+// Buffers are allocated one by one, a received packet's buffer may move to a reassembly slot (see rx_take).
+static int batch_alloc(ioBatch *b, unsigned int size, size_t buffer_size) {
+    b->buffer_size = buffer_size;
+    b->size = size;
+    b->msgs = (struct mmsghdr *)calloc(size, sizeof(struct mmsghdr));
+    b->iov = (struct iovec *)calloc(2 * (size_t)size, sizeof(struct iovec));
+    b->addrs = (struct sockaddr_storage *)calloc(size, sizeof(struct sockaddr_storage));
+    b->control = (char *)calloc(size, CONTROL_SIZE);
+    b->gso_msgs = (struct mmsghdr *)calloc(size, sizeof(struct mmsghdr));
+    b->count = 0;
+    b->pos = 0;
+    b->offset = 0;
+    if (b->msgs == NULL || b->iov == NULL || b->addrs == NULL || b->control == NULL || b->gso_msgs == NULL) {
+        batch_free(b);
+        return -1;
+    }
+    for (unsigned int i = 0; i < size; i++) {
+        b->iov[2 * i].iov_base = malloc(buffer_size);
+        if (b->iov[2 * i].iov_base == NULL) {
+            batch_free(b);
+            return -1;
+        }
+        b->iov[2 * i].iov_len = buffer_size;
+        b->msgs[i].msg_hdr.msg_iov = &b->iov[2 * i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1; // A send sets 2 when the packet has its data
+        b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+        b->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    }
+    return 0;
+}
+
+// *** io_uring engine: ***
+
+static int uring_drain(rudpConn *conn);
+static void uring_rx_release(rudpConn *conn);
+
+static void uring_free(rudpConn *conn) {
+    uringEngine *u = conn->uring;
+    if (u == NULL)
+        return;
+    // The requests in flight point to the send batches and to the user's buffers
+    if (uring_drain(conn) == -1)
+        RUDP_LOG_ERRNO(RUDP_LOG_WARN, "io_uring sends failed");
+    for (int i = 0; i < URING_SENDS; i++)
+        batch_free(&u->sends[i].batch);
+    uring_rx_release(conn);
+    rudpUring_buffers_exit(&u->rx, &u->buffers);
+    rudpUring_exit(&u->rx);
+    rudpUring_exit(&u->tx);
+    free(u);
+    conn->uring = NULL;
+}
+
+// Start the multishot recvmsg: every datagram that arrives completes it once more, in a buffer of the group
+static int uring_arm(rudpConn *conn) {
+    uringEngine *u = conn->uring;
+    struct io_uring_sqe *sqe = rudpUring_sqe(&u->rx);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = conn->sockfd;
+    sqe->addr = (uint64_t)(uintptr_t)&u->msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    if (rudpUring_submit(&u->rx, 0) == -1)
+        return -1;
+    u->armed = 1;
+    return 0;
+}
+
+// The receive ring and its buffers, sized for single packets or for the buffers GRO coalesces. Datagrams that were
+// received by the previous ring and not processed are lost (the Sender retransmits them).
+static int uring_rx_init(rudpConn *conn) {
+    uringEngine *u = conn->uring;
+    uring_rx_release(conn);
+    rudpUring_buffers_exit(&u->rx, &u->buffers);
+    rudpUring_exit(&u->rx);
+    u->armed = 0;
+    memset(&u->msg, 0, sizeof(u->msg));
+    u->msg.msg_namelen = sizeof(struct sockaddr_storage);
+    u->msg.msg_controllen = conn->gro ? CONTROL_SIZE : 0;
+
+    // A completion per buffer at most, the completion queue (twice the entries) never overflows
+    unsigned int count = conn->gro ? URING_GRO_BUFFERS : URING_BUFFERS;
+    size_t size = sizeof(struct io_uring_recvmsg_out) + u->msg.msg_namelen + u->msg.msg_controllen +
+                  (conn->gro ? GRO_BUFFER_SIZE : sizeof(Packet));
+    size = (size + 7) & ~(size_t)7; // The address is read in place, every buffer stays aligned
+    if (rudpUring_init(&u->rx, count) == -1)
+        return -1;
+    if (rudpUring_buffers_init(&u->rx, &u->buffers, URING_BUFFER_GROUP, count, size) == -1)
+        return -1;
+    return uring_arm(conn);
+}
+
+// Set up the rings of a connection on a socket of RUDP_ENGINE_URING. Returns -1 if the kernel refuses (errno is set).
+static int uring_alloc(rudpConn *conn) {
+    uringEngine *u = (uringEngine *)calloc(1, sizeof(uringEngine));
+    if (u == NULL)
+        return -1;
+    u->tx.fd = -1;
+    u->rx.fd = -1;
+    conn->uring = u;
+    // The completion queue (twice the entries) holds the completions of all the batches in flight
+    if (rudpUring_init(&u->tx, 2 * RUDP_MAX_BATCH) == -1)
+        goto fail;
+    // Receives wait with a timeout in io_uring_enter (IORING_ENTER_EXT_ARG)
+    if (!(u->tx.features & IORING_FEAT_EXT_ARG)) {
+        errno = EOPNOTSUPP;
+        goto fail;
+    }
+    if (uring_rx_init(conn) == -1)
+        goto fail;
+    return 0;
+
+fail:;
+    int error = errno;
+    uring_free(conn);
+    errno = error;
+    return -1;
+}
+
+// Give the buffers the last receive batch was read in back to the kernel, and the batch its own buffers
+static void uring_rx_release(rudpConn *conn) {
+    uringEngine *u = conn->uring;
+    ioBatch *rx = conn->rx;
+    for (unsigned int i = 0; i < u->held_count; i++) {
+        rudpUring_buffer_recycle(&u->buffers, u->held[i]);
+        rx->iov[2 * i].iov_base = u->own[i];
+        rx->msgs[i].msg_hdr.msg_name = &rx->addrs[i];
+    }
+    u->held_count = 0;
+    rx->in_place = 0;
+}
+
+// Point message i of the receive batch to the datagram of a provided buffer (res bytes), as recvmmsg would have
+// received it: the packet, its address and its ancillary data are read where the kernel put them, until the next batch.
+// Returns -1 if the buffer is malformed.
+static int uring_datagram(rudpConn *conn, char *buffer, int res, unsigned int i) {
+    uringEngine *u = conn->uring;
+    ioBatch *rx = conn->rx;
+    const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buffer;
+    size_t headers = sizeof(*out) + u->msg.msg_namelen + u->msg.msg_controllen;
+    if ((size_t)res < headers)
+        return -1;
+    char *name = buffer + sizeof(*out);
+    char *control = name + u->msg.msg_namelen;
+    char *payload = control + u->msg.msg_controllen;
+
+    struct msghdr *msg = &rx->msgs[i].msg_hdr;
+    msg->msg_name = name;
+    msg->msg_namelen = out->namelen < u->msg.msg_namelen ? out->namelen : u->msg.msg_namelen;
+    msg->msg_control = conn->gro ? control : NULL;
+    msg->msg_controllen = conn->gro ? (out->controllen < u->msg.msg_controllen ? out->controllen : u->msg.msg_controllen) : 0;
+    // A truncated datagram keeps the bytes that fit, its decoding fails
+    size_t len = (size_t)res - headers;
+    if (out->payloadlen < len)
+        len = out->payloadlen;
+    if (len > rx->buffer_size)
+        len = rx->buffer_size;
+    u->own[i] = rx->iov[2 * i].iov_base;
+    rx->iov[2 * i].iov_base = payload;
+    rx->msgs[i].msg_len = len;
+    return 0;
+}
+
+// Fill the receive batch with the datagrams of the completions, as rx_fill. The completion queue is read in user
+// space, so a busy socket costs no system call (the multishot recvmsg is started again if the buffers ran out), and the
+// datagrams aren't copied: their buffers go back to the kernel once the batch was processed, with the next one.
+static int uring_receive(rudpConn *conn, int flags) {
+    uringEngine *u = conn->uring;
+    ioBatch *rx = conn->rx;
+    unsigned int n = 0;
+    int error = 0;
+    uring_rx_release(conn);
+    rx->pos = 0;
+    rx->offset = 0;
+    rx->count = 0;
+    while (1) {
+        struct io_uring_cqe *cqe;
+        while (n < rx->size && (cqe = rudpUring_cqe(&u->rx)) != NULL) {
+            int res = cqe->res;
+            uint32_t cqe_flags = cqe->flags;
+            if (!(cqe_flags & IORING_CQE_F_MORE))
+                u->armed = 0;
+            if (cqe_flags & IORING_CQE_F_BUFFER) {
+                if (res >= 0 && uring_datagram(conn, rudpUring_buffer(&u->buffers, cqe_flags), res, n) == 0) {
+                    u->held[n++] = cqe_flags;
+                    u->held_count = n;
+                    rx->in_place = 1;
+                } else {
+                    rudpUring_buffer_recycle(&u->buffers, cqe_flags);
+                }
+            } else if (res < 0 && res != -ENOBUFS) {
+                error = -res;
+            }
+            rudpUring_cqe_seen(&u->rx);
+        }
+        if (!u->armed && uring_arm(conn) == -1)
+            return -1;
+        if (n > 0 || error != 0 || (flags & MSG_DONTWAIT))
+            break;
+        if (rudpUring_wait(&u->rx, -1) == -1)
+            return -1;
+    }
+    rx->count = n;
+    if (n == 0) {
+        errno = error != 0 ? error : EAGAIN;
+        return -1;
+    }
+    return n;
+}
+
+// Receive buffers of a single packet, or large enough for the buffers GRO coalesces
+static int rx_alloc(rudpConn *conn) {
+    if (conn->uring != NULL)
+        uring_rx_release(conn);
+    batch_free(conn->rx);
+    int result;
+    if (conn->gro)
+        result = batch_alloc(conn->rx, conn->batch < GRO_BATCH ? conn->batch : GRO_BATCH, GRO_BUFFER_SIZE);
+    else
+        result = batch_alloc(conn->rx, conn->batch, sizeof(Packet));
+    if (result == 0 && conn->uring != NULL && uring_rx_init(conn) == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_WARN, "io_uring receive buffers failed, using the system calls");
+        uring_free(conn);
+    }
+    return result;
+}
+
+int rudpConn_set_batch(rudpConn *conn, unsigned int batch) {
+    if (batch == 0)
+        batch = RUDP_DEFAULT_BATCH;
+    if (batch > RUDP_MAX_BATCH)
+        batch = RUDP_MAX_BATCH;
+    batch_free(conn->tx);
+    conn->batch = batch;
+    if (batch_alloc(conn->tx, batch, sizeof(Packet)) == -1 || rx_alloc(conn) == -1)
+        return -1;
+    return 0;
+}
+
+int rudpConn_set_offload(rudpConn *conn, int enable) {
+    int gso = 0, gro = enable ? 1 : 0;
+    socklen_t len = sizeof(gso);
+
+    // GSO is set per message, the socket option is only read to check that the kernel knows it
+    conn->gso = enable && getsockopt(conn->sockfd, SOL_UDP, UDP_SEGMENT, &gso, &len) == 0;
+    int had_gro = conn->gro;
+    conn->gro = setsockopt(conn->sockfd, SOL_UDP, UDP_GRO, &gro, sizeof(gro)) == 0 && gro;
+    if (conn->gro != had_gro && rx_alloc(conn) == -1)
+        return -1;
+    return (conn->gso ? RUDP_OFFLOAD_GSO : 0) | (conn->gro ? RUDP_OFFLOAD_GRO : 0);
+}
+
+// Connection ID of a new connection, random so a restarted Sender isn't mistaken for its old connection
+static uint32_t conn_id_new() {
+    uint32_t id;
+    if (getrandom(&id, sizeof(id), 0) != sizeof(id))
+        id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    return id;
+}
+
+// State of a connection without its batches and window slots, they are allocated once the connection needs them
+static rudpConn *conn_new(int sockfd, unsigned int window) {
+    if (window == 0)
+        window = RUDP_DEFAULT_WINDOW;
+    if (window > RUDP_MAX_WINDOW)
+        window = RUDP_MAX_WINDOW;
+
+    rudpConn *conn = (rudpConn *)calloc(1, sizeof(rudpConn));
+    if (conn == NULL)
+        return NULL;
+    conn->sockfd = sockfd;
+    conn->conn_id = conn_id_new();
+    conn->window = window;
+    conn->next_seq = 1; // Data packets start right after the SYN
+    conn->send_base = 1;
+    conn->rto = INITIAL_RTO_US;
+    conn->mtu = RUDP_BASE_MTU;
+    conn->mss = RUDP_BASE_MTU - IP_UDP_HEADERS - HEADER_SIZE;
+    conn->ack_every = DEFAULT_ACK_EVERY;
+    conn->ack_delay = DEFAULT_ACK_DELAY_US;
+    conn->cc_ops = &cc_newreno;
+    conn->cc_ops->init(&conn->cc);
+    return conn;
+}
+
+// The socket buffer must hold a burst of packets of the largest MTU, or a burst of jumbo packets overflows it.
+// It's only ever grown, and the kernel caps it at net.core.rmem_max.
+static void socket_rcvbuf(int sockfd, unsigned int packets) {
+    int rcvbuf = 0;
+    socklen_t len = sizeof(rcvbuf);
+    int wanted = (int)(packets * sizeof(Packet));
+    if (getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0 && rcvbuf / 2 < wanted) // The kernel reports twice the size it was given
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &wanted, sizeof(wanted));
+}
+
+rudpConn *rudpConn_alloc(int sockfd, unsigned int window) {
+    rudpConn *conn = conn_new(sockfd, window);
+    if (conn == NULL)
+        return NULL;
+    conn->tx = (ioBatch *)calloc(1, sizeof(ioBatch));
+    conn->rx = (ioBatch *)calloc(1, sizeof(ioBatch));
+    if (conn->tx == NULL || conn->rx == NULL || rudpConn_set_batch(conn, RUDP_DEFAULT_BATCH) == -1) {
+        rudpConn_free(conn);
+        return NULL;
+    }
+    socket_rcvbuf(sockfd, conn->window); // A window of data
+    return conn;
+}
+
+void rudpConn_free(rudpConn *conn) {
+    if (conn == NULL)
+        return;
+    while (conn->send_head != NULL) {
+        sendRequest *next = conn->send_head->next;
+        free(conn->send_head);
+        conn->send_head = next;
+    }
+    free(conn->send_slots);
+    for (unsigned int i = 0; conn->recv_slots != NULL && i < conn->window; i++)
+        free(conn->recv_slots[i].packet);
+    for (unsigned int i = 0; i < conn->spare_count; i++)
+        free(conn->spare_packets[i]);
+    free(conn->recv_slots);
+    free(conn->spare_packets);
+    free(conn->fec_sums);
+    for (unsigned int i = 0; conn->fec_blocks != NULL && i < FEC_BLOCKS; i++)
+        free(conn->fec_blocks[i].sums);
+    free(conn->fec_blocks);
+    free(conn->fec_packet);
+    free(conn->resume);
+    free(conn->peer_resume);
+    // The batches of a server's connection belong to the server
+    if (conn->server == NULL) {
+        uring_free(conn); // First, its requests may point to the batches
+        if (conn->tx != NULL)
+            batch_free(conn->tx);
+        if (conn->rx != NULL)
+            batch_free(conn->rx);
+        free(conn->tx);
+        free(conn->rx);
+    }
+    free(conn);
+}
+
+unsigned int rudpConn_window(const rudpConn *conn) {
+    return conn->window;
+}
+
+int rudpConn_set_integrity(rudpConn *conn, int mode) {
+    if (mode != RUDP_INTEGRITY_CHECKSUM && mode != RUDP_INTEGRITY_CRC32C)
+        return -1;
+    if (mode == RUDP_INTEGRITY_CRC32C)
+        conn->options |= OPTION_CRC32C;
+    else
+        conn->options &= ~OPTION_CRC32C;
+    return 0;
+}
+
+int rudpConn_integrity(const rudpConn *conn) {
+    return conn->options & OPTION_CRC32C ? RUDP_INTEGRITY_CRC32C : RUDP_INTEGRITY_CHECKSUM;
+}
+
+int rudpConn_set_compression(rudpConn *conn, int enable) {
+    if (enable)
+        conn->options |= OPTION_COMPRESS;
+    else
+        conn->options &= ~OPTION_COMPRESS;
+    return 0;
+}
+
+int rudpConn_compression(const rudpConn *conn) {
+    return (conn->options & OPTION_COMPRESS) != 0;
+}
+
+void rudpConn_set_user(rudpConn *conn, void *user) {
+    conn->user = user;
+}
+
+void *rudpConn_user(const rudpConn *conn) {
+    return conn->user;
+}
+
+// Copy resume data to a buffer of RUDP_MAX_RESUME bytes, allocated the first time. Returns -1 on error.
+static int resume_copy(unsigned char **buffer, size_t *buffer_len, const void *data, size_t len) {
+    if (len > RUDP_MAX_RESUME)
+        return -1;
+    if (*buffer == NULL && len > 0) {
+        *buffer = (unsigned char *)malloc(RUDP_MAX_RESUME);
+        if (*buffer == NULL)
+            return -1;
+    }
+    if (len > 0)
+        memcpy(*buffer, data, len);
+    *buffer_len = len;
+    return 0;
+}
+
+int rudpConn_set_resume(rudpConn *conn, const void *data, size_t len) {
+    return resume_copy(&conn->resume, &conn->resume_len, data, len);
+}
+
+size_t rudpConn_resume(const rudpConn *conn, const void **data) {
+    *data = conn->peer_resume;
+    return conn->peer_resume_len;
+}
+
+const struct sockaddr *rudpConn_peer(const rudpConn *conn, socklen_t *len) {
+    if (len != NULL)
+        *len = conn->peer_len;
+    return (const struct sockaddr *)&conn->peer;
+}
+
+int rudpConn_set_delayed_ack(rudpConn *conn, unsigned int packets, unsigned int delay_us) {
+    if (packets == 0)
+        return -1;
+    conn->ack_every = packets;
+    conn->ack_delay = delay_us;
+    return 0;
+}
+
+int rudpConn_set_mtu(rudpConn *conn, unsigned int mtu) {
+    if (mtu != 0 && (mtu < RUDP_BASE_MTU || mtu > RUDP_MAX_MTU))
+        return -1;
+    conn->pmtu_fixed = mtu != 0;
+    conn->mtu = mtu != 0 ? mtu : RUDP_BASE_MTU;
+    conn->mss = conn->mtu - IP_UDP_HEADERS - HEADER_SIZE;
+    return 0;
+}
+
+unsigned int rudpConn_mtu(const rudpConn *conn) {
+    return conn->mtu;
+}
+
+int rudpConn_set_fec(rudpConn *conn, int mode, unsigned int block, unsigned int parity, int adaptive) {
+    if (mode == RUDP_FEC_OFF) {
+        conn->fec_mode = RUDP_FEC_OFF;
+        conn->options &= ~OPTION_FEC;
+        return 0;
+    }
+    if ((mode != RUDP_FEC_XOR && mode != RUDP_FEC_RS) || block == 0 || block > RUDP_FEC_MAX_BLOCK || parity == 0 ||
+        parity > (mode == RUDP_FEC_XOR ? 1 : RUDP_FEC_MAX_PARITY))
+        return -1;
+    uint8_t *sums = (uint8_t *)realloc(conn->fec_sums, (size_t)parity * FEC_UNIT_SIZE);
+    if (sums == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "FEC allocation failed");
+        return -1;
+    }
+    conn->fec_sums = sums;
+    conn->fec_mode = mode;
+    conn->fec_block = block;
+    conn->fec_parity = parity;
+    conn->fec_adaptive = adaptive;
+    conn->fec_count = 0;
+    conn->fec_rows = adaptive ? 1 : parity;
+    conn->options = (conn->options & ~OPTION_FEC) | (mode == RUDP_FEC_RS ? OPTION_FEC_RS : OPTION_FEC_XOR);
+    return 0;
+}
+
+unsigned long rudpConn_fec_recovered(const rudpConn *conn) {
+    return conn->fec_recovered;
+}
+
+unsigned int rudpConn_srtt(const rudpConn *conn) {
+    return (unsigned int)conn->srtt;
+}
+
+unsigned int rudpConn_rto(const rudpConn *conn) {
+    return (unsigned int)conn->rto;
+}
+
+int rudpConn_set_cc(rudpConn *conn, const ccOps *ops) {
+    if (ops == NULL)
+        return -1;
+    conn->cc_ops = ops;
+    conn->cc_ops->init(&conn->cc);
+    return 0;
+}
+
+void rudpConn_stats(const rudpConn *conn, rudpConnStats *stats) {
+    *stats = conn->stats;
+    stats->retransmits = conn->retransmits;
+    stats->rtt_avg = conn->stats.rtt_samples > 0 ? (unsigned int)(conn->rtt_sum / conn->stats.rtt_samples) : 0;
+}
+
+void rudpConn_cc_stats(const rudpConn *conn, rudpCCStats *stats) {
+    stats->cwnd = (unsigned int)conn->cc.cwnd;
+    stats->ssthresh = conn->cc.ssthresh < conn->window ? (unsigned int)conn->cc.ssthresh : conn->window;
+    stats->pacing_rate = conn->cc.pacing_rate;
+    stats->losses = conn->cc.losses;
+    stats->timeouts = conn->cc.timeouts;
+    stats->retransmits = conn->retransmits;
+    stats->packets = conn->tx_count;
+    stats->acks = conn->acks;
+    stats->parity = conn->parity_sent;
+    stats->fec_parity = conn->fec_mode != RUDP_FEC_OFF ? conn->fec_rows : 0;
+}
+
+// Monotonic time in microseconds, used for RTT samples and retransmission deadlines
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Update SRTT/RTTVAR with a new RTT sample and recompute the RTO (Jacobson/Karels, RFC 6298).
+// A new sample also cancels the exponential backoff of earlier timeouts.
+static void rtt_sample(rudpConn *conn, int64_t rtt) {
+    if (rtt <= 0)
+        rtt = 1;
+    unsigned int sample = rtt < UINT32_MAX ? (unsigned int)rtt : UINT32_MAX;
+    if (conn->stats.rtt_samples++ == 0 || sample < conn->stats.rtt_min)
+        conn->stats.rtt_min = sample;
+    if (sample > conn->stats.rtt_max)
+        conn->stats.rtt_max = sample;
+    conn->rtt_sum += sample;
+    if (conn->srtt == 0) {
+        conn->srtt = rtt;
+        conn->rttvar = rtt / 2;
+    } else {
+        int64_t delta = conn->srtt > rtt ? conn->srtt - rtt : rtt - conn->srtt;
+        conn->rttvar = (3 * conn->rttvar + delta) / 4;
+        conn->srtt = (7 * conn->srtt + rtt) / 8;
+    }
+    conn->rto = conn->srtt + (4 * conn->rttvar > 1 ? 4 * conn->rttvar : 1);
+    if (conn->rto < MIN_RTO_US)
+        conn->rto = MIN_RTO_US;
+    if (conn->rto > MAX_RTO_US)
+        conn->rto = MAX_RTO_US;
+}
+
+// Exponential backoff of the RTO after a timeout
+static void rto_backoff(rudpConn *conn) {
+    conn->stats.timeouts++;
+    conn->rto *= 2;
+    if (conn->rto > MAX_RTO_US)
+        conn->rto = MAX_RTO_US;
+}
+
+// Function to calculate checksum
+unsigned short int calculate_checksum(void *data, size_t  bytes) {
+    // SIMD one's complement sum (see RUDP_Checksum.h), a left-over byte is padded with zero
+    return (~csum_fold(csum_add(0, data, bytes)));
+}
+
+// Function to verify checksum of a received packet, bytes is its whole size on the wire (header + data)
+int verify_checksum(Packet *buffer, size_t bytes) {
+    // The checksum field is part of the header, so the sum of a valid packet is all ones
+    void *raw = buffer;
+    int result = csum_fold(csum_add(0, raw, bytes)) == 0xFFFF ? 1 : -1;
+    return result;
+}
+
+// Check the CRC32C of a received packet, it's computed with the field itself zeroed
+static int verify_crc32c(Packet *packet, size_t bytes) {
+    uint32_t expected = ntohl(packet->Checksum);
+    packet->Checksum = 0;
+    void *raw = packet;
+    return crc32c(0, raw, bytes) == expected ? 1 : -1;
+}
+
+// Encode the header of packet (given in host byte order) to the wire format and compute its checksum, or its CRC32C
+// if OPTION_CRC32C is set. The data is the packet's Content, or the Length bytes at payload (sent from there without
+// copying them) if it's not NULL. Returns the size of the packet on the wire: the header and Length bytes of data.
+static size_t packet_encode(Packet *packet, const char *payload) {
+    uint16_t length = packet->Length;
+    int crc = packet->Options & OPTION_CRC32C;
+
+    packet->Version = RUDP_VERSION;
+    packet->Length = htons(length);
+    packet->Window = htons(packet->Window);
+    packet->Options = htons(packet->Options);
+    packet->Seq = htonl(packet->Seq);
+    packet->ConnID = htonl(packet->ConnID);
+    packet->Checksum = 0;
+
+    void *header = packet;
+    const void *data = payload != NULL ? payload : packet->Content;
+    if (crc) {
+        packet->Checksum = htonl(crc32c(crc32c(0, header, HEADER_SIZE), data, length));
+    } else {
+        // The checksum is summed in host byte order, so its two bytes are stored as they are, in the low half of the field
+        uint16_t checksum = ~csum_fold(csum_add(csum_add(0, header, HEADER_SIZE), data, length));
+        packet->Checksum = htonl(ntohs(checksum));
+    }
+    return HEADER_SIZE + length;
+}
+
+// Validate a received datagram of rec_size bytes and decode its header to host byte order.
+// Returns rec_size, or -2 if the packet is malformed or corrupted (the caller drops it).
+static ssize_t packet_decode(Packet *packet, ssize_t rec_size) {
+    if ((size_t)rec_size < HEADER_SIZE || packet->Version != RUDP_VERSION)
+        return -2;
+    if (ntohs(packet->Options) & OPTION_CRC32C ? verify_crc32c(packet, rec_size) == -1 : verify_checksum(packet, rec_size) == -1)
+        return -2;
+    packet->Options = ntohs(packet->Options);
+    packet->Length = ntohs(packet->Length);
+    packet->Window = ntohs(packet->Window);
+    packet->Seq = ntohl(packet->Seq);
+    packet->ConnID = ntohl(packet->ConnID);
+    if (packet->Length != rec_size - HEADER_SIZE)
+        return -2;
+    return rec_size;
+}
+
+// Group the queued packets from index first into GSO messages: a run of packets of the same size
+// (the last one may be shorter) to the same address goes to the kernel as one buffer, that it splits back to datagrams.
+// Returns the number of messages in tx.gso_msgs.
+static unsigned int gso_group(rudpConn *conn, unsigned int first) {
+    ioBatch *tx = conn->tx;
+    unsigned int groups = 0;
+    for (unsigned int i = first; i < tx->count; groups++) {
+        size_t segment = TX_SIZE(tx, i);
+        size_t max = GSO_MAX_BYTES / segment < GSO_MAX_SEGMENTS ? GSO_MAX_BYTES / segment : GSO_MAX_SEGMENTS;
+        unsigned int k = 1;
+        struct msghdr *first_msg = &tx->msgs[i].msg_hdr;
+        while (i + k < tx->count && k < max && TX_SIZE(tx, i + k) <= segment &&
+               tx->msgs[i + k].msg_hdr.msg_namelen == first_msg->msg_namelen &&
+               memcmp(tx->msgs[i + k].msg_hdr.msg_name, first_msg->msg_name, first_msg->msg_namelen) == 0) {
+            k++;
+            if (TX_SIZE(tx, i + k - 1) < segment)
+                break;
+        }
+
+        struct msghdr *msg = &tx->gso_msgs[groups].msg_hdr;
+        msg->msg_name = first_msg->msg_name;
+        msg->msg_namelen = first_msg->msg_namelen;
+        msg->msg_iov = &tx->iov[2 * i];
+        msg->msg_iovlen = 2 * k; // The kernel splits the bytes of all the iovecs at every segment bytes
+        msg->msg_control = NULL;
+        msg->msg_controllen = 0;
+        if (k > 1) {
+            msg->msg_control = tx->control + groups * CONTROL_SIZE;
+            msg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = segment;
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+        i += k;
+    }
+    return groups;
+}
+
+static int uring_chain(rudpConn *conn, uringSend *s);
+
+// All the requests of a submitted batch completed, and the one at s->failed - 1 failed with s->error (the ones linked
+// after it were cancelled). It's handled as tx_flush handles a failure of sendmmsg: the messages after it are sent
+// again, unless the socket buffer of a server is full (they're dropped) or the error is for good.
+static void uring_send_failed(rudpConn *conn, uringSend *s) {
+    uringEngine *u = conn->uring;
+    unsigned int i = s->failed - 1;
+    int error = s->error;
+    s->failed = 0;
+    unsigned int next = i + 1; // The messages after the one that failed
+    if (s->gso && (error == EIO || error == EINVAL || error == ENOPROTOOPT || error == EOPNOTSUPP)) {
+        if (conn->gso)
+            RUDP_LOG(RUDP_LOG_WARN, "UDP GSO isn't supported, sending without it.");
+        conn->gso = 0;
+        // The packets of the group that failed and of the ones after it are sent again one by one
+        unsigned int packet = (unsigned int)(s->msgs[i].msg_hdr.msg_iov - s->batch.iov) / 2;
+        s->msgs = s->batch.msgs + packet;
+        s->count = s->batch.count - packet;
+        s->gso = 0;
+        next = 0;
+    } else if (error != EMSGSIZE && (!conn->nonblocking || error == EAGAIN || error == EWOULDBLOCK)) {
+        if (!conn->nonblocking) {
+            errno = error;
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packets failed to be send");
+            u->tx_error = error;
+        }
+        return;
+    }
+    s->msgs += next;
+    s->count -= next;
+    if (s->count > 0 && uring_chain(conn, s) == -1)
+        u->tx_error = errno;
+}
+
+// Take the completions of the sends: a batch is free again once all of its requests completed
+static void uring_reap(rudpConn *conn) {
+    uringEngine *u = conn->uring;
+    struct io_uring_cqe *cqe;
+    while ((cqe = rudpUring_cqe(&u->tx)) != NULL) {
+        uringSend *s = &u->sends[cqe->user_data >> 32];
+        unsigned int i = (unsigned int)cqe->user_data;
+        int res = cqe->res;
+        rudpUring_cqe_seen(&u->tx);
+        if (res < 0 && res != -ECANCELED && (s->failed == 0 || i + 1 < s->failed)) {
+            s->failed = i + 1;
+            s->error = -res;
+        }
+        if (--s->pending == 0 && s->failed > 0)
+            uring_send_failed(conn, s);
+    }
+}
+
+// Queue the messages of a submitted batch as one chain of linked sendmsg requests, so they go out in order, and
+// submit them without waiting. Returns -1 on error (errno is set).
+static int uring_chain(rudpConn *conn, uringSend *s) {
+    uringEngine *u = conn->uring;
+    uint64_t index = (uint64_t)(s - u->sends);
+    for (unsigned int i = 0; i < s->count; i++) {
+        struct io_uring_sqe *sqe = rudpUring_sqe(&u->tx);
+        if (sqe == NULL)
+            return -1;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn->sockfd;
+        sqe->addr = (uint64_t)(uintptr_t)&s->msgs[i].msg_hdr;
+        sqe->len = 1;
+        sqe->msg_flags = conn->nonblocking ? MSG_DONTWAIT : 0;
+        sqe->user_data = index << 32 | i;
+        if (i + 1 < s->count)
+            sqe->flags = IOSQE_IO_LINK;
+        s->pending++;
+    }
+    return rudpUring_submit(&u->tx, 0) == -1 ? -1 : 0;
+}
+
+// Returns a send batch whose requests all completed, sized as the connection's one, waiting until the kernel is done
+// with one if all of them are in flight. NULL on error (errno is set).
+static uringSend *uring_send_free(rudpConn *conn) {
+    uringEngine *u = conn->uring;
+    while (1) {
+        uring_reap(conn);
+        if (u->tx_error != 0) {
+            errno = u->tx_error;
+            return NULL;
+        }
+        for (int i = 0; i < URING_SENDS; i++) {
+            uringSend *s = &u->sends[i];
+            if (s->pending > 0)
+                continue;
+            if (s->batch.size != conn->tx->size) {
+                batch_free(&s->batch);
+                if (batch_alloc(&s->batch, conn->tx->size, conn->tx->buffer_size) == -1)
+                    return NULL;
+            }
+            return s;
+        }
+        if (rudpUring_wait(&u->tx, -1) == -1 && errno != EINTR)
+            return NULL;
+    }
+}
+
+// Send the send batch as one chain of requests without waiting for them: the batch is set aside, with everything its
+// messages point to, until they completed, and the connection fills a free one meanwhile. Its failures are handled
+// once they complete (see uring_send_failed). Returns -1 on error (errno is set).
+static int uring_flush(rudpConn *conn) {
+    ioBatch *tx = conn->tx;
+    uringSend *s = uring_send_free(conn);
+    if (s == NULL)
+        return -1;
+    s->gso = conn->gso;
+    s->count = s->gso ? gso_group(conn, 0) : tx->count;
+    s->msgs = s->gso ? tx->gso_msgs : tx->msgs;
+    // The messages point into the arrays of the batch, that move with it (connections of a server keep the ioBatch itself)
+    ioBatch filled = *tx;
+    *tx = s->batch;
+    s->batch = filled;
+    tx->count = 0;
+    return uring_chain(conn, s);
+}
+
+// Wait until the kernel completed every send, the memory they point to may be reused then. Returns -1 if a send
+// failed for good (errno is set).
+static int uring_drain(rudpConn *conn) {
+    uringEngine *u = conn->uring;
+    while (1) {
+        uring_reap(conn);
+        int busy = 0;
+        for (int i = 0; i < URING_SENDS; i++)
+            busy |= u->sends[i].pending > 0;
+        if (!busy)
+            break;
+        if (rudpUring_wait(&u->tx, -1) == -1 && errno != EINTR)
+            return -1;
+    }
+    if (u->tx_error != 0) {
+        errno = u->tx_error;
+        return -1;
+    }
+    return 0;
+}
+
+// Send every packet queued in the send batch, with as few sendmmsg calls as possible.
+// With GSO, the kernel segments each group of packets, and if it can't, GSO is turned off and the packets are sent one by one.
+static int tx_flush(rudpConn *conn) {
+    if (conn->server != NULL)
+        conn = conn->server->io;
+    if (conn->uring != NULL && conn->tx->count > 0) {
+        if (uring_flush(conn) == 0)
+            return 1;
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packets failed to be send");
+        conn->tx->count = 0;
+        close(conn->sockfd);
+        return -1;
+    }
+    unsigned int sent = 0; // Packets sent so far
+    while (sent < conn->tx->count) {
+        int n;
+        unsigned int packets = 0;
+        if (conn->gso) {
+            unsigned int groups = gso_group(conn, sent);
+            n = sendmmsg(conn->sockfd, conn->tx->gso_msgs, groups, 0);
+            for (int g = 0; g < n; g++)
+                packets += conn->tx->gso_msgs[g].msg_hdr.msg_iovlen / 2;
+        } else {
+            n = sendmmsg(conn->sockfd, conn->tx->msgs + sent, conn->tx->count - sent, 0);
+            packets = n;
+        }
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            // No segmentation offload on this path (e.g. the device has no checksum offload)
+            if (conn->gso && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+                RUDP_LOG(RUDP_LOG_WARN, "UDP GSO isn't supported, sending without it.");
+                conn->gso = 0;
+                continue;
+            }
+            // A datagram larger than the MTU of the route is dropped, as the path would drop it: a probe that is too
+            // large gets no reply, and a chunk is retransmitted until pmtu_blackhole makes the packets smaller
+            if (errno == EMSGSIZE) {
+                sent += conn->gso ? conn->tx->gso_msgs[0].msg_hdr.msg_iovlen / 2 : 1;
+                continue;
+            }
+            // A server doesn't stop for one peer: when the socket buffer is full the rest of the batch is dropped
+            // (the peers retransmit), and a datagram the kernel refuses is skipped
+            if (conn->nonblocking) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                sent += conn->gso ? conn->tx->gso_msgs[0].msg_hdr.msg_iovlen / 2 : 1;
+                continue;
+            }
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packets failed to be send");
+            conn->tx->count = 0;
+            close(conn->sockfd);
+            return -1;
+        }
+        sent += packets;
+    }
+    conn->tx->count = 0;
+    return 1;
+}
+
+// With the io_uring engine the sent batches are still in flight when tx_flush returns: wait for them before the
+// memory their packets point to goes back to the user. Returns -1 if a send failed (errno is set).
+static int tx_drain(rudpConn *conn) {
+    if (conn->server != NULL)
+        conn = conn->server->io;
+    if (conn->uring == NULL)
+        return 0;
+    return uring_drain(conn);
+}
+
+// Returns the next free packet of the send batch (the batch is sent first if it's full), NULL on error.
+// The caller fills the header in host byte order and the content, then queues it with tx_commit.
+static Packet *tx_next(rudpConn *conn) {
+    if (conn->tx->count == conn->tx->size && tx_flush(conn) == -1)
+        return NULL;
+    return BATCH_PACKET(conn->tx, conn->tx->count);
+}
+
+// Queue the packet returned by tx_next to the address name, as a packet of connection conn_id with the given options.
+// Its data is in its Content, or at payload (that must stay valid until the batch is sent).
+static void tx_queue(ioBatch *tx, uint32_t conn_id, uint16_t options, const char *payload, const void *name, socklen_t name_len) {
+    unsigned int i = tx->count++;
+    Packet *packet = BATCH_PACKET(tx, i);
+    packet->ConnID = conn_id;
+    packet->Options = options;
+    size_t length = packet->Length;
+    size_t size = packet_encode(packet, payload);
+    tx->iov[2 * i].iov_len = payload == NULL ? size : HEADER_SIZE;
+    tx->iov[2 * i + 1].iov_base = (void *)payload;
+    tx->iov[2 * i + 1].iov_len = payload == NULL ? 0 : length;
+    tx->msgs[i].msg_hdr.msg_iovlen = payload == NULL ? 1 : 2;
+    // The address is copied, a connection may be gone by the time a server flushes its batch
+    memcpy(&tx->addrs[i], name, name_len);
+    tx->msgs[i].msg_hdr.msg_namelen = name_len;
+}
+
+static void tx_commit(rudpConn *conn) {
+    tx_queue(conn->tx, conn->conn_id, conn->options, NULL, &conn->peer, conn->peer_len);
+}
+
+// Receive a batch of datagrams with a single recvmmsg call (blocks until the first one, unless flags has MSG_DONTWAIT).
+// Returns the number of datagrams, -1 on error (errno is set).
+static int rx_fill(rudpConn *conn, int flags) {
+    if (conn->uring != NULL)
+        return uring_receive(conn, flags);
+    for (unsigned int i = 0; i < conn->rx->size; i++) {
+        struct msghdr *msg = &conn->rx->msgs[i].msg_hdr;
+        msg->msg_namelen = sizeof(struct sockaddr_storage);
+        msg->msg_control = conn->gro ? conn->rx->control + i * CONTROL_SIZE : NULL;
+        msg->msg_controllen = conn->gro ? CONTROL_SIZE : 0;
+    }
+    conn->rx->pos = 0;
+    conn->rx->offset = 0;
+    conn->rx->count = 0;
+    int n = recvmmsg(conn->sockfd, conn->rx->msgs, conn->rx->size, MSG_WAITFORONE | flags, NULL);
+    if (n == -1)
+        return -1;
+    conn->rx->count = n;
+    return n;
+}
+
+// Wait until packets arrive or the deadline (monotonic microseconds, UINT64_MAX waits with no limit) passes, and receive them.
+// Returns the number of datagrams, 0 if the deadline passed, -1 on error (errno is set).
+static int rx_wait(rudpConn *conn, uint64_t deadline) {
+    if (deadline == UINT64_MAX)
+        return rx_fill(conn, 0);
+    uint64_t now = now_us();
+    if (now >= deadline)
+        return 0;
+    if (conn->uring != NULL) {
+        int ready = rudpUring_wait(&conn->uring->rx, (int64_t)(deadline - now));
+        if (ready <= 0)
+            return ready;
+        int n = rx_fill(conn, MSG_DONTWAIT);
+        if (n == -1 && errno == EAGAIN)
+            return 0;
+        return n;
+    }
+    struct pollfd pfd = { .fd = conn->sockfd, .events = POLLIN };
+    struct timespec timeout = { (deadline - now) / 1000000, ((deadline - now) % 1000000) * 1000 };
+    int ready = ppoll(&pfd, 1, &timeout, NULL);
+    if (ready <= 0)
+        return ready;
+    int n = rx_fill(conn, MSG_DONTWAIT);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    return n;
+}
+
+// Size of the packets that GRO coalesced into a received datagram, or 0 if it holds a single packet
+static size_t gro_segment(struct msghdr *msg) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segment;
+            memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            return segment > 0 ? segment : 0;
+        }
+    }
+    return 0;
+}
+
+// Take the next packet of the receive batch and decode it, its message (with the source address) is stored in from (if not NULL).
+// A datagram coalesced by GRO is split back to the packets it holds.
+// Returns its size on the wire, -2 if it's malformed or corrupted (the caller drops it), 0 if the batch is done.
+static ssize_t rx_next(rudpConn *conn, Packet **packet, struct mmsghdr **from) {
+    ioBatch *rx = conn->rx;
+    if (rx->pos == rx->count)
+        return 0;
+    unsigned int i = rx->pos;
+    size_t total = rx->msgs[i].msg_len;
+    size_t size = total - rx->offset;
+    if (conn->gro) {
+        size_t segment = gro_segment(&rx->msgs[i].msg_hdr);
+        if (segment > 0 && segment < size)
+            size = segment;
+    }
+
+    *packet = (Packet *)(void *)((char *)rx->iov[2 * i].iov_base + rx->offset);
+    rx->last = i;
+    if (from != NULL)
+        *from = &rx->msgs[i];
+    rx->offset += size;
+    if (rx->offset >= total) {
+        rx->pos++;
+        rx->offset = 0;
+    }
+    ssize_t decoded = packet_decode(*packet, size);
+    if (decoded == -2)
+        conn->stats.checksum_failures++;
+    return decoded;
+}
+
+// Take the buffer of packet, the last one rx_next returned, out of the receive batch, and give the batch spare instead.
+// Returns NULL if the buffer holds other packets as well (coalesced by GRO), then the packet must be copied.
+static Packet *rx_take(ioBatch *rx, Packet *packet, Packet *spare) {
+    struct iovec *iov = &rx->iov[2 * rx->last];
+    if (rx->in_place || iov->iov_base != (void *)packet || rx->buffer_size != sizeof(Packet))
+        return NULL;
+    iov->iov_base = spare;
+    return packet;
+}
+
+// Grow rows of FEC parity sums, whose first length bytes are in use, to size bytes: the sums are as long as the largest
+// packet in them, and the bytes after it are zeroed only once a packet needs them
+static void fec_extend(uint8_t *sums, unsigned int rows, size_t *length, size_t size) {
+    if (size <= *length)
+        return;
+    for (unsigned int row = 0; row < rows; row++)
+        memset(sums + row * FEC_UNIT_SIZE + *length, 0, size - *length);
+    *length = size;
+}
+
+// Add coef times a data packet, its length followed by its data, to a row of FEC parity sums
+static void fec_sum(uint8_t *row, uint8_t coef, const char *data, unsigned int data_length) {
+    uint8_t prefix[FEC_LENGTH_SIZE] = { (uint8_t)(data_length >> 8), (uint8_t)data_length };
+    fec_mul_add(row, prefix, coef, FEC_LENGTH_SIZE);
+    fec_mul_add(row + FEC_LENGTH_SIZE, (const uint8_t *)data, coef, data_length);
+}
+
+// *** Sender's functions: ***
+
+// Keep what the Sender needs of a received ACK: its SACK bitmap (or the Receiver's resume data), and the window and
+// options of the Receiver
+static void ack_store(rudpConn *conn, const Packet *ack) {
+    conn->sack = (const uint8_t *)ack->Content;
+    conn->sack_bytes = ack->Length;
+    if (ack->Options & OPTION_RESUME) {
+        if (resume_copy(&conn->peer_resume, &conn->peer_resume_len, ack->Content, ack->Length) == -1)
+            RUDP_LOG(RUDP_LOG_WARN, "Resume data of the Receiver ignored");
+        conn->sack_bytes = 0;
+    }
+    conn->acks++;
+    conn->peer_window = ack->Window;
+    conn->peer_options = ack->Options;
+}
+
+// MTU of the route to the peer as the kernel knows it (the MTU of the device, or a smaller one an ICMP message taught it),
+// at most RUDP_MAX_MTU, 0 if it can't tell. Only a connected socket tells it, so a socket is connected to the peer for that.
+static unsigned int route_mtu(const rudpConn *conn) {
+    int mtu = 0;
+    socklen_t len = sizeof(mtu);
+    int soc = socket(conn->peer.ss_family, SOCK_DGRAM, 0);
+    if (soc == -1)
+        return 0;
+    if (connect(soc, (const struct sockaddr *)&conn->peer, conn->peer_len) == -1 ||
+        getsockopt(soc, IPPROTO_IP, IP_MTU, &mtu, &len) == -1)
+        mtu = 0;
+    close(soc);
+    if (mtu > RUDP_MAX_MTU)
+        mtu = RUDP_MAX_MTU;
+    return mtu > 0 ? (unsigned int)mtu : 0;
+}
+
+// Start the path MTU search once the peer is known. Packets get DF, so the IP layer never fragments them, and
+// IP_PMTUDISC_PROBE keeps the kernel from refusing a probe because of what it thinks the path MTU is. The search is
+// bounded by the MTU of the route, the device can't send larger packets without fragmenting them.
+static void pmtu_init(rudpConn *conn) {
+    if (conn->pmtu_fixed)
+        return;
+    int probe = IP_PMTUDISC_PROBE;
+    conn->pmtu_max = route_mtu(conn);
+    if (conn->pmtu_max < RUDP_BASE_MTU || setsockopt(conn->sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &probe, sizeof(probe)) == -1) {
+        conn->pmtu_fixed = 1; // The packets stay at the base MTU
+        return;
+    }
+    conn->probe_size = 0;
+    conn->probe_failed = 0;
+    conn->pmtu_raise_at = 0;
+}
+
+// The search is over once the gap to the largest MTU that may work is too small to matter, it starts again later
+// (the path may have changed)
+static int pmtu_settled(rudpConn *conn, uint64_t now) {
+    if (conn->pmtu_max >= conn->mtu + PMTU_STEP)
+        return 0;
+    conn->pmtu_raise_at = now + PMTU_RAISE_US;
+    return 1;
+}
+
+// Queue the next PMTU probe, or the one that got no reply within the RTO again. Probes are sent as the Sender sends
+// data (an idle connection isn't probed), one per RTO at most, and aren't counted in the congestion window.
+// Returns -1 on error.
+static int pmtu_probe(rudpConn *conn, uint64_t now) {
+    if (conn->pmtu_fixed)
+        return 0;
+    if (conn->pmtu_raise_at != 0) {
+        if (now < conn->pmtu_raise_at)
+            return 0;
+        conn->pmtu_raise_at = 0;
+        conn->pmtu_max = route_mtu(conn);
+        conn->probe_failed = 0;
+    }
+    if (conn->probe_size != 0) {
+        if (now < conn->probe_sent_at + conn->rto)
+            return 0;
+        // No reply to any of the attempts, the path doesn't carry packets of this size
+        if (++conn->probe_attempts >= PROBE_ATTEMPTS) {
+            conn->pmtu_max = conn->probe_size - 1;
+            conn->probe_failed = 1;
+            conn->probe_size = 0;
+        }
+    }
+    if (conn->probe_size == 0) {
+        if (pmtu_settled(conn, now))
+            return 0;
+        // Most paths carry the MTU of the route, so it's tried first, after a probe failed the gap is halved
+        conn->probe_size = conn->probe_failed ? (conn->mtu + conn->pmtu_max + 1) / 2 : conn->pmtu_max;
+        conn->probe_id++;
+        conn->probe_attempts = 0;
+    }
+
+    Packet *probe = tx_next(conn);
+    if (probe == NULL)
+        return -1;
+    size_t length = conn->probe_size - IP_UDP_HEADERS - HEADER_SIZE;
+    memset(probe, 0, HEADER_SIZE + length); // The probe is padded with zeros
+    probe->Length = length;
+    probe->Flag = 'P';
+    probe->Seq = conn->probe_id;
+    probe->Window = conn->window;
+    tx_commit(conn);
+    conn->probe_sent_at = now;
+    return 0;
+}
+
+// The reply of a probe arrived: the path carries packets of its size, the next chunks are that large
+static void pmtu_reply(rudpConn *conn, unsigned int id, uint64_t now) {
+    if (conn->probe_size == 0 || id != conn->probe_id) // A late reply of a probe that was given up on
+        return;
+    conn->mtu = conn->probe_size;
+    conn->mss = conn->mtu - IP_UDP_HEADERS - HEADER_SIZE;
+    conn->probe_size = 0;
+    pmtu_settled(conn, now);
+}
+
+// A chunk larger than the base MTU keeps getting lost, the path MTU may have shrunk below it behind a router that drops
+// large packets without an ICMP message (a black hole). New chunks fall back to the base MTU and the search stops,
+// and DF is cleared so the chunks that were already sized to the old MTU get through as fragments.
+static void pmtu_blackhole(rudpConn *conn) {
+    int dont = IP_PMTUDISC_DONT;
+    RUDP_LOG(RUDP_LOG_WARN, "Packets of %u bytes seem to be lost in a black hole, falling back to an MTU of %u.", conn->mtu, RUDP_BASE_MTU);
+    conn->pmtu_fixed = 1;
+    conn->probe_size = 0;
+    conn->mtu = RUDP_BASE_MTU;
+    conn->mss = conn->mtu - IP_UDP_HEADERS - HEADER_SIZE;
+    setsockopt(conn->sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &dont, sizeof(dont));
+}
+
+// Function that checks if Sender got ACK Packet before the deadline (monotonic microseconds),
+// the cumulative ACK is stored in ack_seq and its SACK bitmap in the connection. Returns -10 if the deadline passed.
+int got_ACK(rudpConn *conn, unsigned int *ack_seq, uint64_t deadline) {
+    Packet *buffer;
+
+    // Packets that are not ACKs (e.g. stray Data/SYN) or belong to another connection are skipped
+    // Packets that are corrupted are skipped as well
+    int late = 0;
+    while (1) {
+        // ACKs that arrived in the last batch are returned before waiting for more
+        ssize_t ACK = rx_next(conn, &buffer, NULL);
+        if (ACK == -2)
+            continue;
+        if (ACK > 0) {
+            if (buffer->Flag == 'A' && buffer->ConnID == conn->conn_id) {
+                *ack_seq = buffer->Seq;
+                ack_store(conn, buffer);
+                return 1; // Successfully received ACK
+            }
+            if (buffer->Flag == 'P' && buffer->ConnID == conn->conn_id)
+                pmtu_reply(conn, buffer->Seq, now_us());
+            continue;
+        }
+
+        // Wait for a packet until the deadline (UINT64_MAX waits with no limit)
+        // Receive all the ACKs that are waiting with one call
+        if (now_us() >= deadline) {
+            // ACKs that arrived while the Sender was busy (on one CPU, the Receiver may run during its flush) are
+            // taken before the deadline counts as passed
+            if (!late && rx_fill(conn, MSG_DONTWAIT) > 0) {
+                late = 1;
+                continue;
+            }
+            return -10;
+        }
+        if (rx_wait(conn, deadline) == -1 && errno != EINTR) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "ACK packet failed to be received.");
+            close(conn->sockfd);
+            return -1;
+        }
+    }
+}
+
+// Returns 1 if the last ACK (cumulative ack_seq) acknowledged the packet seq: it's before ack_seq, or it's in the SACK bitmap
+static int ack_covers(const rudpConn *conn, unsigned int ack_seq, unsigned int seq) {
+    if ((int)(ack_seq - seq) > 0)
+        return 1;
+    unsigned int bit = seq - ack_seq - 1;
+    if (seq == ack_seq || bit / 8 >= conn->sack_bytes)
+        return 0;
+    return (conn->sack[bit / 8] >> (bit % 8)) & 1;
+}
+
+// Queue a control packet (SYN/FIN) with sequence number seq, it's sent with the next batch. Control packets are
+// header-only, but a SYN carries the Sender's resume data when it set some.
+static int queue_control(rudpConn *conn, char flag, unsigned int seq) {
+    Packet *control = tx_next(conn);
+    if (control == NULL)
+        return -1;
+    memset(control, 0, HEADER_SIZE); // ensure header is clean
+    control->Length = 0;
+    control->Flag = flag;
+    control->Seq = seq;
+    control->Window = conn->window;
+    if (flag == 'S' && conn->resume_len > 0) {
+        memcpy(control->Content, conn->resume, conn->resume_len);
+        control->Length = conn->resume_len;
+        tx_queue(conn->tx, conn->conn_id, conn->options | OPTION_RESUME, NULL, &conn->peer, conn->peer_len);
+        return 1;
+    }
+    tx_commit(conn);
+    return 1;
+}
+
+// Send a control packet (SYN/FIN) and wait for the ACK of its sequence number, retransmit on timeout
+static int send_control(rudpConn *conn, char flag, unsigned int seq) {
+    int attempts = 0;
+    // The function wait for an acknowledgment packet, if it didnt receive any, retransmits the packet till default max_attempts
+    // This for preventing infinite loops in case of persistent failures
+    while (attempts < MAX_RETRANSMISSION_ATTEMPTS) {
+        if (queue_control(conn, flag, seq) == -1 || tx_flush(conn) == -1) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "%s packet failed to be send", flag == 'S' ? "SYN" : "FIN");
+            return -1;
+        }
+
+        uint64_t sent_at = now_us();
+        uint64_t deadline = sent_at + conn->rto;
+        unsigned int ack_seq;
+        int ACK_Status;
+        // ACKs of older data packets may still arrive, wait for a cumulative ACK past this packet
+        do {
+            ACK_Status = got_ACK(conn, &ack_seq, deadline);
+        } while (ACK_Status == 1 && (int)(ack_seq - seq) <= 0);
+
+        // Check if no timeout, out of the loop
+        if (ACK_Status != -10) {
+            if (ACK_Status == 1 && attempts == 0) {
+                rtt_sample(conn, now_us() - sent_at);
+                cc_update_pacing(&conn->cc, conn->srtt, HEADER_SIZE + conn->mss);
+            }
+            return ACK_Status;
+        }
+        rto_backoff(conn);
+        attempts++;
+        RUDP_LOG(RUDP_LOG_DEBUG, "Retransmission attempt %d", attempts);
+    }
+    return -1;
+}
+
+// The ACK of the SYN arrived: adopt what the Receiver agreed to and allocate the window. Returns 1, or -1 on error.
+static int connect_established(rudpConn *conn) {
+    // Never have more in flight than the Receiver can buffer
+    if (conn->peer_window > 0 && conn->peer_window < conn->window)
+        conn->window = conn->peer_window;
+    // CRC32C, FEC and compression are used only if the Receiver agreed to them
+    if (!(conn->peer_options & OPTION_CRC32C))
+        conn->options &= ~OPTION_CRC32C;
+    if (!(conn->peer_options & OPTION_COMPRESS))
+        conn->options &= ~OPTION_COMPRESS;
+    if (FEC_OPTION_MODE(conn->peer_options) != conn->fec_mode) {
+        conn->options &= ~OPTION_FEC;
+        conn->fec_mode = RUDP_FEC_OFF;
+    }
+    free(conn->send_slots);
+    conn->send_slots = (sendSlot *)calloc(conn->window, sizeof(sendSlot));
+    if (conn->send_slots == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Window allocation failed");
+        return -1;
+    }
+    return 1;
+}
+
+// Creating handshake between two peers (Sender send SYN message, Rec recieved the SYN message & send ACK, Sender recieve ACK)
+// An image of the TCP connect() function that will ensure a handshake
+int handshake_connect(rudpConn *conn, struct sockaddr *serv_addr, socklen_t addrlen) {
+    RUDP_LOG(RUDP_LOG_INFO, "Sending request for RDUP connection");
+
+    memcpy(&conn->peer, serv_addr, addrlen);
+    conn->peer_len = addrlen;
+    pmtu_init(conn);
+
+    // Send SYN message - send just flag without a real data, the SYN takes sequence number 0
+    int ACK_Status = send_control(conn, 'S', 0);
+    if (ACK_Status == 1) {
+        RUDP_LOG(RUDP_LOG_INFO, "Got ACK from Receiver.");
+        return connect_established(conn);
+    }
+    if (ACK_Status == -1) {
+        // If maximum retransmission attempts reached
+        RUDP_LOG(RUDP_LOG_ERROR, "Maximum retransmission attempts reached. Handshake failed.");
+    }
+    return ACK_Status;
+}
+
+// Build the data packet with sequence number seq in the send batch, its content is sent straight from the user's buffer
+// (the data of its window slot). ack_now asks the Receiver to acknowledge it without delay.
+static int send_data(rudpConn *conn, unsigned int seq, int ack_now) {
+    sendSlot *slot = &conn->send_slots[seq % conn->window];
+
+    Packet *data = tx_next(conn);
+    if (data == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "data packet failed to be send");
+        return -1;
+    }
+    memset(data, 0, HEADER_SIZE); // ensure header is clean
+    data->Length = slot->length;
+    data->Flag = 'D';
+    data->Seq = seq;
+    data->Window = slot->fec_tag;
+    conn->stats.packets_sent++;
+    conn->stats.bytes_sent += slot->length;
+    tx_queue(conn->tx, conn->conn_id, conn->options | (ack_now ? OPTION_ACK_NOW : 0), slot->data, &conn->peer, conn->peer_len);
+    return 1;
+}
+
+// Charge bytes to the pacing budget: the next packet may be sent once they drain at the pacing rate.
+// The budget isn't accumulated while the connection is idle, so pacing never allows a burst.
+static void pace(rudpConn *conn, uint64_t now, size_t bytes) {
+    if (conn->next_send_at < now)
+        conn->next_send_at = now;
+    if (conn->cc.pacing_rate > 0)
+        conn->next_send_at += bytes * 1000000 / conn->cc.pacing_rate;
+}
+
+// Signal a loss to the congestion controller, once per window of data (NewReno recovery)
+static void loss_event(rudpConn *conn, unsigned int seq, unsigned int next, int timeout) {
+    if (timeout) {
+        conn->cc_ops->on_timeout(&conn->cc);
+    } else {
+        if ((int)(seq - conn->recovery_point) < 0)
+            return;
+        conn->cc_ops->on_loss(&conn->cc);
+    }
+    conn->recovery_point = next;
+    cc_update_pacing(&conn->cc, conn->srtt, HEADER_SIZE + conn->mss);
+}
+
+// Retransmit a chunk that is considered lost
+static int retransmit(rudpConn *conn, unsigned int seq, uint64_t now) {
+    sendSlot *slot = &conn->send_slots[seq % conn->window];
+    if (++slot->attempts >= MAX_RETRANSMISSION_ATTEMPTS) {
+        // If maximum retransmission attempts reached
+        RUDP_LOG(RUDP_LOG_ERROR, "Maximum retransmission attempts reached. Sending the data failed.");
+        return -1;
+    }
+    RUDP_LOG(RUDP_LOG_DEBUG, "Retransmission attempt %d (packet %u)", slot->attempts, seq);
+    if (slot->attempts == PMTU_BLACKHOLE_ATTEMPTS && !conn->pmtu_fixed && slot->length > RUDP_BASE_MTU - IP_UDP_HEADERS - HEADER_SIZE)
+        pmtu_blackhole(conn);
+    conn->retransmits++;
+    slot->sent_at = now;
+    slot->tx_order = ++conn->tx_count;
+    pace(conn, now, HEADER_SIZE + slot->length);
+    return send_data(conn, seq, 1);
+}
+
+// Add the new chunk seq to the FEC block being sent, or start a block with it: the parity sums of the block and the tag
+// of the chunk. A block is at most half the congestion window, so its parity packets arrive within the RTT its lost
+// packets would wait for. With adaptive FEC, the parity packets of a block follow the estimated loss rate.
+static void fec_add(rudpConn *conn, unsigned int seq) {
+    sendSlot *slot = &conn->send_slots[seq % conn->window];
+    if (conn->fec_count == 0) {
+        conn->fec_first = seq;
+        conn->fec_length = 0;
+        if (conn->fec_adaptive) {
+            double expected = FEC_MARGIN * conn->fec_loss * conn->fec_block; // Lost packets, with a margin
+            conn->fec_rows = (unsigned int)expected + (expected > (unsigned int)expected);
+            if (conn->fec_rows < 1)
+                conn->fec_rows = 1;
+            if (conn->fec_rows > conn->fec_parity)
+                conn->fec_rows = conn->fec_parity;
+        }
+    }
+    unsigned int index = conn->fec_count++;
+    fec_extend(conn->fec_sums, conn->fec_rows, &conn->fec_length, FEC_LENGTH_SIZE + slot->length);
+    for (unsigned int row = 0; row < conn->fec_rows; row++)
+        fec_sum(conn->fec_sums + row * FEC_UNIT_SIZE, fec_coef(conn->fec_mode, row, index), slot->data, slot->length);
+    slot->fec_tag = (uint16_t)(index << 8 | conn->fec_rows);
+}
+
+// The FEC block being sent ends with the chunk just added: after fec_block chunks, half the congestion window, or when
+// the Sender has to wait for ACKs (the queue is empty or the window is full)
+static int fec_block_end(const rudpConn *conn) {
+    unsigned int half_cwnd = (unsigned int)conn->cc.cwnd / 2;
+    return conn->fec_count == conn->fec_block || conn->fec_count >= (half_cwnd > 1 ? half_cwnd : 1) ||
+           conn->send_cursor == NULL || conn->next_seq - conn->send_base >= conn->window;
+}
+
+// End the FEC block being sent: queue its parity packets, paced like data but outside the window (they are never
+// retransmitted), and update the loss estimate with the chunks ACKs reported missing while it was sent.
+// Returns -1 on error.
+static int fec_flush(rudpConn *conn, uint64_t now) {
+    for (unsigned int row = 0; row < conn->fec_rows; row++) {
+        Packet *parity = tx_next(conn);
+        if (parity == NULL) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "parity packet failed to be send");
+            return -1;
+        }
+        memset(parity, 0, HEADER_SIZE); // ensure header is clean
+        memcpy(parity->Content, conn->fec_sums + row * FEC_UNIT_SIZE, conn->fec_length);
+        parity->Length = conn->fec_length;
+        parity->Flag = 'R';
+        parity->Seq = conn->fec_first;
+        parity->Window = conn->fec_count << 8 | conn->fec_rows << 4 | row;
+        tx_commit(conn);
+        pace(conn, now, HEADER_SIZE + conn->fec_length);
+        conn->parity_sent++;
+        conn->stats.packets_sent++;
+        conn->stats.bytes_sent += conn->fec_length;
+    }
+    for (unsigned int index = 0; index < conn->fec_count; index++)
+        conn->send_slots[(conn->fec_first + index) % conn->window].fec_sent = conn->tx_count;
+    double sample = (double)(conn->fec_holes - conn->fec_holes_seen) / conn->fec_count;
+    conn->fec_holes_seen = conn->fec_holes;
+    conn->fec_loss += (sample - conn->fec_loss) / 8;
+    conn->fec_count = 0;
+    return 0;
+}
+
+// Move the cursor past the buffers (and the messages) that were sent to their end. A message the cursor leaves got
+// all its sequence numbers, its end is the sequence number of the next chunk.
+static void cursor_skip(rudpConn *conn) {
+    sendRequest *req = conn->send_cursor;
+    while (req != NULL && (conn->cursor_buffer == req->iovcnt || conn->cursor_offset == req->iov[conn->cursor_buffer].iov_len)) {
+        if (conn->cursor_buffer == req->iovcnt) {
+            req->end = conn->next_seq;
+            req->segmented = 1;
+            req = conn->send_cursor = req->next;
+            conn->cursor_buffer = 0;
+        } else {
+            conn->cursor_buffer++;
+        }
+        conn->cursor_offset = 0;
+    }
+}
+
+// Queue a message of iovcnt buffers to be sent: its chunks take the sequence numbers after the messages queued before it.
+// Every buffer is split to chunks on its own (a chunk never spans two buffers, so its data is sent from the buffer as
+// it is). The iovec array is copied, the buffers must stay valid until the message is acknowledged. Returns NULL on error.
+static sendRequest *send_enqueue(rudpConn *conn, const struct iovec *iov, int iovcnt, uint64_t id, int notify) {
+    sendRequest *req = (sendRequest *)calloc(1, sizeof(sendRequest) + iovcnt * sizeof(struct iovec));
+    if (req == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Send queue allocation failed");
+        return NULL;
+    }
+    req->iov = (struct iovec *)(req + 1);
+    req->iovcnt = iovcnt;
+    for (int i = 0; i < iovcnt; i++) {
+        req->iov[i] = iov[i];
+        req->bytes += iov[i].iov_len;
+    }
+    req->id = id;
+    req->notify = notify;
+    if (conn->send_tail != NULL)
+        conn->send_tail->next = req;
+    else
+        conn->send_head = req;
+    conn->send_tail = req;
+    if (conn->send_cursor == NULL) {
+        conn->send_cursor = req;
+        conn->cursor_buffer = 0;
+        conn->cursor_offset = 0;
+        cursor_skip(conn); // An empty message has no chunks
+    }
+    return req;
+}
+
+// Remove the oldest message from the queue, and report result (its size, or -1 if it failed) to on_send
+static void send_dequeue(rudpConn *conn, int64_t result) {
+    sendRequest *req = conn->send_head;
+    conn->send_head = req->next;
+    if (conn->send_head == NULL)
+        conn->send_tail = NULL;
+    if (conn->send_cursor == req) {
+        conn->send_cursor = req->next;
+        conn->cursor_buffer = 0;
+        conn->cursor_offset = 0;
+        cursor_skip(conn);
+    }
+    if (req->notify && conn->async.on_send != NULL) {
+        tx_drain(conn); // A failure is reported by the next tx_flush
+        conn->async.on_send(conn, req->id, result, conn->async_user);
+    }
+    free(req);
+}
+
+// Messages whose chunks were all acknowledged are done
+static void send_complete(rudpConn *conn) {
+    while (conn->send_head != NULL && conn->send_head->segmented && (int)(conn->send_base - conn->send_head->end) >= 0)
+        send_dequeue(conn, conn->send_head->bytes);
+}
+
+// Fill the window with new chunks of the queued messages, as far as the congestion window and the pacing rate allow.
+// A chunk is as large as the path MTU allows now, the PMTU probe (if one is due) goes out with them.
+// While ACKs of the last received batch wait to be processed, the window isn't full yet.
+static int send_fill(rudpConn *conn, uint64_t now) {
+    if ((conn->send_cursor != NULL || conn->in_flight > 0) && pmtu_probe(conn, now) == -1)
+        return -1;
+    // With FEC, the length of a chunk goes in front of it in the parity packets, that must fit the MTU as well
+    unsigned int chunk = conn->mss - (conn->fec_mode != RUDP_FEC_OFF ? FEC_LENGTH_SIZE : 0);
+    while (conn->rx->pos == conn->rx->count && conn->send_cursor != NULL && conn->next_seq - conn->send_base < conn->window &&
+           conn->in_flight < (unsigned int)conn->cc.cwnd && conn->next_send_at <= now + PACING_QUANTUM_US) {
+        const struct iovec *buffer = &conn->send_cursor->iov[conn->cursor_buffer];
+
+        unsigned int seq = conn->next_seq;
+        sendSlot *slot = &conn->send_slots[seq % conn->window];
+        slot->attempts = 0;
+        slot->acked = 0;
+        slot->sent_at = now;
+        slot->tx_order = ++conn->tx_count;
+        slot->data = (const char *)buffer->iov_base + conn->cursor_offset;
+        slot->length = buffer->iov_len - conn->cursor_offset < chunk ? buffer->iov_len - conn->cursor_offset : chunk;
+        slot->fec_tag = 0;
+        slot->holed = 0;
+        slot->fec_sent = 0;
+        conn->cursor_offset += slot->length;
+        conn->next_seq++;
+        cursor_skip(conn);
+        if (conn->fec_mode != RUDP_FEC_OFF)
+            fec_add(conn, seq);
+        // The Receiver delays its ACKs, unless the Sender has to wait for one after this chunk
+        int ack_now = conn->send_cursor == NULL || seq + 1 - conn->send_base >= conn->window ||
+                      conn->in_flight + 1 >= (unsigned int)conn->cc.cwnd;
+        if (send_data(conn, seq, ack_now) == -1)
+            return -1;
+        pace(conn, now, HEADER_SIZE + slot->length);
+        conn->in_flight++;
+        if (conn->fec_mode != RUDP_FEC_OFF && fec_block_end(conn) && fec_flush(conn, now) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+// The earliest retransmission deadline in the window, or the time the pacing rate allows the next chunk
+// (UINT64_MAX if nothing is waiting)
+static uint64_t send_deadline(const rudpConn *conn) {
+    uint64_t deadline = UINT64_MAX;
+    for (unsigned int seq = conn->send_base; seq != conn->next_seq; seq++) {
+        const sendSlot *slot = &conn->send_slots[seq % conn->window];
+        if (!slot->acked && slot->sent_at + conn->rto < deadline)
+            deadline = slot->sent_at + conn->rto;
+    }
+    if (conn->send_cursor != NULL && conn->next_seq - conn->send_base < conn->window &&
+        conn->in_flight < (unsigned int)conn->cc.cwnd && conn->next_send_at < deadline)
+        deadline = conn->next_send_at;
+    return deadline;
+}
+
+// Retransmit every chunk in the window that wasn't acknowledged in time. Returns -1 if one of them ran out of attempts.
+static int send_timeout(rudpConn *conn, uint64_t now) {
+    int expired = 0;
+    for (unsigned int seq = conn->send_base; seq != conn->next_seq; seq++) {
+        sendSlot *slot = &conn->send_slots[seq % conn->window];
+        if (slot->acked || slot->sent_at + conn->rto > now)
+            continue;
+        expired = 1;
+        if (retransmit(conn, seq, now) == -1)
+            return -1;
+    }
+    if (expired) {
+        rto_backoff(conn);
+        loss_event(conn, conn->send_base, conn->next_seq, 1);
+    }
+    return 0;
+}
+
+// Process an ACK (cumulative ack_seq, and the SACK bitmap that got_ACK stored): acknowledge the chunks it covers,
+// retransmit the holes, slide the window and complete the messages that are done. Returns -1 on error.
+// An ACK acknowledges every chunk before its cumulative ACK and the chunks in its SACK bitmap (selective repeat),
+// so only the holes are retransmitted: a chunk is lost once DUP_THRESHOLD chunks after it are acknowledged and one
+// of them was sent after it (fast retransmit).
+static int send_on_ack(rudpConn *conn, unsigned int ack_seq, uint64_t now) {
+    unsigned int base = conn->send_base, next = conn->next_seq;
+
+    // Chunks of the window the ACK acknowledges for the first time (an ACK that adds nothing is a duplicate and ignored)
+    unsigned int newly = 0;
+    unsigned int highest = base; // Highest acknowledged chunk
+    sendSlot *newest = NULL; // Acknowledged chunk that was sent last
+    for (unsigned int seq = base; seq != next; seq++) {
+        sendSlot *slot = &conn->send_slots[seq % conn->window];
+        if (slot->acked)
+            highest = seq;
+        if (slot->acked || !ack_covers(conn, ack_seq, seq))
+            continue;
+        slot->acked = 1;
+        newly++;
+        highest = seq;
+        if (newest == NULL || slot->tx_order > newest->tx_order)
+            newest = slot;
+    }
+    if (newly > 0) {
+        // The chunk sent last is the one whose arrival triggered the ACK, and only packets that were sent once
+        // give an unambiguous RTT sample (Karn's rule)
+        int64_t rtt = newest->attempts == 0 ? (int64_t)(now - newest->sent_at) : 0;
+        if (rtt > 0)
+            rtt_sample(conn, rtt);
+        conn->in_flight -= newly;
+        for (unsigned int i = 0; i < newly; i++)
+            conn->cc_ops->on_ack(&conn->cc, rtt);
+        // A window-limited connection can't use a larger cwnd, and the pacing rate derived from it would be meaningless
+        if (conn->cc.cwnd > conn->window)
+            conn->cc.cwnd = conn->window;
+        cc_update_pacing(&conn->cc, conn->srtt, HEADER_SIZE + conn->mss);
+
+        // FEC loss estimate: every chunk the ACKs reported missing (before the highest acknowledged one) counts once,
+        // whether FEC rebuilds it or it's retransmitted
+        if (conn->fec_mode != RUDP_FEC_OFF) {
+            for (unsigned int seq = base; seq != highest; seq++) {
+                sendSlot *slot = &conn->send_slots[seq % conn->window];
+                if (!slot->acked && !slot->holed) {
+                    slot->holed = 1;
+                    conn->fec_holes++;
+                }
+            }
+        }
+
+        // Holes: chunks with DUP_THRESHOLD acknowledged chunks after them, that were sent before the newest acknowledged one
+        unsigned int above = 0; // Acknowledged chunks after seq
+        for (unsigned int seq = base + 1; (int)(highest - seq) >= 0; seq++)
+            above += conn->send_slots[seq % conn->window].acked;
+        for (unsigned int seq = base; above >= DUP_THRESHOLD; seq++) {
+            sendSlot *slot = &conn->send_slots[seq % conn->window];
+            above -= conn->send_slots[(seq + 1) % conn->window].acked;
+            if (slot->acked || slot->tx_order > newest->tx_order)
+                continue;
+            // With FEC, a lost chunk is left to the parity packets of its block until the last chunk of the block, that
+            // was sent right before them, or a chunk sent after them is acknowledged
+            if (slot->fec_tag != 0 && (slot->fec_sent == 0 || slot->fec_sent > newest->tx_order))
+                continue;
+            loss_event(conn, seq, next, 0);
+            if (retransmit(conn, seq, now) == -1)
+                return -1;
+        }
+    }
+    // Slide the window over the acknowledged prefix
+    while (conn->send_base != next && conn->send_slots[conn->send_base % conn->window].acked)
+        conn->send_base++;
+    send_complete(conn);
+    return 0;
+}
+
+// Sending data to the peer: the buffers are queued as one message and sent with up to window chunks in flight at once,
+// limited by the congestion window and spread over the RTT by the pacing rate (see send_fill and send_on_ack).
+// A chunk is also retransmitted when its retransmission deadline (time sent + RTO) passed.
+int64_t rudp_sendv(rudpConn *conn, const struct iovec *iov, int iovcnt) {
+    if (conn->send_slots == NULL) // Not connected
+        return -1;
+
+    sendRequest *req = send_enqueue(conn, iov, iovcnt, 0, 0);
+    if (req == NULL)
+        return -1;
+    int64_t len = req->bytes;
+    send_complete(conn);
+
+    // The blocking API has no other messages in the queue, the message is done (and freed) once the queue is empty
+    while (conn->send_head != NULL) {
+        if (send_fill(conn, now_us()) == -1)
+            return -1;
+        // Wait for ACKs until the earliest retransmission deadline in the window, or until the pacing rate allows the next chunk
+        uint64_t deadline = send_deadline(conn);
+
+        // Everything queued in this round goes out in one batch before waiting
+        if (tx_flush(conn) == -1)
+            return -1;
+
+        unsigned int ack_seq;
+        int ACK_Status = got_ACK(conn, &ack_seq, deadline);
+        if (ACK_Status == -1) {
+            return -1;
+        }
+        // The deadline passed, retransmit every chunk in the window that wasn't acknowledged in time
+        if (ACK_Status == -10) {
+            if (send_timeout(conn, now_us()) == -1)
+                return -1;
+            continue;
+        }
+        if (send_on_ack(conn, ack_seq, now_us()) == -1)
+            return -1;
+    }
+    // The queued packets point into the buffers, they must be sent before they're returned to the user
+    if (tx_flush(conn) == -1 || tx_drain(conn) == -1)
+        return -1;
+    return len;
+}
+
+int rudp_send(rudpConn *conn, const void*msg, int len){
+    if (len <= 0)
+        return 0;
+    struct iovec iov = { (void *)msg, (size_t)len };
+    return (int)rudp_sendv(conn, &iov, 1);
+}
+
+int64_t rudp_send_fd(rudpConn *conn, int fd, off_t offset, int64_t len) {
+    long page = sysconf(_SC_PAGESIZE);
+    int64_t sent = 0;
+
+    // The file is mapped a slice at a time (rudp_send takes an int length), its pages are sent from the page cache
+    while (sent < len) {
+        off_t pos = offset + sent;
+        off_t map_start = pos - pos % page; // mmap needs an offset aligned to pages
+        int slice = len - sent < FILE_SLICE ? (int)(len - sent) : FILE_SLICE;
+        size_t map_len = slice + (size_t)(pos - map_start);
+        char *map = (char *)mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, map_start);
+        if (map == MAP_FAILED) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "File mapping failed");
+            return -1;
+        }
+        madvise(map, map_len, MADV_SEQUENTIAL); // Aggressive read-ahead, every page is read once
+        int n = rudp_send(conn, map + (pos - map_start), slice);
+        munmap(map, map_len);
+        if (n != slice)
+            return -1;
+        sent += slice;
+    }
+    return sent;
+}
+
+int64_t rudp_send_file(rudpConn *conn, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "File open failed");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "File stat failed");
+        close(fd);
+        return -1;
+    }
+    int64_t sent = rudp_send_fd(conn, fd, 0, st.st_size);
+    close(fd);
+    return sent;
+}
+
+int rdup_close(rudpConn *conn) {
+    RUDP_LOG(RUDP_LOG_INFO, "Sending request for exit.");
+
+    // Send FIN message - send just flag without a real data, the FIN takes the sequence number after the last data packet
+    int ACK_Status = send_control(conn, 'F', conn->next_seq);
+    if (ACK_Status == 1) {
+        RUDP_LOG(RUDP_LOG_INFO, "Got ACK from Receiver.");
+        RUDP_LOG(RUDP_LOG_INFO, "Exit.");
+        conn->send_base = ++conn->next_seq;
+        return 1;
+    }
+    if (ACK_Status == -1) {
+        // If maximum retransmission attempts reached
+        RUDP_LOG(RUDP_LOG_ERROR, "Maximum retransmission attempts reached. disconnect failed.");
+    }
+    return ACK_Status;
+}
+
+// *** Asynchronous Sender's functions: ***
+
+int rudpConn_set_async(rudpConn *conn, const rudpAsyncCallbacks *callbacks, void *user) {
+    int flags = fcntl(conn->sockfd, F_GETFL, 0);
+    if (flags == -1 || fcntl(conn->sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Setting the socket non-blocking failed");
+        return -1;
+    }
+    conn->nonblocking = 1;
+    if (callbacks != NULL)
+        conn->async = *callbacks;
+    else
+        memset(&conn->async, 0, sizeof(conn->async));
+    conn->async_user = user;
+    return 0;
+}
+
+int rudpConn_fd(const rudpConn *conn) {
+    // The ring is readable once it has completions, the socket itself is drained by the multishot recvmsg
+    if (conn->uring != NULL)
+        return conn->uring->rx.fd;
+    return conn->sockfd;
+}
+
+int rudpConn_set_engine(rudpConn *conn, int engine) {
+    if (engine != RUDP_ENGINE_SYSCALL && engine != RUDP_ENGINE_URING)
         return -1;
+    if (engine == RUDP_ENGINE_SYSCALL)
+        uring_free(conn);
+    else if (conn->uring == NULL && uring_alloc(conn) == -1)
+        RUDP_LOG_ERRNO(RUDP_LOG_WARN, "io_uring is unavailable, using the system calls");
+    return 0;
+}
+
+int rudpConn_engine(const rudpConn *conn) {
+    return conn->uring != NULL ? RUDP_ENGINE_URING : RUDP_ENGINE_SYSCALL;
+}
+
+// Queue the control packet that waits for its ACK (again), it's retransmitted at control_sent_at + RTO
+static int control_send(rudpConn *conn, uint64_t now) {
+    conn->control_sent_at = now;
+    return queue_control(conn, conn->control_flag, conn->control_seq);
+}
+
+// The connection failed (a packet ran out of retransmissions, or a socket error): every queued message fails with it
+static void async_fail(rudpConn *conn) {
+    int state = conn->state;
+    conn->state = CONN_FAILED;
+    conn->control_flag = 0;
+    while (conn->send_head != NULL)
+        send_dequeue(conn, -1);
+    if (state == CONN_CONNECTING) {
+        if (conn->async.on_connect != NULL)
+            conn->async.on_connect(conn, -1, conn->async_user);
+    } else if (conn->async.on_close != NULL) {
+        conn->async.on_close(conn, -1, conn->async_user);
     }
-    return soc;
 }
 
-// Function to calculate checksum
-unsigned short int calculate_checksum(void *data, size_t  bytes) {
-    unsigned short int *data_pointer = (unsigned short int *)data;
-    unsigned int total_sum = 0;
-    
-    // Main summing loop
-    while (bytes > 1) {
-        total_sum += *data_pointer++;
-        bytes -= 2;
+// Send what the state of the connection allows: new chunks, and the FIN once every queued message was acknowledged
+static int async_progress(rudpConn *conn, uint64_t now) {
+    if (conn->state == CONN_OPEN || conn->state == CONN_CLOSING) {
+        if (send_fill(conn, now) == -1)
+            return -1;
+        if (conn->state == CONN_CLOSING && conn->control_flag == 0 && conn->send_head == NULL) {
+            // The FIN takes the sequence number after the last data packet
+            conn->control_flag = 'F';
+            conn->control_seq = conn->next_seq;
+            conn->control_attempts = 0;
+            if (control_send(conn, now) == -1)
+                return -1;
+        }
     }
-    // Add left-over byte, if any
-    if (bytes > 0){
-        total_sum += *((unsigned char *)data_pointer);
-        total_sum &= 0xFFFF; // Ensure that the sum is within 16 bits
+    return tx_flush(conn);
+}
+
+// Handle an ACK: of the SYN/FIN that waits for it, or of data packets. Returns -1 on error.
+static int async_ack(rudpConn *conn, unsigned int ack_seq, uint64_t now) {
+    // A cumulative ACK past the control packet
+    if (conn->control_flag != 0 && (int)(ack_seq - conn->control_seq) > 0) {
+        char flag = conn->control_flag;
+        conn->control_flag = 0;
+        if (conn->control_attempts == 0) {
+            rtt_sample(conn, now - conn->control_sent_at);
+            cc_update_pacing(&conn->cc, conn->srtt, HEADER_SIZE + conn->mss);
+        }
+        if (flag == 'S') {
+            if (connect_established(conn) == -1)
+                return -1;
+            conn->state = CONN_OPEN;
+            if (conn->async.on_connect != NULL)
+                conn->async.on_connect(conn, 1, conn->async_user);
+        } else {
+            conn->state = CONN_CLOSED;
+            conn->send_base = ++conn->next_seq;
+            if (conn->async.on_close != NULL)
+                conn->async.on_close(conn, 1, conn->async_user);
+        }
+        return 0;
     }
-    // Fold 32-bit sum to 16 bits
-    while (total_sum >> 16)
-        total_sum = (total_sum & 0xFFFF) + (total_sum >> 16);
+    if (conn->state == CONN_OPEN || conn->state == CONN_CLOSING)
+        return send_on_ack(conn, ack_seq, now);
+    return 0;
+}
 
-    return (~((unsigned short int)total_sum));
+// Retransmit the control packet and the data packets whose retransmission deadline passed. Returns -1 if one of them
+// ran out of attempts.
+static int async_timers(rudpConn *conn, uint64_t now) {
+    if (conn->control_flag != 0 && now >= conn->control_sent_at + conn->rto) {
+        if (++conn->control_attempts >= MAX_RETRANSMISSION_ATTEMPTS) {
+            RUDP_LOG(RUDP_LOG_ERROR, "Maximum retransmission attempts reached. %s failed.", conn->control_flag == 'S' ? "Handshake" : "disconnect");
+            return -1;
+        }
+        rto_backoff(conn);
+        RUDP_LOG(RUDP_LOG_DEBUG, "Retransmission attempt %d", conn->control_attempts);
+        if (control_send(conn, now) == -1)
+            return -1;
+    }
+    if ((conn->state == CONN_OPEN || conn->state == CONN_CLOSING) && send_timeout(conn, now) == -1)
+        return -1;
+    return 0;
 }
 
-// Function to verify checksum
-int verify_checksum(Packet *buffer, size_t bytes) {
-   // Extract data and checksum from the packet
-    unsigned short *data_pointer= (unsigned short int *)buffer->Content;
-    unsigned short checksum = buffer->Checksum;
-    unsigned int total_sum = checksum;
-
-    // Calculate the checksum of the received data combined with the checksum
-    // Main summing loop
-    while (bytes > 1) {
-        total_sum += *data_pointer++;
-        bytes -= 2;
-    }
-    // Add left-over byte, if any
-    if (bytes > 0){
-        total_sum += *((unsigned char *)data_pointer);
-        total_sum &= 0xFFFF; // Ensure that the sum is within 16 bits
-    }
-    // Fold 32-bit sum to 16 bits
-    while (total_sum >> 16)
-        total_sum = (total_sum & 0xFFFF) + (total_sum >> 16);
-    
-    // If the sum is all ones, the checksum is correct
-    int result = total_sum == 0xFFFF ? 1 : -1;
-    return result;
+int rudp_connect_async(rudpConn *conn, const struct sockaddr *addr, socklen_t addrlen) {
+    if (conn->state != CONN_IDLE || !conn->nonblocking)
+        return -1;
+    memcpy(&conn->peer, addr, addrlen);
+    conn->peer_len = addrlen;
+    pmtu_init(conn);
+    conn->state = CONN_CONNECTING;
+    conn->control_flag = 'S'; // The SYN takes sequence number 0
+    conn->control_seq = 0;
+    conn->control_attempts = 0;
+    if (control_send(conn, now_us()) == -1 || tx_flush(conn) == -1)
+        return -1;
+    return 0;
 }
 
-// *** Sender's functions: ***
+int rudp_sendv_async(rudpConn *conn, const struct iovec *iov, int iovcnt, uint64_t id) {
+    if (conn->state != CONN_CONNECTING && conn->state != CONN_OPEN)
+        return -1;
+    if (send_enqueue(conn, iov, iovcnt, id, 1) == NULL)
+        return -1;
+    send_complete(conn); // An empty message is done at once
+    // The first chunks go out right away, the rest as ACKs arrive
+    if (async_progress(conn, now_us()) == -1) {
+        async_fail(conn);
+        return -1;
+    }
+    return 0;
+}
 
-// Function that checks if Sender got ACK Packet
-int got_ACK(int sockfd, struct sockaddr * from, socklen_t * fromlen) {
-    Packet buffer;
-    memset(&buffer, 0, sizeof(Packet));
-
-    ssize_t ACK = recvfrom(sockfd, &buffer, sizeof(Packet), 0, from, fromlen);
-    
-    // setsockopt(SO_RCVTIMEO): Causes the receive operation to return with an error (-1 with errno set to EAGAIN or EWOULDBLOCK)
-    // if the timeout expires before data is received. Need to check for this error condition explicitly.
-    if (ACK == -1) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {         
-            perror("ACK packet failed to be received: the timeout expires before data is received.");
-            return -10;
-        } else {
-                perror("ACK packet failed to be received.");
-                close(sockfd);
+int rudp_send_async(rudpConn *conn, const void *msg, size_t len, uint64_t id) {
+    struct iovec iov = { (void *)msg, len };
+    return rudp_sendv_async(conn, &iov, 1, id);
+}
+
+int rudp_close_async(rudpConn *conn) {
+    if (conn->state != CONN_OPEN)
+        return -1;
+    conn->state = CONN_CLOSING;
+    if (async_progress(conn, now_us()) == -1) {
+        async_fail(conn);
+        return -1;
+    }
+    return 0;
+}
+
+int rudpConn_poll(rudpConn *conn) {
+    int processed = 0;
+    if (conn->state == CONN_IDLE || conn->state == CONN_CLOSED || conn->state == CONN_FAILED)
+        return 0;
+
+    for (int round = 0; round < SERVER_POLL_BUDGET; round++) {
+        if (rx_fill(conn, MSG_DONTWAIT) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "ACK packet failed to be received.");
+            async_fail(conn);
+            return -1;
+        }
+        Packet *buffer;
+        ssize_t rec_size;
+        while ((rec_size = rx_next(conn, &buffer, NULL)) != 0) {
+            // Packets that are not ACKs of this connection (or replies of its PMTU probes), or are corrupted, are skipped
+            if (rec_size == -2 || buffer->ConnID != conn->conn_id)
+                continue;
+            if (buffer->Flag == 'P')
+                pmtu_reply(conn, buffer->Seq, now_us());
+            if (buffer->Flag != 'A')
+                continue;
+            processed++;
+            ack_store(conn, buffer);
+            if (async_ack(conn, buffer->Seq, now_us()) == -1) {
+                async_fail(conn);
                 return -1;
+            }
+        }
+        // The window slid, new chunks go out with the next round's ACKs still on the way
+        if (async_progress(conn, now_us()) == -1) {
+            async_fail(conn);
+            return -1;
         }
     }
-    if (ACK == 0) {
-        perror("The peer has closed the connection");
-        close(sockfd);
+
+    uint64_t now = now_us();
+    if (async_timers(conn, now) == -1 || async_progress(conn, now) == -1) {
+        async_fail(conn);
+        return -1;
+    }
+    return processed;
+}
+
+int rudpConn_timeout(const rudpConn *conn) {
+    uint64_t deadline = UINT64_MAX;
+    if (conn->control_flag != 0)
+        deadline = conn->control_sent_at + conn->rto;
+    if ((conn->state == CONN_OPEN || conn->state == CONN_CLOSING) && conn->send_slots != NULL) {
+        uint64_t data_deadline = send_deadline(conn);
+        if (data_deadline < deadline)
+            deadline = data_deadline;
+    }
+    if (deadline == UINT64_MAX)
+        return -1;
+    uint64_t now = now_us();
+    if (now >= deadline)
         return 0;
+    return (int)((deadline - now + 999) / 1000);
+}
+
+// *** Receiver's functions: ***
+
+// Queue an ACK of everything the connection received so far, it's sent with the next batch: the cumulative ACK
+// is the first packet that didn't arrive, and the packets after it in the reassembly buffer are in the SACK bitmap
+static int queue_ACK(rudpConn *conn) {
+    Packet *ACK = tx_next(conn);
+    if (ACK == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "ACK packet failed to be send");
+        return -1;
+    }
+    memset(ACK, 0, HEADER_SIZE); // ensure header is clean
+    unsigned int ack_seq = conn->expected_seq;
+    unsigned int bytes = 0;
+    if (conn->recv_slots != NULL) {
+        // The reassembly buffer also holds in-order packets the user didn't read yet
+        while (ack_seq - conn->expected_seq < conn->window && conn->recv_slots[ack_seq % conn->window].present)
+            ack_seq++;
+        uint8_t *sack = (uint8_t *)ACK->Content;
+        for (unsigned int seq = ack_seq + 1; seq - conn->expected_seq < conn->window; seq++) {
+            if (!conn->recv_slots[seq % conn->window].present)
+                continue;
+            unsigned int bit = seq - ack_seq - 1;
+            while (bytes <= bit / 8)
+                sack[bytes++] = 0;
+            sack[bit / 8] |= 1 << (bit % 8);
+        }
     }
-    if (buffer.Flag == 'A') {
-        return 1; // Successfully received ACK
+    ACK->Length = bytes;
+    ACK->Flag = 'A';
+    ACK->Seq = ack_seq;
+    ACK->Window = conn->window;
+    // No data packet arrived since the SYN (whose sequence number is 0): it's the ACK of the SYN, or of its retransmission
+    if (ack_seq == 1 && bytes == 0 && conn->resume_len > 0) {
+        memcpy(ACK->Content, conn->resume, conn->resume_len);
+        ACK->Length = conn->resume_len;
+        tx_queue(conn->tx, conn->conn_id, conn->options | OPTION_RESUME, NULL, &conn->peer, conn->peer_len);
+    } else {
+        tx_commit(conn);
     }
+    conn->unacked = 0;
+    conn->ack_now = 0;
+    return 1;
+}
+
+// Queue the ACK of the connection if the delayed ACK policy says it's due: it was asked for at once, ack_every
+// in-order packets weren't acknowledged, or the oldest of them waited ack_delay. Returns 1 if it was queued, -1 on error.
+static int ack_check(rudpConn *conn, uint64_t now) {
+    if (conn->ack_now || conn->unacked >= conn->ack_every || (conn->unacked > 0 && now >= conn->ack_deadline))
+        return queue_ACK(conn);
     return 0;
 }
- 
-// Creating handshake between two peers (Sender send SYN message, Rec recieved the SYN message & send ACK, Sender recieve ACK)
-// An image of the TCP connect() function that will ensure a handshake 
-int handshake_connect(int sockfd, struct sockaddr *serv_addr, socklen_t addrlen, struct sockaddr* respond_server, socklen_t * respond_server_len) {
-    printf("Sending request for RDUP connection\n");
-   
-    // Send SYN message - send just flag without a real data
-    Packet SYN;
-    memset(&SYN, 0, sizeof(SYN)); // ensure struct is clean
-    SYN.Length = 0;
-    SYN.Flag = 'S';
-    
-    int attempts = 0;
-    // The function wait for an acknowledgment packet, if it didnt receive any, retransmits the packet till default max_attempts
-    // This for preventing infinite loops in case of persistent failures
-    while (attempts < MAX_RETRANSMISSION_ATTEMPTS) {
-        // send SYN packet 
-        ssize_t size_SYN = sendto(sockfd,&SYN,sizeof(Packet), 0, serv_addr,addrlen); 
-        if (size_SYN<=0) {
-            perror("SYN packet failed to be send");
-            close(sockfd);
+
+// Queue the reply of a PMTU probe that arrived: a header-only probe with its ID, it's sent with the next batch
+static int queue_probe_reply(rudpConn *conn, unsigned int id) {
+    Packet *reply = tx_next(conn);
+    if (reply == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Probe reply failed to be send");
+        return -1;
+    }
+    memset(reply, 0, HEADER_SIZE); // ensure header is clean
+    reply->Length = 0;
+    reply->Flag = 'P';
+    reply->Seq = id;
+    reply->Window = conn->window;
+    tx_commit(conn);
+    return 1;
+}
+
+// Function that send ACK packet to Sender (with any other queued packets), acknowledging everything received so far
+int send_ACK(rudpConn *conn) {
+    if (queue_ACK(conn) == -1 || tx_flush(conn) == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "ACK packet failed to be send");
+        return -1;
+    }
+    return 1;
+}
+
+// Wait for a SYN packet and acknowledge it (Receiver side of the handshake)
+// An image of the TCP accept() function
+int handshake_accept(rudpConn *conn) {
+    Packet *buffer;
+    struct mmsghdr *from;
+
+    while (1) {
+        ssize_t rec_size = rx_next(conn, &buffer, &from);
+        if (rec_size == -2)
+            continue;
+        if (rec_size > 0 && buffer->Flag == 'S')
+            break;
+        if (rec_size == 0 && rx_fill(conn, 0) == -1 && errno != EINTR) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packet failed to be received");
+            close(conn->sockfd);
             return -1;
         }
+    }
 
-        int ACK_Status = got_ACK (sockfd, respond_server, respond_server_len);
-        // Check if no timeout, out of the loop
-        if (ACK_Status != -10) {
-            if (ACK_Status == 1) 
-                printf("Got ACK from Receiver.\n");
-            return ACK_Status;
-        } 
-        attempts++;
-        printf("Retransmission attempt %d\n", attempts);
+    RUDP_LOG(RUDP_LOG_INFO, "Connection request received, sending ACK.");
+    memcpy(&conn->peer, from->msg_hdr.msg_name, from->msg_hdr.msg_namelen);
+    conn->peer_len = from->msg_hdr.msg_namelen;
+    conn->conn_id = buffer->ConnID; // From now on packets of other connections are ignored
+    // The integrity check and the FEC the Sender asked for, and compression if both sides want it
+    conn->options = (buffer->Options & (OPTION_CRC32C | OPTION_FEC)) | (buffer->Options & conn->options & OPTION_COMPRESS);
+    if (conn->options & OPTION_FEC)
+        socket_rcvbuf(conn->sockfd, 2 * conn->window); // Parity packets arrive on top of the window of data
+    if (buffer->Window > 0 && buffer->Window < conn->window)
+        conn->window = buffer->Window;
+    conn->expected_seq = buffer->Seq + 1;
+    if ((buffer->Options & OPTION_RESUME) && resume_copy(&conn->peer_resume, &conn->peer_resume_len, buffer->Content, buffer->Length) == -1)
+        RUDP_LOG(RUDP_LOG_WARN, "Resume data of the Sender ignored");
+    if (send_ACK(conn) == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packet ACK failed to be Send for start connection");
+        return -1;
     }
+    RUDP_LOG(RUDP_LOG_INFO, "Sender connected, beginning to receive file...");
+    return 1;
+}
 
-    // If maximum retransmission attempts reached
-    printf("Maximum retransmission attempts reached. Handshake failed.\n");
-    return -1;
+// Keep a packet that can't be delivered yet in its reassembly slot, without copying it when possible:
+// the slot takes the buffer the packet was received into, and the receive batch gets a spare buffer instead.
+// The reassembly buffer is allocated only once the first packet has to wait in it. Returns -1 on error.
+static int slot_keep(rudpConn *conn, Packet *buffer) {
+    if (conn->recv_slots == NULL) {
+        conn->recv_slots = (recvSlot *)calloc(conn->window, sizeof(recvSlot));
+        conn->spare_packets = (Packet **)calloc(conn->window, sizeof(Packet *));
+        if (conn->recv_slots == NULL || conn->spare_packets == NULL) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Window allocation failed");
+            return -1;
+        }
+    }
+    recvSlot *slot = &conn->recv_slots[buffer->Seq % conn->window];
+    if (slot->present)
+        return 0; // A duplicate
+
+    // A slot is free, so fewer than window buffers are held by slots, and a spare one exists or may be allocated
+    Packet *spare = conn->spare_count > 0 ? conn->spare_packets[--conn->spare_count] : (Packet *)malloc(sizeof(Packet));
+    if (spare == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Window allocation failed");
+        return -1;
+    }
+    Packet *kept = rx_take(conn->rx, buffer, spare);
+    if (kept == NULL) {
+        memcpy(spare->Content, buffer->Content, buffer->Length);
+        kept = spare;
+    }
+    slot->present = 1;
+    slot->length = buffer->Length;
+    slot->delivered = 0;
+    slot->packet = kept;
+    return 0;
 }
 
-// Sending data to the peer (after receive ACK packet)
-int rudp_send(int sockfd, const void*msg, int len, struct sockaddr *serv_addr, socklen_t addrlen, struct sockaddr* respond_server, socklen_t * respond_server_len){
-    // Send data message
-    Packet data;
-    memset(&data, 0, sizeof(data)); // ensure struct is clean
-    data.Length = len;
-    data.Flag = 'D';
-    strcpy(data.Content, msg);
-    data.Checksum = calculate_checksum(data.Content, data.Length);
+// The data of the slot was delivered, its buffer becomes a spare one
+static void slot_release(rudpConn *conn, recvSlot *slot) {
+    slot->present = 0;
+    conn->spare_packets[conn->spare_count++] = slot->packet;
+    slot->packet = NULL;
+}
 
-    int attempts = 0;
-    
-    // The function wait for an acknowledgment packet, if it didnt receive any, retransmits the data till default max_attempts
-    // This for preventing infinite loops in case of persistent failures
-    while (attempts < MAX_RETRANSMISSION_ATTEMPTS) {
-    ssize_t dataSent = sendto(sockfd, &data, sizeof(Packet), 0, (const struct sockaddr *)serv_addr,addrlen); 
-        if (dataSent<=0) {
-            perror("data packet failed to be send");
-            close(sockfd);
-            return -1;
+// Hand the in-order data of the reassembly buffer to the server's on_data callback, returns the number of packets
+static unsigned int server_deliver(rudpConn *conn) {
+    unsigned int delivered = 0;
+    if (conn->recv_slots == NULL)
+        return 0;
+    while (1) {
+        recvSlot *slot = &conn->recv_slots[conn->expected_seq % conn->window];
+        if (!slot->present)
+            break;
+        slot->present = 0;
+        conn->expected_seq++;
+        conn->server->callbacks.on_data(conn, slot->packet->Content + slot->delivered, slot->length - slot->delivered,
+                                        conn->server->user);
+        slot_release(conn, slot);
+        delivered++;
+    }
+    return delivered;
+}
+
+static int conn_input(rudpConn *conn, Packet *buffer, uint64_t now);
+
+// The FEC block of the connection that starts at first, or a new one for it: a free one, or else the oldest one (its
+// lost packets are left to retransmissions). The parity packets of the block are parity, a packet that says otherwise
+// isn't of this block. Returns NULL if the packet doesn't fit the block, or on allocation error.
+static fecBlock *fec_block_get(rudpConn *conn, unsigned int first, unsigned int parity) {
+    if (conn->fec_blocks == NULL) {
+        conn->fec_blocks = (fecBlock *)calloc(FEC_BLOCKS, sizeof(fecBlock));
+        conn->fec_packet = (Packet *)malloc(sizeof(Packet));
+        if (conn->fec_blocks == NULL || conn->fec_packet == NULL) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "FEC allocation failed");
+            return NULL;
         }
-        int ACK_Status = got_ACK (sockfd, respond_server, respond_server_len);
-        // Check if no timeout, out of the loop (if ACK is 1, return size of dataSent)
-         if (ACK_Status == -1) {
+    }
+    fecBlock *block = NULL;
+    for (unsigned int i = 0; i < FEC_BLOCKS; i++) {
+        fecBlock *candidate = &conn->fec_blocks[i];
+        if (candidate->used && candidate->first == first)
+            return candidate->parity == parity ? candidate : NULL;
+        if (block == NULL || (block->used && (!candidate->used || (int)(candidate->first - block->first) < 0)))
+            block = candidate;
+    }
+    if (parity > block->capacity) {
+        uint8_t *sums = (uint8_t *)realloc(block->sums, parity * FEC_UNIT_SIZE);
+        if (sums == NULL) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "FEC allocation failed");
+            return NULL;
+        }
+        block->sums = sums;
+        block->capacity = parity;
+    }
+    block->used = 1;
+    block->first = first;
+    block->count = 0;
+    block->parity = parity;
+    block->received = 0;
+    block->rows = 0;
+    block->length = 0;
+    return block;
+}
+
+// Rebuild the lost data packets of a block once as many of its parity packets arrived, and handle them as if they had
+// arrived: their loss is repaired, so it's never a congestion signal. A block is done once none of its data packets
+// is missing. Returns -1 on error.
+static int fec_decode(rudpConn *conn, fecBlock *block, uint64_t now) {
+    unsigned int missing[RUDP_FEC_MAX_PARITY], rows[RUDP_FEC_MAX_PARITY], e = 0, r = 0;
+    if (block->count == 0)
+        return 0; // The size of the block isn't known before a parity packet arrives
+    for (unsigned int index = 0; index < block->count; index++) {
+        if (block->received >> index & 1)
+            continue;
+        if (e == RUDP_FEC_MAX_PARITY)
+            return 0;
+        missing[e++] = index;
+    }
+    for (unsigned int row = 0; row < block->parity && r < e; row++) {
+        if (block->rows >> row & 1)
+            rows[r++] = row;
+    }
+    if (r < e)
+        return 0;
+    block->used = 0;
+    uint8_t inverse[RUDP_FEC_MAX_PARITY * RUDP_FEC_MAX_PARITY];
+    if (e == 0 || fec_invert(FEC_OPTION_MODE(conn->options), rows, missing, e, inverse) == -1)
+        return 0;
+
+    uint8_t unit[FEC_UNIT_SIZE];
+    for (unsigned int c = 0; c < e; c++) {
+        memset(unit, 0, block->length);
+        for (r = 0; r < e; r++)
+            fec_mul_add(unit, block->sums + rows[r] * FEC_UNIT_SIZE, inverse[c * e + r], block->length);
+        unsigned int length = (unsigned int)unit[0] << 8 | unit[1];
+        if (length > MAX_BUFFER_SIZE || FEC_LENGTH_SIZE + length > block->length)
+            continue; // Not a packet, the parity packets didn't match
+        // Without the FEC option, the rebuilt packet isn't added to a block again
+        Packet *packet = conn->fec_packet;
+        memset(packet, 0, HEADER_SIZE);
+        packet->Flag = 'D';
+        packet->Length = length;
+        packet->Seq = block->first + missing[c];
+        memcpy(packet->Content, unit + FEC_LENGTH_SIZE, length);
+        conn->fec_recovered++;
+        if (conn_input(conn, packet, now) == -1)
             return -1;
-        } 
-        if (ACK_Status == 0) {
+    }
+    return 0;
+}
+
+// A data packet of a FEC block arrived for the first time: add it to the sums of its block. Returns -1 on error.
+static int fec_data(rudpConn *conn, Packet *buffer, uint64_t now) {
+    unsigned int index = buffer->Window >> 8, parity = buffer->Window & 0xFF;
+    if (parity == 0 || parity > RUDP_FEC_MAX_PARITY || index >= RUDP_FEC_MAX_BLOCK)
+        return 0;
+    fecBlock *block = fec_block_get(conn, buffer->Seq - index, parity);
+    if (block == NULL)
+        return conn->fec_blocks == NULL ? -1 : 0;
+    if ((block->received >> index & 1) || (block->count > 0 && index >= block->count))
+        return 0;
+    int mode = FEC_OPTION_MODE(conn->options);
+    fec_extend(block->sums, block->parity, &block->length, FEC_LENGTH_SIZE + buffer->Length);
+    for (unsigned int row = 0; row < block->parity; row++)
+        fec_sum(block->sums + row * FEC_UNIT_SIZE, fec_coef(mode, row, index), buffer->Content, buffer->Length);
+    block->received |= 1ULL << index;
+    return fec_decode(conn, block, now);
+}
+
+// A parity packet arrived: add it to the sums of its block, unless all the data of the block arrived already.
+// Returns -1 on error.
+static int fec_parity_input(rudpConn *conn, Packet *buffer, uint64_t now) {
+    unsigned int count = buffer->Window >> 8, parity = buffer->Window >> 4 & 0xF, row = buffer->Window & 0xF;
+    if (count == 0 || count > RUDP_FEC_MAX_BLOCK || parity == 0 || parity > RUDP_FEC_MAX_PARITY || row >= parity ||
+        buffer->Length > FEC_UNIT_SIZE)
+        return 0;
+    if ((int)(buffer->Seq + count - conn->expected_seq) <= 0)
+        return 0;
+    fecBlock *block = fec_block_get(conn, buffer->Seq, parity);
+    if (block == NULL)
+        return conn->fec_blocks == NULL ? -1 : 0;
+    if ((block->rows >> row & 1) || (count < RUDP_FEC_MAX_BLOCK && block->received >> count != 0))
+        return 0;
+    block->count = count;
+    fec_extend(block->sums, block->parity, &block->length, buffer->Length);
+    fec_mul_add(block->sums + row * FEC_UNIT_SIZE, (const uint8_t *)buffer->Content, 1, buffer->Length);
+    block->rows |= 1U << row;
+    return fec_decode(conn, block, now);
+}
+
+// Handle a packet of the connection on the Receiver side: keep its data until it can be delivered in order, and mark
+// the connection's ACK as due (ack_now) or delayed (unacked), the caller queues it with ack_check after the batch.
+// The data a server's connection gets in order goes to on_data straight from the receive batch, without a copy.
+// Returns -1 on error.
+static int conn_input(rudpConn *conn, Packet *buffer, uint64_t now) {
+    // Got a SYN packet again (the ACK of the handshake was lost)
+    if (buffer->Flag == 'S') {
+        conn->ack_now = 1;
+        return 0;
+    }
+
+    // Got a PMTU probe, it's answered at once (its padding isn't kept)
+    if (buffer->Flag == 'P')
+        return queue_probe_reply(conn, buffer->Seq) == -1 ? -1 : 0;
+
+    // Got a Data packet
+    if (buffer->Flag == 'D') {
+        unsigned int offset = buffer->Seq - conn->expected_seq;
+        // Beyond the reassembly buffer, not acknowledged so the Sender will retransmit it later
+        if ((int)offset >= 0 && offset >= conn->window)
             return 0;
-        } 
-        if (ACK_Status == 1) {
-            return dataSent;
-        } 
-        attempts++;
-        printf("Retransmission attempt %d\n", attempts);
+        if (buffer != conn->fec_packet) {
+            conn->stats.packets_received++;
+            conn->stats.bytes_received += buffer->Length;
+        }
+        int filled = 0; // The packet fills a hole, the packets after it arrived out of order
+        int fresh = 0; // First arrival of the packet
+        if (offset == 0 && conn->server != NULL) {
+            fresh = 1;
+            conn->expected_seq++;
+            conn->server->callbacks.on_data(conn, buffer->Content, buffer->Length, conn->server->user);
+            filled = server_deliver(conn) > 0;
+        } else if ((int)offset >= 0) {
+            // New packet inside the window, kept until it can be delivered in order
+            fresh = conn->recv_slots == NULL || !conn->recv_slots[buffer->Seq % conn->window].present;
+            if (slot_keep(conn, buffer) == -1)
+                return -1;
+            filled = offset == 0 && conn->recv_slots[(buffer->Seq + 1) % conn->window].present;
+        }
+        if (!fresh)
+            conn->stats.duplicates++;
+        // In-order data waits for the delayed ACK. A packet out of order (a hole), the one that fills a hole and
+        // a duplicate (its ACK was lost) are acknowledged at once, so the Sender retransmits only what is missing.
+        if (offset != 0 || filled || (buffer->Options & OPTION_ACK_NOW))
+            conn->ack_now = 1;
+        else if (conn->unacked++ == 0)
+            conn->ack_deadline = now + conn->ack_delay;
+        // Its FEC block may now rebuild the packets of the block that were lost
+        if (fresh && (buffer->Options & OPTION_FEC))
+            return fec_data(conn, buffer, now);
+        return 0;
     }
-    // If maximum retransmission attempts reached
-    printf("Maximum retransmission attempts reached. Sending the data failed.\n");
-    return -1;
+
+    // Got a FEC parity packet, it isn't acknowledged (it's never retransmitted)
+    if (buffer->Flag == 'R')
+        return FEC_OPTION_MODE(conn->options) != RUDP_FEC_OFF ? fec_parity_input(conn, buffer, now) : 0;
+
+    // Got a FIN packet (Sender wants to close connection)
+    if (buffer->Flag == 'F') {
+        // A FIN that was already handled (its ACK was lost)
+        if ((int)(buffer->Seq - conn->expected_seq) < 0) {
+            conn->ack_now = 1;
+            return 0;
+        }
+        // FIN is handled only after all the data before it was delivered
+        conn->fin_received = 1;
+        conn->fin_seq = buffer->Seq;
+    }
+    return 0;
 }
 
-int rdup_close(int sockfd, struct sockaddr *serv_addr, socklen_t addrlen, struct sockaddr * respond_server, socklen_t * respond_server_len) {
-    printf("Sending request for exit.\n");
-   
-    // Send FIN message - send just flag without a real data
-    Packet FIN;
-    memset(&FIN, 0, sizeof(FIN)); // ensure struct is clean
-    strcpy(FIN.Content,"Exit");
-    FIN.Length = 0;
-    FIN.Flag = 'F';
-    
-    int attempts = 0;
-    // The function wait for an acknowledgment packet, if it didnt receive any, retransmits the packet till default max_attempts
-    // This for preventing infinite loops in case of persistent failures
-    while (attempts < MAX_RETRANSMISSION_ATTEMPTS) {
-        // send FIN packet 
-        ssize_t size_FIN = sendto(sockfd, &FIN, sizeof(Packet), 0, (const struct sockaddr *)serv_addr,addrlen); 
-        if (size_FIN<=0) {
-            perror("FIN packet failed to be send");
-            close(sockfd);
+// Copy the in-order data that is waiting in the reassembly buffer to the user's buffer
+static int deliver(rudpConn *conn, char *buf, int buflen) {
+    int copied = 0;
+    if (conn->recv_slots == NULL)
+        return 0;
+    while (copied < buflen) {
+        recvSlot *slot = &conn->recv_slots[conn->expected_seq % conn->window];
+        if (!slot->present)
+            break;
+        int available = slot->length - slot->delivered;
+        int n = available < buflen - copied ? available : buflen - copied;
+        memcpy(buf + copied, slot->packet->Content + slot->delivered, n);
+        copied += n;
+        slot->delivered += n;
+        if (slot->delivered == slot->length) {
+            slot_release(conn, slot);
+            conn->expected_seq++;
+        }
+    }
+    return copied;
+}
+
+// Function to receive the next in-order data from the Sender into buf (up to buflen bytes).
+// Packets are received in batches, a batch is acknowledged with one ACK (or none, while the delayed ACK waits).
+// Packets that arrive out of order are kept in the reassembly buffer.
+// Returns the number of bytes copied to buf, 0 when the Sender closed the connection (FIN), -1 on error.
+int rudp_receive(rudpConn *conn, void *buf, int buflen) {
+    Packet *buffer;
+
+    while (1) {
+        // Process every packet of the last batch
+        uint64_t now = now_us();
+        ssize_t rec_size;
+        while ((rec_size = rx_next(conn, &buffer, NULL)) != 0) {
+            // Corrupted packets are not acknowledged, the Sender will retransmit them
+            if (rec_size == -2) {
+                RUDP_LOG(RUDP_LOG_DEBUG, "Checksum is not valid, packet dropped.");
+                continue;
+            }
+            // Packets of other connections are ignored, a rudpServer serves several Senders on one socket
+            if (buffer->ConnID != conn->conn_id)
+                continue;
+            if (conn_input(conn, buffer, now) == -1)
+                return -1;
+        }
+
+        // Send the ACK of the whole batch, if it's due
+        if (ack_check(conn, now_us()) == -1 || tx_flush(conn) == -1) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packet ACK failed to be Send data");
             return -1;
         }
 
-        int ACK_Status = got_ACK (sockfd, respond_server, respond_server_len);
-        // Check if no timeout, out of the loop
-        if (ACK_Status != -10) {
-            if (ACK_Status == 1) {
-                printf("Got ACK from Receiver.\n");
-                printf("Exit.\n");
+        // Data that is already in order is returned before waiting for more packets
+        int copied = deliver(conn, (char *)buf, buflen);
+        if (copied > 0)
+            return copied;
+
+        if (conn->fin_received && conn->fin_seq == conn->expected_seq) {
+            RUDP_LOG(RUDP_LOG_INFO, "Sender sent exit message.");
+            conn->fin_received = 0;
+            conn->expected_seq++;
+            if (send_ACK(conn) == -1) {
+                RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packet ACK failed to be Send for start connection");
+                return -1;
             }
-            return ACK_Status;
-        } 
-        attempts++;
-        printf("Retransmission attempt %d\n", attempts);
+            RUDP_LOG(RUDP_LOG_INFO, "ACK sent.");
+            return 0;
+        }
+
+        // Wait for more packets, but no longer than the deadline of the delayed ACK
+        if (rx_wait(conn, conn->unacked > 0 ? conn->ack_deadline : UINT64_MAX) == -1 && errno != EINTR) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packet failed to be received");
+            close(conn->sockfd);
+            return -1;
+        }
     }
+}
 
-    // If maximum retransmission attempts reached
-    printf("Maximum retransmission attempts reached. disconnect failed.\n");
-    return -1;
+// *** Server's functions: ***
+
+// FNV-1a hash of the address of the Sender and the connection ID
+static uint32_t conn_hash(const void *name, socklen_t name_len, uint32_t conn_id) {
+    const unsigned char *bytes = (const unsigned char *)name;
+    uint32_t hash = 2166136261u;
+    for (socklen_t i = 0; i < name_len; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    for (int i = 0; i < 4; i++)
+        hash = (hash ^ ((conn_id >> (8 * i)) & 0xFF)) * 16777619u;
+    return hash;
 }
 
-// *** Receiver's functions: ***
+static rudpConn **server_bucket(rudpServer *server, const void *name, socklen_t name_len, uint32_t conn_id) {
+    return &server->buckets[conn_hash(name, name_len, conn_id) & (server->bucket_count - 1)];
+}
 
-// Function that send ACK packet to Sender
-int send_ACK(int sockfd, struct sockaddr * dest, socklen_t destlen) {   
-    // Send ACK message - send just flag without a real data
-    Packet ACK;
-    memset(&ACK, 0, sizeof(ACK)); // ensure struct is clean
-    ACK.Length = 0;
-    ACK.Flag = 'A';
-    
-    ssize_t size_ACK = sendto(sockfd, &ACK, sizeof(Packet), 0, (const struct sockaddr *)dest, destlen);
-    if (size_ACK<=0) {
-            perror("ACK packet failed to be send");
-            close(sockfd);
-            return -1;
+static rudpConn *server_lookup(rudpServer *server, const void *name, socklen_t name_len, uint32_t conn_id) {
+    for (rudpConn *conn = *server_bucket(server, name, name_len, conn_id); conn != NULL; conn = conn->hash_next) {
+        if (conn->conn_id == conn_id && conn->peer_len == name_len && memcmp(&conn->peer, name, name_len) == 0)
+            return conn;
+    }
+    return NULL;
+}
+
+// Double the table once it holds more connections than buckets, so chains stay short
+static void server_grow(rudpServer *server) {
+    unsigned int old_count = server->bucket_count;
+    rudpConn **old = server->buckets;
+    rudpConn **buckets = (rudpConn **)calloc(old_count * 2, sizeof(rudpConn *));
+    if (buckets == NULL)
+        return; // Longer chains, but still correct
+    server->buckets = buckets;
+    server->bucket_count = old_count * 2;
+    for (unsigned int i = 0; i < old_count; i++) {
+        rudpConn *conn = old[i];
+        while (conn != NULL) {
+            rudpConn *next = conn->hash_next;
+            rudpConn **bucket = server_bucket(server, &conn->peer, conn->peer_len, conn->conn_id);
+            conn->hash_next = *bucket;
+            *bucket = conn;
+            conn = next;
         }
-    return 1;
+    }
+    free(old);
+}
+
+static void server_insert(rudpServer *server, rudpConn *conn) {
+    if (server->size >= server->bucket_count)
+        server_grow(server);
+    rudpConn **bucket = server_bucket(server, &conn->peer, conn->peer_len, conn->conn_id);
+    conn->hash_next = *bucket;
+    *bucket = conn;
+    server->size++;
 }
 
-// Function to receive any type of packet,
-// after receive successfully, send ACK packet to the Sender 
-int rudp_receive(int sockfd, struct sockaddr * Sender_adrr, socklen_t * Sender_len) {
-    Packet buffer;
-    memset(&buffer, 0, sizeof(Packet));
+// Remove the connection from the table, tell the user why it's closed and free it
+static void server_close(rudpServer *server, rudpConn *conn, int reason) {
+    rudpConn **link = server_bucket(server, &conn->peer, conn->peer_len, conn->conn_id);
+    while (*link != conn)
+        link = &(*link)->hash_next;
+    *link = conn->hash_next;
+    server->size--;
+    for (link = &server->ack_list; conn->ack_listed && *link != NULL; link = &(*link)->ack_next) {
+        if (*link == conn) {
+            *link = conn->ack_next;
+            break;
+        }
+    }
+    if (server->callbacks.on_close != NULL)
+        server->callbacks.on_close(conn, reason, server->user);
+    rudpConn_free(conn);
+}
 
-    ssize_t rec_size = recvfrom(sockfd, &buffer, sizeof(Packet), 0, Sender_adrr, Sender_len);
-    if (rec_size<0) {
-            perror("packet failed to be received");
-            close(sockfd);
-            return -1;
+// A SYN of a new connection: create its state, the SYN itself is acknowledged by conn_input
+static rudpConn *server_accept(rudpServer *server, Packet *syn, struct msghdr *from) {
+    rudpConn *conn = conn_new(server->io->sockfd, server->window);
+    if (conn == NULL) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Connection allocation failed");
+        return NULL;
+    }
+    conn->server = server;
+    conn->tx = server->io->tx;
+    conn->rx = server->io->rx;
+    conn->batch = server->io->batch;
+    conn->ack_every = server->io->ack_every;
+    conn->ack_delay = server->io->ack_delay;
+    memcpy(&conn->peer, from->msg_name, from->msg_namelen);
+    conn->peer_len = from->msg_namelen;
+    conn->conn_id = syn->ConnID;
+    conn->options = (syn->Options & (OPTION_CRC32C | OPTION_FEC)) | (syn->Options & server->io->options & OPTION_COMPRESS);
+    if (conn->options & OPTION_FEC)
+        socket_rcvbuf(conn->sockfd, 2 * server->window); // Parity packets arrive on top of the window of data
+    if (syn->Window > 0 && syn->Window < conn->window)
+        conn->window = syn->Window;
+    conn->expected_seq = syn->Seq + 1;
+    if ((syn->Options & OPTION_RESUME) && resume_copy(&conn->peer_resume, &conn->peer_resume_len, syn->Content, syn->Length) == -1)
+        RUDP_LOG(RUDP_LOG_WARN, "Resume data of the Sender ignored");
+    if (server->callbacks.on_accept != NULL && server->callbacks.on_accept(conn, server->user) == -1) {
+        rudpConn_free(conn);
+        return NULL;
+    }
+    server_insert(server, conn);
+    return conn;
+}
+
+// Route a received packet to its connection
+static int server_input(rudpServer *server, Packet *buffer, struct msghdr *from, uint64_t now) {
+    rudpConn *conn = server_lookup(server, from->msg_name, from->msg_namelen, buffer->ConnID);
+    if (conn == NULL) {
+        if (buffer->Flag == 'S') {
+            conn = server_accept(server, buffer, from);
+        } else if (buffer->Flag == 'F') {
+            // The connection was already closed and the ACK of its FIN was lost, acknowledge it again
+            Packet *ACK = tx_next(server->io);
+            if (ACK == NULL)
+                return -1;
+            memset(ACK, 0, HEADER_SIZE);
+            ACK->Flag = 'A';
+            ACK->Seq = buffer->Seq + 1;
+            ACK->Window = server->window;
+            tx_queue(server->io->tx, buffer->ConnID, buffer->Options & OPTION_CRC32C, NULL, from->msg_name, from->msg_namelen);
         }
-    // Connection closed
-    if (rec_size == 0) {
-            printf("Connection closed by peer.\n");
-            close(sockfd);       
+        if (conn == NULL)
             return 0;
     }
 
-    // Ensure that the buffer is null-terminated, no matter what message was received.
-    // This is important to avoid SEGFAULTs when printing the buffer.
-    if (buffer.Content[MAX_BUFFER_SIZE - 1] != '\0')
-           buffer.Content[MAX_BUFFER_SIZE- 1] = '\0';
-    
-    int ACK = 0;
-    // Got a SYN packet (Sender wants to connect)
-    if(buffer.Flag == 'S') {
-        printf("Connection request received, sending ACK.\n");
-        ACK = send_ACK(sockfd, Sender_adrr,*Sender_len);
-        if (ACK == -1){
-            perror("packet ACK failed to be Send for start connection");
-            close(sockfd);
+    conn->last_active = now;
+    if (conn_input(conn, buffer, now) == -1)
+        return -1;
+    // All the data before the FIN was delivered, the connection is done
+    if (conn->fin_received && conn->fin_seq == conn->expected_seq) {
+        conn->expected_seq++;
+        if (queue_ACK(conn) == -1)
             return -1;
-        }
-        printf("Sender connected, beginning to receive file...\n");
-        return 1;
+        server_close(server, conn, RUDP_CLOSE_FIN);
+        return 0;
     }
-    // Got a Data packet
-    if(buffer.Flag == 'D') {
-        int val_checksum = verify_checksum(&buffer,buffer.Length);
-        if (val_checksum == -1) {
-            perror("Checksum is not valid");
-            close(sockfd);
-            return -1;
-        } else { 
-            ACK = send_ACK(sockfd, Sender_adrr,*Sender_len);
-            if (ACK == -1){
-                perror("packet ACK failed to be Send data");
-                close(sockfd);
-                return -1;
-            }
-            return rec_size;
-        }   
+    // The ACK is queued after the batch, together with the ACKs of the other connections
+    if ((conn->ack_now || conn->unacked > 0) && !conn->ack_listed) {
+        conn->ack_listed = 1;
+        conn->ack_next = server->ack_list;
+        server->ack_list = conn;
     }
+    return 0;
+}
 
-    // Got a FIN packet (Sender wants to close connection)
-    if(buffer.Flag == 'F') {
-        printf("Sender sent exit message.\n");
-        ACK = send_ACK(sockfd, Sender_adrr,*Sender_len);
-        if (ACK == -1){
-            perror("packet ACK failed to be Send for start connection");
-            close(sockfd);
+// Queue the ACKs that are due, the connections whose ACK is still delayed stay in the list
+static int server_ack(rudpServer *server, uint64_t now) {
+    rudpConn **link = &server->ack_list;
+    while (*link != NULL) {
+        rudpConn *conn = *link;
+        if (ack_check(conn, now) == -1)
             return -1;
+        if (conn->unacked == 0 && !conn->ack_now) {
+            *link = conn->ack_next;
+            conn->ack_listed = 0;
+        } else {
+            link = &conn->ack_next;
         }
-        printf("ACK sent.\n");
-        memset(buffer.Content, 0, MAX_BUFFER_SIZE);
-        return 2;
     }
-
-   
     return 0;
 }
 
+// Close the connections that got no packets for IDLE_TIMEOUT_US
+static void server_expire(rudpServer *server, uint64_t now) {
+    for (unsigned int i = 0; i < server->bucket_count; i++) {
+        rudpConn *conn = server->buckets[i];
+        while (conn != NULL) {
+            rudpConn *next = conn->hash_next;
+            if (now - conn->last_active > IDLE_TIMEOUT_US)
+                server_close(server, conn, RUDP_CLOSE_IDLE);
+            conn = next;
+        }
+    }
+    server->next_expiry = now + EXPIRY_INTERVAL_US;
+}
+
+rudpServer *rudpServer_alloc(int sockfd, unsigned int window, const rudpServerCallbacks *callbacks, void *user) {
+    if (callbacks == NULL || callbacks->on_data == NULL)
+        return NULL;
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Setting the socket non-blocking failed");
+        return NULL;
+    }
+
+    rudpServer *server = (rudpServer *)calloc(1, sizeof(rudpServer));
+    if (server == NULL)
+        return NULL;
+    server->io = rudpConn_alloc(sockfd, window);
+    server->buckets = (rudpConn **)calloc(INITIAL_BUCKETS, sizeof(rudpConn *));
+    if (server->io == NULL || server->buckets == NULL) {
+        rudpConn_free(server->io);
+        free(server->buckets);
+        free(server);
+        return NULL;
+    }
+    server->io->nonblocking = 1;
+    server->callbacks = *callbacks;
+    server->user = user;
+    server->window = server->io->window;
+    server->bucket_count = INITIAL_BUCKETS;
+    server->next_expiry = now_us() + EXPIRY_INTERVAL_US;
+    return server;
+}
+
+void rudpServer_free(rudpServer *server) {
+    if (server == NULL)
+        return;
+    for (unsigned int i = 0; i < server->bucket_count; i++) {
+        while (server->buckets[i] != NULL)
+            server_close(server, server->buckets[i], RUDP_CLOSE_SHUTDOWN);
+    }
+    free(server->buckets);
+    rudpConn_free(server->io);
+    free(server);
+}
+
+int rudpServer_set_delayed_ack(rudpServer *server, unsigned int packets, unsigned int delay_us) {
+    return rudpConn_set_delayed_ack(server->io, packets, delay_us);
+}
+
+int rudpServer_set_offload(rudpServer *server, int enable) {
+    return rudpConn_set_offload(server->io, enable);
+}
+
+int rudpServer_set_compression(rudpServer *server, int enable) {
+    return rudpConn_set_compression(server->io, enable);
+}
+
+int rudpServer_fd(const rudpServer *server) {
+    return rudpConn_fd(server->io);
+}
+
+int rudpServer_set_engine(rudpServer *server, int engine) {
+    return rudpConn_set_engine(server->io, engine);
+}
 
+unsigned int rudpServer_size(const rudpServer *server) {
+    return server->size;
+}
 
+unsigned long rudpServer_checksum_failures(const rudpServer *server) {
+    return server->io->stats.checksum_failures;
+}
 
+int rudpServer_timeout(const rudpServer *server) {
+    uint64_t now = now_us();
+    uint64_t deadline = server->next_expiry;
+    for (const rudpConn *conn = server->ack_list; conn != NULL; conn = conn->ack_next) {
+        if (conn->unacked > 0 && conn->ack_deadline < deadline)
+            deadline = conn->ack_deadline;
+    }
+    if (now >= deadline)
+        return 0;
+    return (int)((deadline - now + 999) / 1000);
+}
 
+// Receive the packets that wait on the socket without blocking, and hand each one to its connection.
+// The ACKs of every batch are sent together, to all the Senders in the batch, one per connection at most.
+int rudpServer_poll(rudpServer *server) {
+    rudpConn *io = server->io;
+    int processed = 0;
 
+    for (int round = 0; round < SERVER_POLL_BUDGET; round++) {
+        if (rx_fill(io, MSG_DONTWAIT) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "packet failed to be received");
+            return -1;
+        }
 
+        uint64_t now = now_us();
+        Packet *buffer;
+        struct mmsghdr *from;
+        ssize_t rec_size;
+        while ((rec_size = rx_next(io, &buffer, &from)) != 0) {
+            // Corrupted packets are not acknowledged, the Sender will retransmit them
+            if (rec_size == -2)
+                continue;
+            processed++;
+            if (server_input(server, buffer, &from->msg_hdr, now) == -1)
+                return -1;
+        }
+        if (server_ack(server, now_us()) == -1 || tx_flush(io) == -1)
+            return -1;
+    }
 
+    // Delayed ACKs whose deadline passed while no packets arrived
+    uint64_t now = now_us();
+    if (server_ack(server, now) == -1 || tx_flush(io) == -1)
+        return -1;
+    if (now >= server->next_expiry)
+        server_expire(server, now);
+    return processed;
+}
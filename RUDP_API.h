@@ -1,5 +1,9 @@
 #pragma once
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // ppoll, sendmmsg/recvmmsg
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
@@ -9,29 +13,419 @@
 #include <sys/time.h>
 #include <time.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <errno.h>
 #include <stdint.h>
-#include <unistd.h> 
+#include <stddef.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/random.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "RUDP_CC.h"
+#include "RUDP_Checksum.h"
+#include "RUDP_FEC.h"
+#include "RUDP_Log.h"
 
 
 typedef struct UDP_Header Packet;
 
+// Default and maximal number of data packets in flight (sender window / receiver reassembly buffer)
+#define RUDP_DEFAULT_WINDOW 64
+#define RUDP_MAX_WINDOW 4096
+
+// Default and maximal number of datagrams sent or received with one system call
+#define RUDP_DEFAULT_BATCH 32
+#define RUDP_MAX_BATCH 64
+
+struct _rudpConn;
+typedef struct _rudpConn rudpConn;
+
+/*
+ * Completions of the asynchronous Sender API (see rudpConn_set_async), every callback may be NULL.
+ * A connection must not be freed inside its callbacks.
+ */
+typedef struct _rudpAsyncCallbacks {
+    // The handshake is done: status is 1, or -1 if the Receiver never answered
+    void (*on_connect)(rudpConn *conn, int status, void *user);
+    // A queued message was acknowledged (result is its size), or failed (-1) and its buffers may be reused
+    void (*on_send)(rudpConn *conn, uint64_t id, int64_t result, void *user);
+    // The FIN was acknowledged (status 1), or the connection failed after the handshake (-1)
+    void (*on_close)(rudpConn *conn, int status, void *user);
+} rudpAsyncCallbacks;
+
 int rudp_socket();
 
-int got_ACK(int sockfd, struct sockaddr * from, socklen_t * fromlen);
+// I/O engines of a connection, see rudpConn_set_engine
+#define RUDP_ENGINE_SYSCALL 0
+#define RUDP_ENGINE_URING 1
+
+/*
+ * Allocates the state of a RUDP connection over sockfd, with up to window packets in flight (0 for the default).
+ * It's the user responsibility to free it with rudpConn_free (the socket itself is not closed).
+ */
+rudpConn *rudpConn_alloc(int sockfd, unsigned int window);
+
+void rudpConn_free(rudpConn *conn);
+
+#define RUDP_INTEGRITY_CHECKSUM 0 // 16-bit one's complement checksum (the default)
+#define RUDP_INTEGRITY_CRC32C 1 // CRC32C, computed with SSE4.2 instructions when the CPU has them
+
+/*
+ * Sets the integrity check the Sender asks for in its SYN, must be called before handshake_connect.
+ * The Receiver uses the one the Sender asked for, so rudpConn_integrity returns the negotiated one after the handshake.
+ * Returns 0 on success, -1 if the mode is unknown.
+ */
+int rudpConn_set_integrity(rudpConn *conn, int mode);
+
+int rudpConn_integrity(const rudpConn *conn);
+
+/*
+ * Compression of the session's file chunks (see RUDP_Session.h), negotiated with the handshake: a Sender turns it on
+ * before handshake_connect to ask for it, a blocking Receiver before handshake_accept (and a server with
+ * rudpServer_set_compression) to agree to it. The library doesn't compress anything itself, rudpConn_compression tells
+ * the session layer if both sides agreed. Returns 0.
+ */
+int rudpConn_set_compression(rudpConn *conn, int enable);
+
+int rudpConn_compression(const rudpConn *conn);
+
+/*
+ * User data attached to the connection (e.g. the state of a server's transfer), NULL until it's set.
+ */
+void rudpConn_set_user(rudpConn *conn, void *user);
+
+void *rudpConn_user(const rudpConn *conn);
+
+/*
+ * Returns the address of the other side of the connection, its length is stored in len (if not NULL).
+ */
+const struct sockaddr *rudpConn_peer(const rudpConn *conn, socklen_t *len);
+
+// Most bytes of resume data, so the SYN and its ACK fit in a packet of RUDP_BASE_MTU bytes
+#define RUDP_MAX_RESUME 1200
+
+/*
+ * Sets the data the connection sends with the handshake to resume a transfer (see RUDP_Resume.h): a Sender sets it before
+ * handshake_connect and it goes in its SYN, a Receiver sets it in the server's on_accept (after reading the Sender's with
+ * rudpConn_resume) and it goes in the ACK of the SYN. The data is copied, len 0 sends none.
+ * Returns 0, or -1 if len is above RUDP_MAX_RESUME or on allocation error.
+ */
+int rudpConn_set_resume(rudpConn *conn, const void *data, size_t len);
+
+/*
+ * The resume data the peer sent with the handshake is stored in data, valid until the connection is freed.
+ * Returns its size, 0 if the peer sent none.
+ */
+size_t rudpConn_resume(const rudpConn *conn, const void **data);
+
+/*
+ * Returns the window in use, after the handshake it is the minimum of both peers' windows.
+ */
+unsigned int rudpConn_window(const rudpConn *conn);
+
+/*
+ * Sets the number of datagrams sent with one sendmmsg / received with one recvmmsg (0 for the default, 1 disables batching).
+ * Must be called before the handshake. Returns 0 on success, -1 if the batch buffers can't be allocated.
+ */
+int rudpConn_set_batch(rudpConn *conn, unsigned int batch);
+
+#define RUDP_OFFLOAD_GSO 1
+#define RUDP_OFFLOAD_GRO 2
+
+/*
+ * Turns UDP segmentation offload on or off for bulk transfers: runs of equal-sized packets are sent as one buffer
+ * that the kernel splits (UDP_SEGMENT), and buffers the kernel coalesced (UDP_GRO) are split back to packets on receive.
+ * Returns the offloads the kernel supports and were turned on (RUDP_OFFLOAD_GSO | RUDP_OFFLOAD_GRO), 0 when it
+ * supports neither (the connection keeps working without them), -1 if the receive buffers can't be allocated.
+ */
+int rudpConn_set_offload(rudpConn *conn, int enable);
+
+// Path MTU bounds (size of the IP packets, headers included): data packets start at the base MTU, that every IPv4
+// path of interest carries unfragmented, and grow up to jumbo frames when the path carries them
+#define RUDP_BASE_MTU 1280
+#define RUDP_MAX_MTU 9000
+
+/*
+ * Sets the MTU the Sender sizes its data packets to, must be called before the handshake.
+ * 0 (the default) discovers the path MTU: packets are sent with DF set and never fragmented, and probe packets of
+ * growing sizes search for the largest MTU the path carries, up to the MTU of the route (RUDP_MAX_MTU at most).
+ * Any other value pins the MTU (fragmentation is left to the IP layer). Returns 0 on success, -1 if mtu is out of bounds.
+ */
+int rudpConn_set_mtu(rudpConn *conn, unsigned int mtu);
+
+/*
+ * Returns the MTU the data packets are sized to now (it grows as probes succeed).
+ */
+unsigned int rudpConn_mtu(const rudpConn *conn);
+
+/*
+ * Turns forward error correction on for the data the Sender sends (RUDP_FEC_XOR or RUDP_FEC_RS, see RUDP_FEC.h), must be
+ * called before handshake_connect: the SYN asks the Receiver for it and it's used only if the Receiver agrees.
+ * Every block of up to block data packets (RUDP_FEC_MAX_BLOCK at most) is followed by parity packets, and the Receiver
+ * rebuilds lost packets of the block from them without waiting for a retransmission: one with XOR, as many as parity
+ * packets arrived with Reed-Solomon. A block ends early at half the congestion window, so its parity packets come
+ * before a lost packet would be retransmitted, and when the Sender has to wait for ACKs (end of the queued data or a
+ * full window), so the tail of a transfer is protected as well.
+ * parity is the number of parity packets per block (1 with XOR, RUDP_FEC_MAX_PARITY at most). With adaptive set, it's
+ * the most a block gets: the Sender estimates the loss rate from the holes in the ACKs and sends twice the packets a
+ * block is expected to lose (at least 1). Returns 0 on success, -1 if an argument is out of bounds or on allocation error.
+ */
+int rudpConn_set_fec(rudpConn *conn, int mode, unsigned int block, unsigned int parity, int adaptive);
+
+/*
+ * Returns the number of lost data packets the Receiver rebuilt from FEC parity packets.
+ */
+unsigned long rudpConn_fec_recovered(const rudpConn *conn);
+
+/*
+ * Returns the smoothed RTT and the current retransmission timeout of the connection (in microseconds).
+ */
+unsigned int rudpConn_srtt(const rudpConn *conn);
+
+unsigned int rudpConn_rto(const rudpConn *conn);
+
+/*
+ * Counters of a connection, for monitoring. The packets are the data packets (FEC parity packets included): the SYN,
+ * FIN, ACK and probe packets aren't counted.
+ */
+typedef struct _rudpConnStats {
+    uint64_t packets_sent; // Retransmissions included
+    uint64_t bytes_sent; // Data bytes of the packets sent
+    uint64_t packets_received; // Duplicates included, packets FEC rebuilt aren't
+    uint64_t bytes_received;
+    unsigned long retransmits;
+    unsigned long timeouts; // Retransmission timeouts, of the SYN and FIN as well
+    unsigned long checksum_failures; // Packets dropped as corrupted or malformed (a server counts them, see rudpServer_checksum_failures)
+    unsigned long duplicates; // Data packets that arrived again (the ACK of the first copy was lost or late)
+    unsigned int rtt_min; // Microseconds, 0 until the first RTT sample
+    unsigned int rtt_avg; // Mean of the samples
+    unsigned int rtt_max;
+    unsigned long rtt_samples;
+} rudpConnStats;
+
+/*
+ * Copies the counters of the connection to stats.
+ */
+void rudpConn_stats(const rudpConn *conn, rudpConnStats *stats);
 
-int handshake_connect(int sockfd, struct sockaddr *serv_addr, socklen_t addrlen, struct sockaddr * respond_server, socklen_t * respond_server_len);
+/*
+ * Congestion control counters of a connection, for tuning the controller.
+ */
+typedef struct _rudpCCStats {
+    unsigned int cwnd; // Packets
+    unsigned int ssthresh; // Packets
+    uint64_t pacing_rate; // Bytes per second, 0 before the first RTT sample
+    unsigned long losses; // Loss events detected by later ACKs
+    unsigned long timeouts; // Retransmission timeouts
+    unsigned long retransmits; // Retransmitted packets
+    unsigned long packets; // Data packets sent, retransmissions included
+    unsigned long acks; // ACK packets received
+    unsigned long parity; // FEC parity packets sent
+    unsigned int fec_parity; // Parity packets of the last FEC block (adaptive), 0 without FEC
+} rudpCCStats;
 
-int rudp_send(int sockfd, const void*msg, int len, struct sockaddr *serv_addr, socklen_t addrlen, struct sockaddr * respond_server, socklen_t * respond_server_len);
+/*
+ * Replaces the congestion controller of the connection (cc_newreno by default, see RUDP_CC.h).
+ * Returns 0 on success, -1 if ops is NULL.
+ */
+int rudpConn_set_cc(rudpConn *conn, const ccOps *ops);
 
-int rdup_close(int sockfd, struct sockaddr *serv_addr, socklen_t addrlen, struct sockaddr* respond_server, socklen_t * respond_server_len);
+void rudpConn_cc_stats(const rudpConn *conn, rudpCCStats *stats);
 
-int send_ACK(int sockfd, struct sockaddr * dest, socklen_t destlen);
+/*
+ * Delayed ACK policy of the Receiver: in-order data is acknowledged once every packets packets arrived, or delay_us
+ * microseconds after the first of them, whichever comes first (1 acknowledges every packet). Holes, duplicates and
+ * packets the Sender marks as urgent are acknowledged at once. The default is 16 packets or 1000 microseconds.
+ * Returns 0 on success, -1 if packets is 0.
+ */
+int rudpConn_set_delayed_ack(rudpConn *conn, unsigned int packets, unsigned int delay_us);
 
-int rudp_receive(int sockfd, struct sockaddr * Sender_adrr, socklen_t * Sender_len);
+/*
+ * Waits for an ACK until deadline (monotonic microseconds), its cumulative ACK is stored in ack_seq: every packet
+ * before it arrived (the packets after it that arrived are in the ACK's SACK bitmap). Returns 1, or -10 if the deadline passed.
+ */
+int got_ACK(rudpConn *conn, unsigned int *ack_seq, uint64_t deadline);
+
+int handshake_connect(rudpConn *conn, struct sockaddr *serv_addr, socklen_t addrlen);
+
+int handshake_accept(rudpConn *conn);
+
+/*
+ * Sends len bytes of msg reliably and returns len, or -1 on error. The data isn't copied, packets point into msg.
+ */
+int rudp_send(rudpConn *conn, const void*msg, int len);
+
+/*
+ * Sends iovcnt buffers one after the other as one stream of packets, with no pause between them: a buffer's first
+ * packets are in flight while the last packets of the one before it wait for their ACKs. Packets never span two
+ * buffers, so small buffers (e.g. a header in front of a file) make short packets. Returns the number of bytes sent,
+ * or -1 on error. Returns only after all of them were acknowledged, the buffers must stay valid until then.
+ */
+int64_t rudp_sendv(rudpConn *conn, const struct iovec *iov, int iovcnt);
+
+/*
+ * Sends len bytes of the file open as fd from offset, with no copy of the data in user space: the file is mapped
+ * read-only and every packet is sent with an iovec that points into the mapping. The file must not shrink meanwhile.
+ * Returns the number of bytes sent (len), or -1 on error. rudp_send_file sends a whole file by its path.
+ */
+int64_t rudp_send_fd(rudpConn *conn, int fd, off_t offset, int64_t len);
+
+int64_t rudp_send_file(rudpConn *conn, const char *path);
+
+int rdup_close(rudpConn *conn);
+
+int send_ACK(rudpConn *conn);
+
+int rudp_receive(rudpConn *conn, void *buf, int buflen);
 
 unsigned short int calculate_checksum(void *data, size_t bytes) ;
 
 int verify_checksum(Packet *buffer, size_t bytes);
 
+/*
+ * Asynchronous Sender: the connection never blocks, so any number of them are driven by the application's own event loop.
+ * rudpConn_set_async makes the socket non-blocking, then the connection is used only with the functions below:
+ * the handshake, the messages and the FIN are queued, and their completion is reported to the callbacks.
+ * Call rudpConn_poll when rudpConn_fd is readable, and when rudpConn_timeout milliseconds passed.
+ */
+int rudpConn_set_async(rudpConn *conn, const rudpAsyncCallbacks *callbacks, void *user);
+
+/*
+ * The file descriptor to wait for with epoll/poll (POLLIN): the socket of the connection, or the io_uring that
+ * receives its packets with RUDP_ENGINE_URING.
+ */
+int rudpConn_fd(const rudpConn *conn);
+
+/*
+ * Sets the engine the connection does its I/O with, before the handshake (and before rudpConn_fd):
+ * RUDP_ENGINE_SYSCALL (the default) sends and receives batches with sendmmsg/recvmmsg, RUDP_ENGINE_URING with io_uring:
+ * datagrams arrive through a multishot recvmsg into buffers the kernel picks from, and are read there (no system call
+ * and no copy per batch while the socket is busy); every batch of packets and ACKs goes out as one chain of linked
+ * sendmsg requests, and stays in flight while the next batch is filled (rudp_sendv returns, and on_send is called,
+ * once the kernel is done with the message). Needs kernel 5.19 or later. If the kernel refuses io_uring, the
+ * connection keeps the system calls (a warning is logged).
+ * Returns 0, or -1 if the engine is unknown.
+ */
+int rudpConn_set_engine(rudpConn *conn, int engine);
+
+/*
+ * Returns the engine the connection does its I/O with (RUDP_ENGINE_*).
+ */
+int rudpConn_engine(const rudpConn *conn);
+
+/*
+ * Starts the handshake, on_connect reports its end. Messages may be queued meanwhile.
+ * Returns 0, or -1 if the connection isn't asynchronous or was already connected.
+ */
+int rudp_connect_async(rudpConn *conn, const struct sockaddr *addr, socklen_t addrlen);
+
+/*
+ * Queues a message (len bytes of msg, or iovcnt buffers sent one after the other), without copying it: the buffers
+ * must stay valid until on_send reports the message with the given id. Messages are sent in the order they were queued.
+ * Returns 0, or -1 if the connection isn't connecting or open.
+ */
+int rudp_send_async(rudpConn *conn, const void *msg, size_t len, uint64_t id);
+
+int rudp_sendv_async(rudpConn *conn, const struct iovec *iov, int iovcnt, uint64_t id);
+
+/*
+ * Queues the FIN, it's sent once every queued message was acknowledged and on_close reports its ACK.
+ * Returns 0, or -1 if the connection isn't open.
+ */
+int rudp_close_async(rudpConn *conn);
+
+/*
+ * Handles the ACKs waiting on the socket and the expired timers without blocking, sends what the windows allow,
+ * and calls the callbacks of what completed. Returns the number of ACKs handled, -1 if the connection failed.
+ */
+int rudpConn_poll(rudpConn *conn);
+
+/*
+ * Milliseconds until rudpConn_poll has timers to run (retransmissions, pacing), -1 if it has none:
+ * the timeout for epoll_wait/poll.
+ */
+int rudpConn_timeout(const rudpConn *conn);
+
+/*
+ * A server: any number of Senders transfer data to it over one UDP socket at the same time.
+ * Packets are matched to their connection by the address of the Sender and the connection ID in the header,
+ * and the server never blocks on a single peer, so it's driven by an event loop (epoll/poll on the socket).
+ */
+struct _rudpServer;
+typedef struct _rudpServer rudpServer;
+
+// Reasons a server's connection is closed
+#define RUDP_CLOSE_FIN 0 // The Sender closed it, all its data was delivered
+#define RUDP_CLOSE_IDLE 1 // No packets arrived for a long time
+#define RUDP_CLOSE_SHUTDOWN 2 // The server was freed
+
+typedef struct _rudpServerCallbacks {
+    // A new connection, returns 0 to accept it or -1 to refuse it (may be NULL)
+    int (*on_accept)(rudpConn *conn, void *user);
+    // The next in-order data of the connection, the buffer is valid only during the call
+    void (*on_data)(rudpConn *conn, const char *data, int len, void *user);
+    // The connection is closed and freed right after the call (may be NULL)
+    void (*on_close)(rudpConn *conn, int reason, void *user);
+} rudpServerCallbacks;
+
+/*
+ * Allocates a server on a bound socket (that is made non-blocking), offering up to window packets in flight
+ * to each connection (0 for the default). user is passed to every callback.
+ * It's the user responsibility to free it with rudpServer_free (the socket itself is not closed).
+ */
+rudpServer *rudpServer_alloc(int sockfd, unsigned int window, const rudpServerCallbacks *callbacks, void *user);
+
+/*
+ * Closes every connection that is still open (on_close with RUDP_CLOSE_SHUTDOWN) and frees the server.
+ */
+void rudpServer_free(rudpServer *server);
+
+/*
+ * Same as rudpConn_set_delayed_ack, for the connections the server accepts from now on.
+ */
+int rudpServer_set_delayed_ack(rudpServer *server, unsigned int packets, unsigned int delay_us);
+
+/*
+ * Same as rudpConn_set_offload, for the socket of the server.
+ */
+int rudpServer_set_offload(rudpServer *server, int enable);
+
+/*
+ * The server's connections agree to compression when their Sender asks for it, see rudpConn_set_compression.
+ */
+int rudpServer_set_compression(rudpServer *server, int enable);
+
+/*
+ * Handles the packets waiting on the socket, without blocking: call it when the socket is readable, and when
+ * rudpServer_timeout milliseconds passed (idle connections are closed). Returns the number of packets handled, -1 on error.
+ */
+int rudpServer_poll(rudpServer *server);
+
+/*
+ * The file descriptor to wait for with epoll/poll (POLLIN) before rudpServer_poll, see rudpConn_fd.
+ */
+int rudpServer_fd(const rudpServer *server);
+
+/*
+ * The engine the server's socket does its I/O with, for all its connections (see rudpConn_set_engine).
+ * Call it before rudpServer_fd. Returns 0, or -1 if the engine is unknown.
+ */
+int rudpServer_set_engine(rudpServer *server, int engine);
+
+/*
+ * Milliseconds until rudpServer_poll has timers to run (delayed ACKs, idle connections), the timeout for epoll_wait/poll.
+ */
+int rudpServer_timeout(const rudpServer *server);
+
+/*
+ * Number of open connections.
+ */
+unsigned int rudpServer_size(const rudpServer *server);
 
+/*
+ * Packets the server dropped as corrupted or malformed, before it could tell their connection.
+ */
+unsigned long rudpServer_checksum_failures(const rudpServer *server);
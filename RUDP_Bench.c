@@ -0,0 +1,417 @@
+#include "RUDP_API.h"
+#include <pthread.h>
+#include <sys/resource.h>
+
+// Benchmark suite over loopback, without any interaction: bulk transfers from KBs to a GB, the same transfer with
+// different chunk sizes (MTUs), and message-rate runs of small messages. Every scenario reports its goodput, packet
+// rate, CPU time per GB, retransmit ratio and, for messages, the p50/p99/p999 delivery latency, as JSON or CSV, so runs
+// of two releases can be compared.
+
+#define PATTERN_SIZE (16 * 1024 * 1024) // Bulk data is this buffer, sent as many times as needed
+#define RECEIVE_SIZE (256 * 1024)
+#define QUICK_MAX_BYTES (64 * 1024 * 1024) // -quick skips the larger bulk transfers
+#define MESSAGE_OUTSTANDING 256 // Messages queued and not acknowledged yet, at most
+#define STAMP_SIZE 8 // A message starts with the time it was sent (monotonic microseconds)
+#define MB (1024.0 * 1024.0)
+#define GB (1024.0 * 1024.0 * 1024.0)
+
+#define KIND_BULK 0
+#define KIND_MESSAGES 1
+
+typedef struct _benchScenario {
+    const char *name;
+    int kind;
+    uint64_t bytes; // Bulk transfer size, or the messages' bytes
+    unsigned int mtu; // 0 discovers the path MTU
+    unsigned int message_size;
+    unsigned long messages;
+} benchScenario;
+
+typedef struct _benchResult {
+    double seconds;
+    double cpu_seconds; // User and system time of both ends
+    rudpCCStats stats;
+    unsigned int mtu; // Path MTU at the end of the run
+    double p50, p99, p999; // Delivery latency of messages (microseconds)
+} benchResult;
+
+// Receiver side of a run, in its own thread
+typedef struct _benchReceiver {
+    int socket;
+    const benchScenario *scenario;
+    uint64_t received;
+    double end; // Time the last byte arrived
+    unsigned char stamp[STAMP_SIZE]; // Of the message being received, it may arrive in pieces
+    uint32_t *latencies;
+    unsigned long latency_count;
+    int failed;
+} benchReceiver;
+
+// The Sender of a message-rate run: its messages are queued with the asynchronous API, MESSAGE_OUTSTANDING at a time
+typedef struct _messageSender {
+    unsigned long done; // Acknowledged messages
+    int connected;
+    int closed;
+    int failed;
+} messageSender;
+
+static const benchScenario scenarios[] = {
+    { "bulk-64KB", KIND_BULK, 64 * 1024, 0, 0, 0 },
+    { "bulk-1MB", KIND_BULK, 1024 * 1024, 0, 0, 0 },
+    { "bulk-16MB", KIND_BULK, 16 * 1024 * 1024, 0, 0, 0 },
+    { "bulk-256MB", KIND_BULK, 256 * 1024 * 1024, 0, 0, 0 },
+    { "bulk-1GB", KIND_BULK, 1024 * 1024 * 1024, 0, 0, 0 },
+    { "chunk-1280", KIND_BULK, 64 * 1024 * 1024, 1280, 0, 0 },
+    { "chunk-1500", KIND_BULK, 64 * 1024 * 1024, 1500, 0, 0 },
+    { "chunk-4096", KIND_BULK, 64 * 1024 * 1024, 4096, 0, 0 },
+    { "chunk-9000", KIND_BULK, 64 * 1024 * 1024, 9000, 0, 0 },
+    { "msg-64B", KIND_MESSAGES, 64 * 200000, 0, 64, 200000 },
+    { "msg-256B", KIND_MESSAGES, 256 * 100000, 0, 256, 100000 },
+    { "msg-1KB", KIND_MESSAGES, 1024 * 100000, 0, 1024, 100000 },
+};
+
+static int bench_engine = RUDP_ENGINE_SYSCALL; // I/O engine of the sockets (-engine)
+
+// Monotonic time in seconds
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t now_micros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// User and system CPU time of the process (both ends of a run are its threads)
+static double cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// The messages in the received bytes: the delivery latency of every message whose stamp is complete
+static void receive_stamps(benchReceiver *r, const unsigned char *data, int len) {
+    unsigned int size = r->scenario->message_size;
+    uint64_t pos = r->received;
+    uint64_t now = now_micros();
+    int off = 0;
+    while (off < len) {
+        unsigned int in_message = pos % size;
+        int n;
+        if (in_message < STAMP_SIZE) {
+            n = STAMP_SIZE - in_message < (unsigned int)(len - off) ? (int)(STAMP_SIZE - in_message) : len - off;
+            memcpy(r->stamp + in_message, data + off, n);
+            if (in_message + n == STAMP_SIZE && r->latency_count < r->scenario->messages) {
+                uint64_t sent;
+                memcpy(&sent, r->stamp, sizeof(sent));
+                r->latencies[r->latency_count++] = now > sent ? (uint32_t)(now - sent) : 0;
+            }
+        } else {
+            n = size - in_message < (unsigned int)(len - off) ? (int)(size - in_message) : len - off;
+        }
+        off += n;
+        pos += n;
+    }
+}
+
+// Receiver side of a run: accept the connection and read until the Sender closes it
+static void *receiver_thread(void *arg) {
+    benchReceiver *r = (benchReceiver *)arg;
+    unsigned char *buffer = (unsigned char *)malloc(RECEIVE_SIZE);
+    rudpConn *conn = rudpConn_alloc(r->socket, RUDP_DEFAULT_WINDOW);
+    if (buffer == NULL || conn == NULL || rudpConn_set_engine(conn, bench_engine) == -1 || handshake_accept(conn) != 1) {
+        rudpConn_free(conn);
+        free(buffer);
+        r->failed = 1;
+        return NULL;
+    }
+    int bytes;
+    while ((bytes = rudp_receive(conn, buffer, RECEIVE_SIZE)) > 0) {
+        if (r->scenario->kind == KIND_MESSAGES)
+            receive_stamps(r, buffer, bytes);
+        r->received += bytes;
+        if (r->received == r->scenario->bytes)
+            r->end = now_seconds();
+    }
+    if (bytes < 0)
+        r->failed = 1;
+    rudpConn_free(conn);
+    free(buffer);
+    return NULL;
+}
+
+// Bulk transfer: the pattern buffer over and over, with one rudp_sendv. Returns the start time, or -1 on error.
+static double send_bulk(rudpConn *conn, const benchScenario *scenario, const char *pattern) {
+    int count = (int)((scenario->bytes + PATTERN_SIZE - 1) / PATTERN_SIZE);
+    struct iovec *iov = (struct iovec *)calloc(count, sizeof(struct iovec));
+    if (iov == NULL)
+        return -1;
+    uint64_t left = scenario->bytes;
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = (void *)pattern;
+        iov[i].iov_len = left < PATTERN_SIZE ? left : PATTERN_SIZE;
+        left -= iov[i].iov_len;
+    }
+    double start = now_seconds();
+    int64_t sent = rudp_sendv(conn, iov, count);
+    free(iov);
+    if (sent != (int64_t)scenario->bytes || rdup_close(conn) != 1)
+        return -1;
+    return start;
+}
+
+static void on_connect(rudpConn *conn, int status, void *user) {
+    messageSender *s = (messageSender *)user;
+    (void)conn;
+    s->connected = status == 1;
+    s->failed |= status != 1;
+}
+
+static void on_send(rudpConn *conn, uint64_t id, int64_t result, void *user) {
+    messageSender *s = (messageSender *)user;
+    (void)conn;
+    (void)id;
+    s->done++;
+    s->failed |= result < 0;
+}
+
+static void on_close(rudpConn *conn, int status, void *user) {
+    messageSender *s = (messageSender *)user;
+    (void)conn;
+    s->closed = 1;
+    s->failed |= status != 1;
+}
+
+// Message-rate run: every message is stamped when it's queued, MESSAGE_OUTSTANDING of them are in the queue or in
+// flight at a time. Returns the start time, or -1 on error.
+static double send_messages(rudpConn *conn, const benchScenario *scenario, const struct sockaddr *addr, socklen_t addrlen) {
+    messageSender sender = { 0, 0, 0, 0 };
+    rudpAsyncCallbacks callbacks = { on_connect, on_send, on_close };
+    char *ring = (char *)malloc((size_t)MESSAGE_OUTSTANDING * scenario->message_size);
+    if (ring == NULL || rudpConn_set_async(conn, &callbacks, &sender) == -1 || rudp_connect_async(conn, addr, addrlen) == -1) {
+        free(ring);
+        return -1;
+    }
+    memset(ring, 'm', (size_t)MESSAGE_OUTSTANDING * scenario->message_size);
+    double start = -1;
+    unsigned long queued = 0;
+    int closing = 0;
+    while (!sender.closed && !sender.failed) {
+        if (sender.connected && start < 0)
+            start = now_seconds();
+        while (sender.connected && queued < scenario->messages && queued - sender.done < MESSAGE_OUTSTANDING) {
+            char *message = ring + (queued % MESSAGE_OUTSTANDING) * scenario->message_size;
+            uint64_t stamp = now_micros();
+            memcpy(message, &stamp, sizeof(stamp));
+            if (rudp_send_async(conn, message, scenario->message_size, queued) == -1) {
+                sender.failed = 1;
+                break;
+            }
+            queued++;
+        }
+        if (sender.done == scenario->messages && !closing) {
+            closing = 1;
+            if (rudp_close_async(conn) == -1)
+                sender.failed = 1;
+        }
+        struct pollfd pfd = { rudpConn_fd(conn), POLLIN, 0 };
+        poll(&pfd, 1, rudpConn_timeout(conn));
+        if (rudpConn_poll(conn) == -1)
+            sender.failed = 1;
+    }
+    free(ring);
+    return sender.failed ? -1 : start;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint32_t *sorted, unsigned long count, double p) {
+    if (count == 0)
+        return 0;
+    unsigned long i = (unsigned long)(p * (count - 1) + 0.5);
+    return sorted[i];
+}
+
+// Run a scenario over loopback, a Receiver thread and the Sender in this one. Returns -1 on error.
+static int bench_run(const benchScenario *scenario, const char *pattern, benchResult *result) {
+    benchReceiver r;
+    memset(&r, 0, sizeof(r));
+    r.scenario = scenario;
+    if (scenario->kind == KIND_MESSAGES) {
+        r.latencies = (uint32_t *)malloc(scenario->messages * sizeof(uint32_t));
+        if (r.latencies == NULL)
+            return -1;
+    }
+
+    struct sockaddr_in address;
+    socklen_t address_len = sizeof(address);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0; // Any free port
+    r.socket = rudp_socket();
+    if (r.socket == -1 || bind(r.socket, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        getsockname(r.socket, (struct sockaddr *)&address, &address_len) == -1) {
+        perror("Bind failed");
+        free(r.latencies);
+        return -1;
+    }
+    pthread_t receiver;
+    if (pthread_create(&receiver, NULL, receiver_thread, &r) != 0) {
+        close(r.socket);
+        free(r.latencies);
+        return -1;
+    }
+
+    int sockfd = rudp_socket();
+    rudpConn *conn = rudpConn_alloc(sockfd, RUDP_DEFAULT_WINDOW);
+    double cpu_start = cpu_seconds();
+    double start = -1;
+    if (conn != NULL && rudpConn_set_engine(conn, bench_engine) == 0 && rudpConn_set_mtu(conn, scenario->mtu) == 0) {
+        if (scenario->kind == KIND_BULK) {
+            if (handshake_connect(conn, (struct sockaddr *)&address, address_len) == 1)
+                start = send_bulk(conn, scenario, pattern);
+        } else {
+            start = send_messages(conn, scenario, (struct sockaddr *)&address, address_len);
+        }
+    }
+    if (start < 0)
+        shutdown(r.socket, SHUT_RDWR); // The Receiver may wait for a Sender that's gone
+    pthread_join(receiver, NULL);
+    result->cpu_seconds = cpu_seconds() - cpu_start;
+    if (conn != NULL) {
+        rudpConn_cc_stats(conn, &result->stats);
+        result->mtu = rudpConn_mtu(conn);
+    }
+    rudpConn_free(conn);
+    close(sockfd);
+    close(r.socket);
+
+    int ok = start >= 0 && !r.failed && r.received == scenario->bytes;
+    if (ok) {
+        result->seconds = r.end - start;
+        qsort(r.latencies, r.latency_count, sizeof(uint32_t), compare_u32);
+        result->p50 = percentile(r.latencies, r.latency_count, 0.50);
+        result->p99 = percentile(r.latencies, r.latency_count, 0.99);
+        result->p999 = percentile(r.latencies, r.latency_count, 0.999);
+    }
+    free(r.latencies);
+    return ok ? 0 : -1;
+}
+
+// A latency of a message run, or null/empty for a bulk one
+static void print_latency(FILE *out, const benchScenario *scenario, double value, int json) {
+    if (scenario->kind == KIND_MESSAGES)
+        fprintf(out, "%.0f", value);
+    else if (json)
+        fprintf(out, "null");
+}
+
+static void print_result(FILE *out, const benchScenario *scenario, const benchResult *result, int json, int first) {
+    double goodput = scenario->bytes / MB / result->seconds;
+    double packets = result->stats.packets / result->seconds;
+    double cpu_per_gb = result->cpu_seconds / (scenario->bytes / GB);
+    double sent = result->stats.packets - result->stats.retransmits;
+    double retransmit_ratio = sent > 0 ? result->stats.retransmits / sent : 0;
+    if (json) {
+        fprintf(out, "%s    { \"name\": \"%s\", \"kind\": \"%s\", \"bytes\": %lu, \"message_size\": %u, \"messages\": %lu, "
+                "\"mtu\": %u, \"seconds\": %.6f, \"goodput_mb_s\": %.2f, \"packets_per_s\": %.0f, \"cpu_s_per_gb\": %.3f, "
+                "\"retransmit_ratio\": %.6f, \"latency_p50_us\": ", first ? "" : ",\n", scenario->name,
+                scenario->kind == KIND_BULK ? "bulk" : "messages", (unsigned long)scenario->bytes, scenario->message_size,
+                scenario->messages, result->mtu, result->seconds, goodput, packets, cpu_per_gb, retransmit_ratio);
+        print_latency(out, scenario, result->p50, json);
+        fprintf(out, ", \"latency_p99_us\": ");
+        print_latency(out, scenario, result->p99, json);
+        fprintf(out, ", \"latency_p999_us\": ");
+        print_latency(out, scenario, result->p999, json);
+        fprintf(out, " }");
+        return;
+    }
+    fprintf(out, "%s,%s,%lu,%u,%lu,%u,%.6f,%.2f,%.0f,%.3f,%.6f,", scenario->name, scenario->kind == KIND_BULK ? "bulk" : "messages",
+            (unsigned long)scenario->bytes, scenario->message_size, scenario->messages, result->mtu, result->seconds, goodput,
+            packets, cpu_per_gb, retransmit_ratio);
+    print_latency(out, scenario, result->p50, json);
+    fprintf(out, ",");
+    print_latency(out, scenario, result->p99, json);
+    fprintf(out, ",");
+    print_latency(out, scenario, result->p999, json);
+    fprintf(out, "\n");
+}
+
+int main(int argc, char *argv[]) {
+    int json = 1;
+    int quick = 0;
+    int verbose = 0;
+    const char *only = NULL; // Run the scenarios whose name starts with it
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-format") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "json") == 0 || strcmp(argv[i + 1], "csv") == 0)) {
+            json = strcmp(argv[++i], "json") == 0;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "-quick") == 0) {
+            quick = 1;
+        } else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "syscall") == 0 || strcmp(argv[i + 1], "uring") == 0)) {
+            bench_engine = strcmp(argv[++i], "uring") == 0 ? RUDP_ENGINE_URING : RUDP_ENGINE_SYSCALL;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else {
+            fprintf(stderr, "Please provide the correct usage for the program: %s [-format json|csv] [-o <FILE>] [-s <SCENARIO>] [-quick] [-engine syscall|uring] [-v]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The library reports only its errors, unless -v asks for its progress messages (they go to stderr)
+    rudp_log_set_level(verbose ? RUDP_LOG_INFO : RUDP_LOG_ERROR);
+    FILE *out = output != NULL ? fopen(output, "w") : stdout;
+    if (out == NULL) {
+        perror("Output open failed");
+        exit(EXIT_FAILURE);
+    }
+
+    char *pattern = (char *)malloc(PATTERN_SIZE);
+    if (pattern == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < PATTERN_SIZE; i++)
+        pattern[i] = (char)(i * 31);
+
+    if (json)
+        fprintf(out, "{\n  \"suite\": \"rudp-loopback\",\n  \"engine\": \"%s\",\n  \"scenarios\": [\n",
+                bench_engine == RUDP_ENGINE_URING ? "uring" : "syscall");
+    else
+        fprintf(out, "name,kind,bytes,message_size,messages,mtu,seconds,goodput_mb_s,packets_per_s,cpu_s_per_gb,"
+                     "retransmit_ratio,latency_p50_us,latency_p99_us,latency_p999_us\n");
+    int count = sizeof(scenarios) / sizeof(scenarios[0]);
+    int first = 1, failed = 0;
+    for (int i = 0; i < count; i++) {
+        const benchScenario *scenario = &scenarios[i];
+        if ((only != NULL && strncmp(scenario->name, only, strlen(only)) != 0) || (quick && scenario->kind == KIND_BULK && scenario->bytes > QUICK_MAX_BYTES))
+            continue;
+        fprintf(stderr, "Running %s...\n", scenario->name);
+        benchResult result;
+        memset(&result, 0, sizeof(result));
+        if (bench_run(scenario, pattern, &result) == -1) {
+            fprintf(stderr, "Scenario %s failed\n", scenario->name);
+            failed = 1;
+            continue;
+        }
+        print_result(out, scenario, &result, json, first);
+        first = 0;
+        fflush(out);
+    }
+    if (json)
+        fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    free(pattern);
+    return failed ? EXIT_FAILURE : 0;
+}
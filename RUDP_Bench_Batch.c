@@ -0,0 +1,131 @@
+#include "RUDP_API.h"
+#include <pthread.h>
+
+// Loopback benchmark of the batched I/O layer: the same transfer is sent with 1 datagram per system call
+// (sendto/recvfrom behaviour) and with growing sendmmsg/recvmmsg batches, and the packet rate of each run is compared.
+
+// The packets are sized to an Ethernet MTU, so the packet rate doesn't depend on the MTU loopback allows
+#define BENCH_MTU 1500
+#define BENCH_PAYLOAD (BENCH_MTU - 28 - 20) // IPv4, UDP and RUDP headers
+#define DEFAULT_SIZE (64 * 1024 * 1024)
+
+typedef struct _benchRun {
+    unsigned int batch;
+    int listeningSocket;
+    double seconds;
+    int received;
+} benchRun;
+
+// Monotonic time in seconds
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Receiver side of a run: accept the connection and read until the Sender closes it
+static void *receiver_thread(void *arg) {
+    benchRun *run = (benchRun *)arg;
+    char buffer[64 * 1024];
+
+    rudpConn *conn = rudpConn_alloc(run->listeningSocket, RUDP_DEFAULT_WINDOW);
+    if (conn == NULL || rudpConn_set_batch(conn, run->batch) == -1 || handshake_accept(conn) != 1) {
+        rudpConn_free(conn);
+        run->received = -1;
+        return NULL;
+    }
+    int bytes;
+    while ((bytes = rudp_receive(conn, buffer, sizeof(buffer))) > 0)
+        run->received += bytes;
+    if (bytes < 0)
+        run->received = -1;
+    rudpConn_free(conn);
+    return NULL;
+}
+
+// Transfer size bytes over loopback with the given batch size
+static int bench_run(benchRun *run, const char *data, int size) {
+    struct sockaddr_in address;
+    socklen_t address_len = sizeof(address);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0; // Any free port
+
+    run->listeningSocket = rudp_socket();
+    if (run->listeningSocket == -1)
+        return -1;
+    if (bind(run->listeningSocket, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        getsockname(run->listeningSocket, (struct sockaddr *)&address, &address_len) == -1) {
+        perror("Bind failed");
+        close(run->listeningSocket);
+        return -1;
+    }
+
+    pthread_t receiver;
+    if (pthread_create(&receiver, NULL, receiver_thread, run) != 0) {
+        close(run->listeningSocket);
+        return -1;
+    }
+
+    int sockfd = rudp_socket();
+    rudpConn *conn = rudpConn_alloc(sockfd, RUDP_DEFAULT_WINDOW);
+    int result = -1;
+    if (conn != NULL && rudpConn_set_batch(conn, run->batch) == 0 && rudpConn_set_mtu(conn, BENCH_MTU) == 0 &&
+        handshake_connect(conn, (struct sockaddr *)&address, address_len) == 1) {
+        double start = now_seconds();
+        if (rudp_send(conn, data, size) == size && rdup_close(conn) == 1) {
+            run->seconds = now_seconds() - start;
+            result = 0;
+        }
+    }
+    pthread_join(receiver, NULL);
+    rudpConn_free(conn);
+    close(sockfd);
+    close(run->listeningSocket);
+    return run->received == size ? result : -1;
+}
+
+int main(int argc, char *argv[]) {
+    int size = DEFAULT_SIZE;
+    if (argc == 3 && strcmp(argv[1], "-s") == 0)
+        size = atoi(argv[2]);
+    if (size <= 0) {
+        fprintf(stderr, "Please provide the correct usage for the program: %s [-s <BYTES>]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    char *data = (char *)malloc(size);
+    if (data == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < size; i++)
+        data[i] = (char)(i * 31);
+
+    unsigned int batches[] = { 1, 8, 32, RUDP_MAX_BATCH };
+    int runs = sizeof(batches) / sizeof(batches[0]);
+    benchRun results[sizeof(batches) / sizeof(batches[0])];
+    memset(results, 0, sizeof(results));
+
+    for (int i = 0; i < runs; i++) {
+        results[i].batch = batches[i];
+        if (bench_run(&results[i], data, size) == -1) {
+            fprintf(stderr, "Run with batch %u failed\n", batches[i]);
+            free(data);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double packets = (size + BENCH_PAYLOAD - 1) / BENCH_PAYLOAD;
+    printf("----------------------------------\n");
+    printf("- * Batched I/O benchmark (%d bytes, %.0f data packets) * -\n", size, packets);
+    for (int i = 0; i < runs; i++) {
+        printf("- Batch %2u: Time =%.2fms; Rate=%.0f packets/s; Speed=%.2fMB/s; Gain=%.2fx\n", results[i].batch,
+               results[i].seconds * 1000, packets / results[i].seconds, size / (1024.0 * 1024.0) / results[i].seconds,
+               results[0].seconds / results[i].seconds);
+    }
+    printf("----------------------------------\n");
+    free(data);
+    return 0;
+}
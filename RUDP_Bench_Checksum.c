@@ -0,0 +1,122 @@
+#include "RUDP_API.h"
+
+// Microbenchmark of the integrity kernels: the original 16-bit checksum loop, the scalar/SSE2/AVX2 one's complement
+// kernels with 64-bit accumulation, and CRC32C with a lookup table and with the SSE4.2 instruction, on 64B - 64KB buffers.
+
+#define MAX_SIZE (64 * 1024)
+#define BYTES_PER_RUN (256 * 1024 * 1024) // Bytes summed for every kernel and size
+
+typedef struct _benchKernel {
+    const char *name;
+    const char *feature; // Instruction set it needs, NULL for none
+    uint32_t (*run)(const void *data, size_t bytes);
+} benchKernel;
+
+// Monotonic time in seconds
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The checksum loop RUDP used before: 16-bit words into a 32-bit sum
+static uint32_t run_word16(const void *data, size_t bytes) {
+    const unsigned short int *data_pointer = (const unsigned short int *)data;
+    unsigned int total_sum = 0;
+    while (bytes > 1) {
+        total_sum += *data_pointer++;
+        bytes -= 2;
+    }
+    if (bytes > 0)
+        total_sum += *((const unsigned char *)data_pointer);
+    while (total_sum >> 16)
+        total_sum = (total_sum & 0xFFFF) + (total_sum >> 16);
+    return total_sum;
+}
+
+static uint32_t run_scalar(const void *data, size_t bytes) {
+    return csum_fold(csum_add_scalar(0, data, bytes));
+}
+
+static uint32_t run_sse2(const void *data, size_t bytes) {
+    return csum_fold(csum_add_sse2(0, data, bytes));
+}
+
+static uint32_t run_avx2(const void *data, size_t bytes) {
+    return csum_fold(csum_add_avx2(0, data, bytes));
+}
+
+static uint32_t run_crc32c_sw(const void *data, size_t bytes) {
+    return crc32c_sw(0, data, bytes);
+}
+
+static uint32_t run_crc32c_hw(const void *data, size_t bytes) {
+    return crc32c_hw(0, data, bytes);
+}
+
+int main() {
+    benchKernel kernels[] = {
+        { "word16", NULL, run_word16 },
+        { "scalar64", NULL, run_scalar },
+        { "sse2", "sse2", run_sse2 },
+        { "avx2", "avx2", run_avx2 },
+        { "crc32c-table", NULL, run_crc32c_sw },
+        { "crc32c-sse4.2", "sse4.2", run_crc32c_hw },
+    };
+    int count = sizeof(kernels) / sizeof(kernels[0]);
+    size_t sizes[] = { 64, 256, 1024, 2068, 4096, 16384, MAX_SIZE };
+    int size_count = sizeof(sizes) / sizeof(sizes[0]);
+
+    unsigned char *data = (unsigned char *)malloc(MAX_SIZE + 1);
+    if (data == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < MAX_SIZE + 1; i++)
+        data[i] = (unsigned char)(i * 131 + 7);
+
+    // Every one's complement kernel must agree with the original loop (an odd size checks the left-over byte)
+    for (int k = 1; k < 4; k++) {
+        if (kernels[k].feature != NULL && !csum_cpu_supports(kernels[k].feature))
+            continue;
+        for (size_t n = 0; n <= 200; n++) {
+            if (kernels[k].run(data + 1, n) != run_word16(data + 1, n)) {
+                fprintf(stderr, "Kernel %s gives a wrong sum for %zu bytes\n", kernels[k].name, n);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (crc32c_sw(0, "123456789", 9) != 0xE3069283 || crc32c_hw(0, "123456789", 9) != 0xE3069283) {
+        fprintf(stderr, "CRC32C check value is wrong\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("----------------------------------\n");
+    printf("- * Integrity kernels (GB/s), checksum uses %s, CRC32C %s * -\n", csum_kernel_name(),
+           crc32c_has_hw() ? "sse4.2" : "table");
+    printf("- %-14s", "Size");
+    for (int s = 0; s < size_count; s++)
+        printf("%9zu", sizes[s]);
+    printf("\n");
+    volatile uint32_t sink = 0; // Keeps the calls from being optimized away
+    for (int k = 0; k < count; k++) {
+        if (kernels[k].feature != NULL && !csum_cpu_supports(kernels[k].feature)) {
+            printf("- %-14s (not supported by this CPU)\n", kernels[k].name);
+            continue;
+        }
+        printf("- %-14s", kernels[k].name);
+        for (int s = 0; s < size_count; s++) {
+            long iterations = BYTES_PER_RUN / sizes[s];
+            double start = now_seconds();
+            for (long i = 0; i < iterations; i++)
+                sink += kernels[k].run(data, sizes[s]);
+            double seconds = now_seconds() - start;
+            printf("%9.2f", (double)iterations * sizes[s] / seconds / 1e9);
+        }
+        printf("\n");
+    }
+    printf("----------------------------------\n");
+    (void)sink;
+    free(data);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <string.h>
+#include "RUDP_CC.h"
+
+#define INITIAL_CWND 4
+#define MIN_CWND 2
+#define INITIAL_SSTHRESH 1e9
+
+// Delay-based controller: packets it keeps queued in the bottleneck
+#define DELAY_ALPHA 2
+#define DELAY_BETA 4
+
+// Pacing gain, above 1 so pacing itself never limits the growth of cwnd
+#define PACING_GAIN_SLOW_START 2.0
+#define PACING_GAIN 1.25
+
+static void cc_common_init(ccState *cc) {
+    cc->cwnd = INITIAL_CWND;
+    cc->ssthresh = INITIAL_SSTHRESH;
+    cc->min_rtt = 0;
+    cc->last_rtt = 0;
+    cc->pacing_rate = 0;
+    cc->losses = 0;
+    cc->timeouts = 0;
+}
+
+static void cc_track_rtt(ccState *cc, int64_t rtt) {
+    if (rtt <= 0)
+        return;
+    cc->last_rtt = rtt;
+    if (cc->min_rtt == 0 || rtt < cc->min_rtt)
+        cc->min_rtt = rtt;
+}
+
+// Multiplicative decrease, shared by both controllers
+static void cc_halve(ccState *cc) {
+    cc->losses++;
+    cc->ssthresh = cc->cwnd / 2 < MIN_CWND ? MIN_CWND : cc->cwnd / 2;
+    cc->cwnd = cc->ssthresh;
+}
+
+static void cc_restart(ccState *cc) {
+    cc->timeouts++;
+    cc->ssthresh = cc->cwnd / 2 < MIN_CWND ? MIN_CWND : cc->cwnd / 2;
+    cc->cwnd = 1;
+}
+
+// *** NewReno ***
+
+static void newreno_on_ack(ccState *cc, int64_t rtt) {
+    cc_track_rtt(cc, rtt);
+    if (cc->cwnd < cc->ssthresh)
+        cc->cwnd += 1; // Slow start: double every RTT
+    else
+        cc->cwnd += 1 / cc->cwnd; // Congestion avoidance: one more packet every RTT
+}
+
+const ccOps cc_newreno = {
+    .name = "newreno",
+    .init = cc_common_init,
+    .on_ack = newreno_on_ack,
+    .on_loss = cc_halve,
+    .on_timeout = cc_restart,
+};
+
+// *** Delay-based ***
+
+static void delay_on_ack(ccState *cc, int64_t rtt) {
+    cc_track_rtt(cc, rtt);
+    if (rtt <= 0 || cc->min_rtt == 0) {
+        if (cc->cwnd < cc->ssthresh)
+            cc->cwnd += 1;
+        return;
+    }
+    // Packets of this connection that wait in queues: cwnd * (1 - min_rtt / rtt)
+    double queued = cc->cwnd * (double)(rtt - cc->min_rtt) / (double)rtt;
+    if (cc->cwnd < cc->ssthresh) {
+        // Leave slow start as soon as a queue starts to build
+        if (queued > DELAY_ALPHA)
+            cc->ssthresh = cc->cwnd;
+        else
+            cc->cwnd += 1;
+        return;
+    }
+    if (queued < DELAY_ALPHA)
+        cc->cwnd += 1 / cc->cwnd;
+    else if (queued > DELAY_BETA && cc->cwnd - 1 / cc->cwnd >= MIN_CWND)
+        cc->cwnd -= 1 / cc->cwnd;
+}
+
+const ccOps cc_delay = {
+    .name = "delay",
+    .init = cc_common_init,
+    .on_ack = delay_on_ack,
+    .on_loss = cc_halve,
+    .on_timeout = cc_restart,
+};
+
+const ccOps *cc_find(const char *name) {
+    if (strcmp(name, cc_newreno.name) == 0)
+        return &cc_newreno;
+    if (strcmp(name, cc_delay.name) == 0)
+        return &cc_delay;
+    return NULL;
+}
+
+void cc_update_pacing(ccState *cc, int64_t srtt, unsigned int packet_size) {
+    if (srtt <= 0) {
+        cc->pacing_rate = 0;
+        return;
+    }
+    double gain = cc->cwnd < cc->ssthresh ? PACING_GAIN_SLOW_START : PACING_GAIN;
+    cc->pacing_rate = (uint64_t)(gain * cc->cwnd * packet_size * 1000000.0 / (double)srtt);
+}
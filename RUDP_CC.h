@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Congestion control state of a RUDP connection.
+ * cwnd and ssthresh are counted in packets, RTTs in microseconds and the pacing rate in bytes per second.
+ */
+typedef struct _ccState {
+    double cwnd; // Max packets in flight allowed by the controller
+    double ssthresh; // Slow start threshold
+    int64_t min_rtt; // Lowest RTT sample seen, the propagation delay estimate of delay-based controllers
+    int64_t last_rtt; // Last RTT sample
+    uint64_t pacing_rate; // 0 until the first RTT sample (no pacing)
+    unsigned long losses; // Loss events (at most one per window of data)
+    unsigned long timeouts; // Retransmission timeouts
+} ccState;
+
+/*
+ * A congestion controller: a set of callbacks that update the cwnd of a connection.
+ * New controllers are added by defining another ccOps and passing it to rudpConn_set_cc.
+ */
+typedef struct _ccOps {
+    const char *name;
+    void (*init)(ccState *cc);
+    // A new packet was acknowledged, rtt is its RTT sample or 0 if it was retransmitted (Karn's rule)
+    void (*on_ack)(ccState *cc, int64_t rtt);
+    // A packet was detected as lost by later ACKs, called once per window of data
+    void (*on_loss)(ccState *cc);
+    // The retransmission timer expired
+    void (*on_timeout)(ccState *cc);
+} ccOps;
+
+/*
+ * AIMD / NewReno: slow start, then +1 packet per RTT, halve on loss, restart from 1 packet on timeout.
+ */
+extern const ccOps cc_newreno;
+
+/*
+ * Delay-based (Vegas style): keeps between 2 and 4 packets queued in the path, based on the RTT above min_rtt.
+ */
+extern const ccOps cc_delay;
+
+/*
+ * Returns the controller with the given name ("newreno" or "delay"), or NULL.
+ */
+const ccOps *cc_find(const char *name);
+
+/*
+ * Recomputes the pacing rate from cwnd and the smoothed RTT, so cwnd packets are spread over one RTT.
+ */
+void cc_update_pacing(ccState *cc, int64_t srtt, unsigned int packet_size);
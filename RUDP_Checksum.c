@@ -0,0 +1,197 @@
+#include <string.h>
+#include "RUDP_Checksum.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CSUM_X86 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78 // Castagnoli polynomial, reflected
+
+static uint32_t crc32c_table[256];
+
+// Kernels picked at startup by checksum_init
+static uint64_t (*csum_kernel)(uint64_t sum, const void *data, size_t bytes) = csum_add_scalar;
+static uint32_t (*crc32c_kernel)(uint32_t crc, const void *data, size_t bytes) = crc32c_sw;
+static const char *csum_kernel_label = "scalar";
+
+int csum_cpu_supports(const char *feature) {
+#ifdef CSUM_X86
+    // __builtin_cpu_supports only takes string literals
+    if (strcmp(feature, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+    if (strcmp(feature, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(feature, "sse4.2") == 0)
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    (void)feature;
+    return 0;
+}
+
+__attribute__((constructor)) static void checksum_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_table[i] = crc;
+    }
+#ifdef CSUM_X86
+    __builtin_cpu_init();
+    if (csum_cpu_supports("avx2")) {
+        csum_kernel = csum_add_avx2;
+        csum_kernel_label = "avx2";
+    } else if (csum_cpu_supports("sse2")) {
+        csum_kernel = csum_add_sse2;
+        csum_kernel_label = "sse2";
+    }
+    if (csum_cpu_supports("sse4.2"))
+        crc32c_kernel = crc32c_hw;
+#endif
+}
+
+// *** One's complement checksum ***
+
+uint64_t csum_add_scalar(uint64_t sum, const void *data, size_t bytes) {
+    const unsigned char *p = (const unsigned char *)data;
+
+    // 32-bit words, the carries collect in the upper half of the accumulator and are folded at the end
+    while (bytes >= 4) {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+        p += 4;
+        bytes -= 4;
+    }
+    if (bytes >= 2) {
+        uint16_t word;
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+        p += 2;
+        bytes -= 2;
+    }
+    // A left-over byte is the first byte of a word padded with zero
+    if (bytes > 0) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        sum += (uint64_t)*p << 8;
+#else
+        sum += *p;
+#endif
+    }
+    return sum;
+}
+
+#ifdef CSUM_X86
+
+// 16 bytes at a time: the four 32-bit words of a vector are widened to 64 bits and added to two accumulators
+__attribute__((target("sse2"))) uint64_t csum_add_sse2(uint64_t sum, const void *data, size_t bytes) {
+    const unsigned char *p = (const unsigned char *)data;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero;
+
+    while (bytes >= 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+        p += 32;
+        bytes -= 32;
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+    return csum_add_scalar(sum + lanes[0] + lanes[1], p, bytes);
+}
+
+// 32 bytes at a time, as the SSE2 kernel with 256-bit vectors
+__attribute__((target("avx2"))) uint64_t csum_add_avx2(uint64_t sum, const void *data, size_t bytes) {
+    const unsigned char *p = (const unsigned char *)data;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero;
+
+    while (bytes >= 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)p);
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+        p += 64;
+        bytes -= 64;
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+    return csum_add_sse2(sum + lanes[0] + lanes[1] + lanes[2] + lanes[3], p, bytes);
+}
+
+#else
+
+uint64_t csum_add_sse2(uint64_t sum, const void *data, size_t bytes) {
+    return csum_add_scalar(sum, data, bytes);
+}
+
+uint64_t csum_add_avx2(uint64_t sum, const void *data, size_t bytes) {
+    return csum_add_scalar(sum, data, bytes);
+}
+
+#endif
+
+uint64_t csum_add(uint64_t sum, const void *data, size_t bytes) {
+    return csum_kernel(sum, data, bytes);
+}
+
+uint16_t csum_fold(uint64_t sum) {
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+const char *csum_kernel_name() {
+    return csum_kernel_label;
+}
+
+// *** CRC32C ***
+
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t bytes) {
+    const unsigned char *p = (const unsigned char *)data;
+    crc = ~crc;
+    while (bytes--)
+        crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#ifdef CSUM_X86
+
+// The crc32 instruction, 8 bytes at a time
+__attribute__((target("sse4.2"))) uint32_t crc32c_hw(uint32_t crc, const void *data, size_t bytes) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t c = ~crc;
+    while (bytes >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        bytes -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (bytes--)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return ~c32;
+}
+
+#else
+
+uint32_t crc32c_hw(uint32_t crc, const void *data, size_t bytes) {
+    return crc32c_sw(crc, data, bytes);
+}
+
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t bytes) {
+    return crc32c_kernel(crc, data, bytes);
+}
+
+int crc32c_has_hw() {
+    return crc32c_kernel != crc32c_sw;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Integrity kernels of RUDP packets: the Internet one's complement checksum (RFC 1071) and CRC32C.
+ * The fastest implementation the CPU supports is picked at startup (AVX2, SSE2 or scalar for the checksum,
+ * SSE4.2 or a lookup table for CRC32C), the others are exported for benchmarks.
+ */
+
+/*
+ * Adds bytes of data to a one's complement sum, and returns the new sum (not folded yet, start with 0).
+ * A buffer may be summed in parts, as long as every part but the last one has an even size.
+ * Words are accumulated in 64 bits, so the sum of any buffer never overflows.
+ */
+uint64_t csum_add(uint64_t sum, const void *data, size_t bytes);
+
+uint64_t csum_add_scalar(uint64_t sum, const void *data, size_t bytes);
+
+uint64_t csum_add_sse2(uint64_t sum, const void *data, size_t bytes);
+
+uint64_t csum_add_avx2(uint64_t sum, const void *data, size_t bytes);
+
+/*
+ * Folds a sum to 16 bits, the checksum is its complement.
+ */
+uint16_t csum_fold(uint64_t sum);
+
+/*
+ * Returns the name of the one's complement kernel csum_add uses ("avx2", "sse2" or "scalar").
+ */
+const char *csum_kernel_name();
+
+/*
+ * CRC32C (Castagnoli) of bytes of data, continuing from crc (0 for a new buffer):
+ * crc32c(crc32c(0, a), b) is the CRC32C of a followed by b.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t bytes);
+
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t bytes);
+
+uint32_t crc32c_hw(uint32_t crc, const void *data, size_t bytes);
+
+/*
+ * Returns 1 if the CPU computes CRC32C in hardware (SSE4.2), 0 if crc32c uses the lookup table.
+ */
+int crc32c_has_hw();
+
+/*
+ * Returns 1 if the CPU supports the given instruction set ("sse2", "avx2", "sse4.2").
+ */
+int csum_cpu_supports(const char *feature);
@@ -0,0 +1,168 @@
+#include <string.h>
+#include "RUDP_FEC.h"
+#include "RUDP_Checksum.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FEC_X86 1
+#endif
+
+#define GF_POLY 0x11D // x^8 + x^4 + x^3 + x^2 + 1, 2 generates the multiplicative group
+
+static uint8_t gf_exp[512]; // Twice the period, so gf_exp[log a + log b] needs no modulo
+static uint8_t gf_log[256];
+static uint8_t gf_mul_table[256][256];
+
+// Kernel picked at startup by fec_init
+static void (*fec_kernel)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes) = fec_mul_add_scalar;
+static const char *fec_kernel_label = "scalar";
+
+__attribute__((constructor)) static void fec_init() {
+    unsigned int x = 1;
+    for (int i = 0; i < 255; i++) {
+        gf_exp[i] = gf_exp[i + 255] = (uint8_t)x;
+        gf_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100)
+            x ^= GF_POLY;
+    }
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < 256; b++)
+            gf_mul_table[a][b] = a == 0 || b == 0 ? 0 : gf_exp[gf_log[a] + gf_log[b]];
+    }
+#ifdef FEC_X86
+    __builtin_cpu_init(); // The constructors of other files may not have run yet
+    if (csum_cpu_supports("avx2")) {
+        fec_kernel = fec_mul_add_avx2;
+        fec_kernel_label = "avx2";
+    }
+#endif
+}
+
+uint8_t gf_mul(uint8_t a, uint8_t b) {
+    return gf_mul_table[a][b];
+}
+
+uint8_t gf_inv(uint8_t a) {
+    return a == 0 ? 0 : gf_exp[255 - gf_log[a]];
+}
+
+uint8_t fec_coef(int mode, unsigned int row, unsigned int index) {
+    if (mode == RUDP_FEC_XOR)
+        return 1;
+    // Cauchy matrix 1 / (x_row + y_index), with x_row = RUDP_FEC_MAX_BLOCK + row and y_index = index: the two sets
+    // never meet, so the sum is never 0. Its columns are scaled so that row 0 is all ones, a plain XOR (scaling keeps
+    // every square part invertible).
+    uint8_t x0 = (uint8_t)(RUDP_FEC_MAX_BLOCK ^ index);
+    return gf_mul(gf_inv((uint8_t)((RUDP_FEC_MAX_BLOCK + row) ^ index)), x0);
+}
+
+void fec_mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes) {
+    if (c == 0)
+        return;
+    size_t i = 0;
+    if (c == 1) {
+        // A plain XOR, 8 bytes at a time
+        for (; i + 8 <= bytes; i += 8) {
+            uint64_t a, b;
+            memcpy(&a, dst + i, sizeof(a));
+            memcpy(&b, src + i, sizeof(b));
+            a ^= b;
+            memcpy(dst + i, &a, sizeof(a));
+        }
+        for (; i < bytes; i++)
+            dst[i] ^= src[i];
+        return;
+    }
+    const uint8_t *product = gf_mul_table[c];
+    for (; i < bytes; i++)
+        dst[i] ^= product[src[i]];
+}
+
+#ifdef FEC_X86
+
+// 32 bytes at a time: c * b is c * (high nibble << 4) ^ c * (low nibble), both looked up in 16-entry tables by vpshufb
+__attribute__((target("avx2"))) void fec_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes) {
+    if (c == 0)
+        return;
+    uint8_t low[16], high[16];
+    for (int n = 0; n < 16; n++) {
+        low[n] = gf_mul_table[c][n];
+        high[n] = gf_mul_table[c][n << 4];
+    }
+    const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)high));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low_table, _mm256_and_si256(v, mask)),
+                                           _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi64(v, 4), mask)));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, product));
+    }
+    fec_mul_add_scalar(dst + i, src + i, c, bytes - i);
+}
+
+#else
+
+void fec_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes) {
+    fec_mul_add_scalar(dst, src, c, bytes);
+}
+
+#endif
+
+void fec_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes) {
+    fec_kernel(dst, src, c, bytes);
+}
+
+const char *fec_kernel_name() {
+    return fec_kernel_label;
+}
+
+int fec_invert(int mode, const unsigned int *rows, const unsigned int *indexes, unsigned int e, uint8_t *inverse) {
+    uint8_t m[RUDP_FEC_MAX_PARITY][RUDP_FEC_MAX_PARITY];
+    if (e == 0 || e > RUDP_FEC_MAX_PARITY)
+        return -1;
+    for (unsigned int r = 0; r < e; r++) {
+        for (unsigned int c = 0; c < e; c++) {
+            m[r][c] = fec_coef(mode, rows[r], indexes[c]);
+            inverse[r * e + c] = r == c;
+        }
+    }
+
+    // Gauss-Jordan elimination, the same row operations turn the identity into the inverse
+    for (unsigned int col = 0; col < e; col++) {
+        unsigned int pivot = col;
+        while (pivot < e && m[pivot][col] == 0)
+            pivot++;
+        if (pivot == e)
+            return -1;
+        if (pivot != col) {
+            for (unsigned int c = 0; c < e; c++) {
+                uint8_t t = m[col][c];
+                m[col][c] = m[pivot][c];
+                m[pivot][c] = t;
+                t = inverse[col * e + c];
+                inverse[col * e + c] = inverse[pivot * e + c];
+                inverse[pivot * e + c] = t;
+            }
+        }
+        uint8_t scale = gf_inv(m[col][col]);
+        for (unsigned int c = 0; c < e; c++) {
+            m[col][c] = gf_mul(m[col][c], scale);
+            inverse[col * e + c] = gf_mul(inverse[col * e + c], scale);
+        }
+        for (unsigned int r = 0; r < e; r++) {
+            uint8_t factor = m[r][col];
+            if (r == col || factor == 0)
+                continue;
+            for (unsigned int c = 0; c < e; c++) {
+                m[r][c] ^= gf_mul(factor, m[col][c]);
+                inverse[r * e + c] ^= gf_mul(factor, inverse[col * e + c]);
+            }
+        }
+    }
+    return 0;
+}
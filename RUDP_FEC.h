@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Erasure codes of RUDP's forward error correction (see rudpConn_set_fec): a block of up to RUDP_FEC_MAX_BLOCK data
+ * packets is followed by parity packets, every one of them a linear combination of the data packets over GF(2^8):
+ *   parity[row] = sum over index of fec_coef(mode, row, index) * data[index]
+ * Packets are summed as byte strings, a shorter one is padded with zeros (addition in GF(2^8) is XOR).
+ * XOR has a single parity packet, the plain XOR of the block, and rebuilds one lost packet. Reed-Solomon uses the rows
+ * of a Cauchy matrix, so any square part of it is invertible: any e lost packets are rebuilt from any e parity packets.
+ * Its first row is the XOR of the block, the cheapest one to compute.
+ */
+
+#define RUDP_FEC_OFF 0
+#define RUDP_FEC_XOR 1
+#define RUDP_FEC_RS 2
+
+#define RUDP_FEC_MAX_BLOCK 64 // Data packets in a block
+#define RUDP_FEC_MAX_PARITY 8 // Parity packets of a block with Reed-Solomon
+
+/*
+ * Coefficient of data packet index in parity packet row.
+ */
+uint8_t fec_coef(int mode, unsigned int row, unsigned int index);
+
+/*
+ * Multiplication and inverse in GF(2^8) (polynomial x^8 + x^4 + x^3 + x^2 + 1), gf_inv(0) is 0.
+ */
+uint8_t gf_mul(uint8_t a, uint8_t b);
+
+uint8_t gf_inv(uint8_t a);
+
+/*
+ * Adds c times bytes of src to dst (dst[i] ^= c * src[i]), with the fastest kernel the CPU supports (AVX2 shuffles
+ * of 4-bit product tables, or a product table lookup per byte). The others are exported for benchmarks.
+ */
+void fec_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes);
+
+void fec_mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes);
+
+void fec_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t bytes);
+
+/*
+ * Returns the name of the kernel fec_mul_add uses ("avx2" or "scalar").
+ */
+const char *fec_kernel_name();
+
+/*
+ * Inverts the e x e matrix of the coefficients of the parity packets rows[] (its rows) for the data packets indexes[]
+ * (its columns), e is at most RUDP_FEC_MAX_PARITY. The inverse is stored row by row: the lost packet indexes[c] is
+ * the sum over r of inverse[c * e + r] times what parity packet rows[r] holds of the lost packets.
+ * Returns 0, or -1 if the matrix is singular (XOR with more than one lost packet).
+ */
+int fec_invert(int mode, const unsigned int *rows, const unsigned int *indexes, unsigned int e, uint8_t *inverse);
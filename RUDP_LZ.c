@@ -0,0 +1,177 @@
+#include <string.h>
+#include "RUDP_LZ.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 // The last bytes of the input are literals, and no match starts in the last MATCH_LIMIT bytes
+#define MATCH_LIMIT 12
+#define HASH_BITS 12 // Entries of the hash table of 4-byte sequences, 8KB on the stack
+#define SKIP_SHIFT 6 // After 64 positions without a match the step grows by one, and so on
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned int lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// Length of the match of in + ip with in + ref, that are known to match for MIN_MATCH bytes, up to the last literals
+static size_t match_length(const uint8_t *in, size_t ip, size_t ref, size_t len) {
+    size_t match = MIN_MATCH;
+    size_t limit = len - LAST_LITERALS - ip;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // 8 bytes at a time: the first differing byte is the lowest set byte of the XOR
+    while (match + 8 <= limit) {
+        uint64_t a, b;
+        memcpy(&a, in + ip + match, sizeof(a));
+        memcpy(&b, in + ref + match, sizeof(b));
+        if (a != b)
+            return match + (__builtin_ctzll(a ^ b) >> 3);
+        match += 8;
+    }
+#endif
+    while (match < limit && in[ip + match] == in[ref + match])
+        match++;
+    return match;
+}
+
+// Write the rest of a length of 15 or more past its token: bytes of 255, then what's left. NULL if it's past end.
+static uint8_t *put_length(uint8_t *op, const uint8_t *end, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (op >= end)
+            return NULL;
+        *op++ = 255;
+    }
+    if (op >= end)
+        return NULL;
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// Write a sequence: lit_len literals, then a match of match_len bytes at offset (none if match_len is 0).
+// Returns the output past it, NULL if it's past end.
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *end, const uint8_t *literals, size_t lit_len, size_t offset,
+                             size_t match_len) {
+    if (op >= end)
+        return NULL;
+    uint8_t *token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15 && (op = put_length(op, end, lit_len - 15)) == NULL)
+        return NULL;
+    if ((size_t)(end - op) < lit_len)
+        return NULL;
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+    if (match_len == 0)
+        return op;
+    if (end - op < 2)
+        return NULL;
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    size_t rest = match_len - MIN_MATCH;
+    *token |= rest >= 15 ? 15 : rest;
+    if (rest >= 15 && (op = put_length(op, end, rest - 15)) == NULL)
+        return NULL;
+    return op;
+}
+
+size_t rudp_lz_compress(const void *src, size_t len, void *dst, size_t capacity) {
+    const uint8_t *in = (const uint8_t *)src;
+    uint8_t *out = (uint8_t *)dst;
+    const uint8_t *end = out + capacity;
+    uint8_t *op = out;
+    size_t anchor = 0; // The literals not written yet start there
+    if (len > RUDP_LZ_MAX_INPUT)
+        return 0;
+
+    if (len > MATCH_LIMIT) {
+        uint16_t table[1 << HASH_BITS]; // Last position of every hash, positions of a chunk fit in 16 bits
+        memset(table, 0, sizeof(table));
+        size_t limit = len - MATCH_LIMIT;
+        size_t ip = 0;
+        unsigned int misses = 0;
+        while (ip < limit) {
+            uint32_t sequence = read32(in + ip);
+            unsigned int h = lz_hash(sequence);
+            size_t ref = table[h];
+            table[h] = (uint16_t)ip;
+            if (ref >= ip || read32(in + ref) != sequence) {
+                ip += 1 + (misses++ >> SKIP_SHIFT);
+                continue;
+            }
+            misses = 0;
+            // The match may start before the sequence that found it
+            while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t match = match_length(in, ip, ref, len);
+            op = put_sequence(op, end, in + anchor, ip - anchor, ip - ref, match);
+            if (op == NULL)
+                return 0;
+            ip += match;
+            anchor = ip;
+            if (ip < limit)
+                table[lz_hash(read32(in + ip - 2))] = (uint16_t)(ip - 2);
+        }
+    }
+    op = put_sequence(op, end, in + anchor, len - anchor, 0, 0);
+    return op == NULL ? 0 : (size_t)(op - out);
+}
+
+// Read the rest of a length of 15 or more past its token, returns -1 if the input ends before it does
+static int get_length(const uint8_t **ip, const uint8_t *end, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= end)
+            return -1;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+int rudp_lz_decompress(const void *src, size_t len, void *dst, size_t size) {
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *in_end = ip + len;
+    uint8_t *out = (uint8_t *)dst;
+    uint8_t *op = out;
+    const uint8_t *out_end = out + size;
+    while (ip < in_end) {
+        unsigned int token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && get_length(&ip, in_end, &literals) == -1)
+            return -1;
+        if ((size_t)(in_end - ip) < literals || (size_t)(out_end - op) < literals)
+            return -1;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == in_end)
+            break; // The last sequence has no match
+        if (in_end - ip < 2)
+            return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out))
+            return -1;
+        size_t match = token & 15;
+        if (match == 15 && get_length(&ip, in_end, &match) == -1)
+            return -1;
+        match += MIN_MATCH;
+        if ((size_t)(out_end - op) < match)
+            return -1;
+        const uint8_t *ref = op - offset;
+        if (offset >= match) {
+            memcpy(op, ref, match);
+            op += match;
+        } else {
+            // The match overlaps the bytes it writes (a repeated pattern)
+            while (match-- > 0)
+                *op++ = *ref++;
+        }
+    }
+    return op == out_end ? 0 : -1;
+}
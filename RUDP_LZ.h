@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A fast LZ77 codec for the compressed chunks of sessions (see RUDP_Session.h), in the LZ4 block format: sequences of
+ * a token (literal length in the high 4 bits, match length - 4 in the low 4 bits, 15 meaning more length bytes follow,
+ * each adding up to 255), the literals, and a match of 4 bytes or more at a 16-bit little-endian offset back in the
+ * output. The last sequence has literals only. Matches are found with a hash table of 4-byte sequences, and a run
+ * that finds none is crossed with growing steps, so incompressible data costs little.
+ */
+
+#define RUDP_LZ_MAX_INPUT (64 * 1024) // Offsets are 16-bit, a chunk is compressed on its own
+
+/*
+ * Compresses len bytes of src (RUDP_LZ_MAX_INPUT at most) to dst, giving up as soon as the output would go past
+ * capacity bytes. Returns the size of the compressed data, 0 if it doesn't fit in capacity (the data doesn't compress).
+ */
+size_t rudp_lz_compress(const void *src, size_t len, void *dst, size_t capacity);
+
+/*
+ * Decompresses len bytes of src to dst, that must be exactly size bytes long once decompressed. Every length and
+ * offset is checked, so malformed data never reads or writes out of the buffers.
+ * Returns 0, or -1 if the data is malformed.
+ */
+int rudp_lz_decompress(const void *src, size_t len, void *dst, size_t size);
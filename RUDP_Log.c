@@ -0,0 +1,97 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "RUDP_Log.h"
+
+#define LOG_BUFFER_SIZE 16384
+#define LOG_LINE_SIZE 512 // Longer messages are cut
+
+int rudp_log_level = RUDP_LOG_INFO;
+
+static const char *level_names[] = { "off", "error", "warn", "info", "debug" };
+
+// Messages not written yet, the threads of a process share them (a Receiver thread and a Sender may log together)
+static char log_buffer[LOG_BUFFER_SIZE];
+static size_t log_used;
+static int log_fd = STDERR_FILENO;
+static int log_registered; // rudp_log_flush runs at exit
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Write the buffer, with log_lock held
+static void log_drain() {
+    size_t done = 0;
+    while (done < log_used) {
+        ssize_t n = write(log_fd, log_buffer + done, log_used - done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // Nowhere to report it, the messages are dropped
+        done += n;
+    }
+    log_used = 0;
+}
+
+void rudp_log_set_level(int level) {
+    if (level < RUDP_LOG_OFF)
+        level = RUDP_LOG_OFF;
+    if (level > RUDP_LOG_DEBUG)
+        level = RUDP_LOG_DEBUG;
+    rudp_log_level = level;
+}
+
+int rudp_log_parse_level(const char *name) {
+    for (int level = RUDP_LOG_OFF; level <= RUDP_LOG_DEBUG; level++) {
+        if (strcmp(name, level_names[level]) == 0)
+            return level;
+    }
+    return -1;
+}
+
+void rudp_log_set_output(int fd) {
+    pthread_mutex_lock(&log_lock);
+    log_drain();
+    log_fd = fd;
+    pthread_mutex_unlock(&log_lock);
+}
+
+void rudp_log_flush() {
+    pthread_mutex_lock(&log_lock);
+    log_drain();
+    pthread_mutex_unlock(&log_lock);
+}
+
+void rudp_log_write(int level, int with_errno, const char *format, ...) {
+    int error = errno; // Before anything below changes it
+    char line[LOG_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n < 0)
+        return;
+    if ((size_t)n >= sizeof(line))
+        n = sizeof(line) - 1;
+    if (with_errno)
+        n += snprintf(line + n, sizeof(line) - n, ": %s", strerror(error));
+    if ((size_t)n >= sizeof(line) - 1)
+        n = sizeof(line) - 2;
+    line[n++] = '\n';
+
+    pthread_mutex_lock(&log_lock);
+    if (!log_registered) {
+        log_registered = 1;
+        atexit(rudp_log_flush);
+    }
+    if (log_used + n > LOG_BUFFER_SIZE)
+        log_drain();
+    memcpy(log_buffer + log_used, line, n);
+    log_used += n;
+    if (level <= RUDP_LOG_INFO)
+        log_drain();
+    pthread_mutex_unlock(&log_lock);
+    errno = error;
+}
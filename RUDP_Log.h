@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * Leveled logging of the library. A message above the current level costs one comparison of an integer and its
+ * arguments aren't evaluated, and levels above RUDP_LOG_MAX_LEVEL aren't compiled in at all
+ * (e.g. -DRUDP_LOG_MAX_LEVEL=RUDP_LOG_WARN drops the debug and info messages from the build).
+ * Messages are collected in a buffer and written with one write call: at once for info and more severe levels,
+ * and when the buffer is full, on rudp_log_flush or at exit for debug messages (the ones of the hot path).
+ */
+
+#define RUDP_LOG_OFF 0
+#define RUDP_LOG_ERROR 1
+#define RUDP_LOG_WARN 2
+#define RUDP_LOG_INFO 3 // Handshakes and closes (the default)
+#define RUDP_LOG_DEBUG 4 // Every retransmission and dropped packet
+
+#ifndef RUDP_LOG_MAX_LEVEL
+#define RUDP_LOG_MAX_LEVEL RUDP_LOG_DEBUG
+#endif
+
+extern int rudp_log_level;
+
+// Log a message (printf format, the line break is added)
+#define RUDP_LOG(level, ...)                                                \
+    do {                                                                    \
+        if ((level) <= RUDP_LOG_MAX_LEVEL && (level) <= rudp_log_level)     \
+            rudp_log_write((level), 0, __VA_ARGS__);                        \
+    } while (0)
+
+// Log a message followed by the description of errno, as perror does
+#define RUDP_LOG_ERRNO(level, ...)                                          \
+    do {                                                                    \
+        if ((level) <= RUDP_LOG_MAX_LEVEL && (level) <= rudp_log_level)     \
+            rudp_log_write((level), 1, __VA_ARGS__);                        \
+    } while (0)
+
+/*
+ * Sets the most verbose level that is logged, RUDP_LOG_OFF turns logging off.
+ */
+void rudp_log_set_level(int level);
+
+/*
+ * Returns the level named name ("off", "error", "warn", "info" or "debug"), or -1 if there's none.
+ */
+int rudp_log_parse_level(const char *name);
+
+/*
+ * Sets the file descriptor the messages are written to (stderr by default), the buffered ones are written first.
+ */
+void rudp_log_set_output(int fd);
+
+/*
+ * Writes the buffered messages.
+ */
+void rudp_log_flush();
+
+void rudp_log_write(int level, int with_errno, const char *format, ...) __attribute__((format(printf, 3, 4)));
@@ -0,0 +1,521 @@
+#define _GNU_SOURCE // ppoll
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// A user-space network emulator: it sits between RUDP_Sender and RUDP_Receiver on localhost, and every datagram it
+// forwards may be lost (at random, or in bursts), delayed with jitter, reordered, duplicated, corrupted, or queued
+// behind a bandwidth limit. It logs what it did to every packet it touched, and prints its statistics when it stops.
+//   ./RUDP_Sender -ip 127.0.0.1 -p 12346 ... -> ./RUDP_Proxy -p 12346 -dp 12345 -loss 0.02 ... -> ./RUDP_Receiver -p 12345
+
+#define MAX_DATAGRAM 65536
+#define MAX_FLOWS 64 // Senders served at the same time, every one of them gets its own socket to the Receiver
+#define MAX_QUEUED 65536 // Datagrams held at the same time (delayed or queued behind the bandwidth limit)
+#define DEFAULT_QUEUE_KB 1024 // Bytes queued behind the bandwidth limit before it drops datagrams (tail drop)
+#define DEFAULT_REORDER_MS 1.0 // Extra delay of a reordered datagram
+
+// Directions: from the Sender to the Receiver (data) and back (ACKs)
+#define FWD 0
+#define REV 1
+
+// Fields of the RUDP header that the log shows (see RUDP_API.c): the flag (byte 1) and the sequence number (bytes 8-11)
+#define RUDP_FLAG_OFFSET 1
+#define RUDP_SEQ_OFFSET 8
+
+// What the proxy does to the datagrams of one direction
+typedef struct _impairment {
+    double loss; // Loss rate
+    double burst; // Mean length of a burst of losses, 1 loses datagrams independently
+    double delay_us;
+    double jitter_us; // Uniform in [-jitter, +jitter] around the delay, a later datagram may overtake an earlier one
+    double reorder; // Probability to hold a datagram reorder_us longer, so the ones after it overtake it
+    double reorder_us;
+    double dup; // Probability to send a datagram twice
+    double corrupt; // Probability to flip a bit of a datagram
+    double rate; // Bandwidth limit in bytes per microsecond, 0 for none
+    double queue_us; // Time the bandwidth limit may queue datagrams for, the ones after it are dropped
+} impairment;
+
+// Counters of one direction
+typedef struct _proxyStats {
+    unsigned long packets; // Received
+    unsigned long forwarded; // Sent, duplicates included
+    unsigned long lost;
+    unsigned long burst_lost; // Lost in a burst (after the first loss of the burst)
+    unsigned long queue_drops;
+    unsigned long duplicated;
+    unsigned long corrupted;
+    unsigned long reordered;
+    unsigned long bytes;
+} proxyStats;
+
+// A datagram held until its time comes
+typedef struct _held {
+    uint64_t at; // Monotonic microseconds
+    uint64_t order; // Datagrams due at the same time go out in the order they arrived
+    int flow;
+    int dir;
+    size_t len;
+    unsigned char data[];
+} held;
+
+// A Sender: its address and the socket the proxy talks to the Receiver with on its behalf
+typedef struct _flow {
+    struct sockaddr_in client;
+    int sock;
+} flow;
+
+static volatile sig_atomic_t stop = 0;
+static uint64_t rng_state;
+static held *heap[MAX_QUEUED]; // Min-heap by (at, order)
+static unsigned int heap_count = 0;
+static uint64_t held_order = 0;
+static FILE *log_file = NULL;
+static uint64_t start_us;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// xorshift64*, seeded from the command line so a run can be reproduced
+static uint64_t rng_next() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [0, 1)
+static double rng_uniform() {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int heap_before(const held *a, const held *b) {
+    return a->at < b->at || (a->at == b->at && a->order < b->order);
+}
+
+static void heap_push(held *h) {
+    unsigned int i = heap_count++;
+    while (i > 0 && heap_before(h, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = h;
+}
+
+static held *heap_pop() {
+    held *top = heap[0];
+    held *last = heap[--heap_count];
+    unsigned int i = 0;
+    while (1) {
+        unsigned int child = 2 * i + 1;
+        if (child >= heap_count)
+            break;
+        if (child + 1 < heap_count && heap_before(heap[child + 1], heap[child]))
+            child++;
+        if (!heap_before(heap[child], last))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heap_count > 0)
+        heap[i] = last;
+    return top;
+}
+
+// One line per event: time since the start (ms), direction, event, and the RUDP packet it happened to
+static void log_event(int dir, const char *event, const unsigned char *data, size_t len, const char *detail) {
+    if (log_file == NULL)
+        return;
+    char flag = len > RUDP_FLAG_OFFSET ? (char)data[RUDP_FLAG_OFFSET] : '?';
+    uint32_t seq = 0;
+    if (len >= RUDP_SEQ_OFFSET + 4)
+        seq = (uint32_t)data[RUDP_SEQ_OFFSET] << 24 | (uint32_t)data[RUDP_SEQ_OFFSET + 1] << 16 |
+              (uint32_t)data[RUDP_SEQ_OFFSET + 2] << 8 | data[RUDP_SEQ_OFFSET + 3];
+    fprintf(log_file, "%.3f %s %s flag=%c seq=%u len=%zu%s%s\n", (now_us() - start_us) / 1000.0, dir == FWD ? "fwd" : "rev",
+            event, flag >= 32 && flag < 127 ? flag : '?', seq, len, detail != NULL ? " " : "", detail != NULL ? detail : "");
+}
+
+// Gilbert-Elliott loss: the link is good or in a burst of losses. It enters a burst at a rate that gives the loss rate
+// on average, and leaves it after burst datagrams on average. Returns 1 if the datagram is lost.
+static int lose(const impairment *imp, int *in_burst, proxyStats *stats) {
+    if (imp->loss <= 0)
+        return 0;
+    if (imp->burst <= 1 || imp->loss >= 1) {
+        if (rng_uniform() >= imp->loss)
+            return 0;
+        stats->lost++;
+        return 1;
+    }
+    if (*in_burst) {
+        if (rng_uniform() < 1.0 / imp->burst) {
+            *in_burst = 0;
+            return 0;
+        }
+        stats->lost++;
+        stats->burst_lost++;
+        return 1;
+    }
+    if (rng_uniform() < imp->loss / (imp->burst * (1 - imp->loss))) {
+        *in_burst = 1;
+        stats->lost++;
+        return 1;
+    }
+    return 0;
+}
+
+// Hold a copy of a datagram until at. Returns -1 if too many datagrams are held (it's dropped).
+static int hold(int flow, int dir, const unsigned char *data, size_t len, uint64_t at) {
+    if (heap_count == MAX_QUEUED)
+        return -1;
+    held *h = (held *)malloc(sizeof(held) + len);
+    if (h == NULL)
+        return -1;
+    h->at = at;
+    h->order = held_order++;
+    h->flow = flow;
+    h->dir = dir;
+    h->len = len;
+    memcpy(h->data, data, len);
+    heap_push(h);
+    return 0;
+}
+
+// Apply the impairments to a datagram that arrived: drop it, or hold it (and maybe a duplicate) until it's due.
+// link_free is when the bandwidth limited link of its direction is done sending the datagrams before it.
+static void impair(const impairment *imp, int flow, int dir, unsigned char *data, size_t len, uint64_t now, int *in_burst,
+                   double *link_free, proxyStats *stats) {
+    stats->packets++;
+    if (lose(imp, in_burst, stats)) {
+        log_event(dir, "lost", data, len, *in_burst ? "(burst)" : NULL);
+        return;
+    }
+
+    // The bandwidth limit: the datagram waits for the ones before it, and is dropped if the queue is full
+    double sent = (double)now;
+    if (imp->rate > 0) {
+        double start = *link_free > now ? *link_free : (double)now;
+        if (start - now > imp->queue_us) {
+            stats->queue_drops++;
+            log_event(dir, "queue-drop", data, len, NULL);
+            return;
+        }
+        sent = start + len / imp->rate;
+        *link_free = sent;
+    }
+
+    double delay = imp->delay_us;
+    if (imp->jitter_us > 0)
+        delay += (2 * rng_uniform() - 1) * imp->jitter_us;
+    if (delay < 0)
+        delay = 0;
+    if (imp->reorder > 0 && rng_uniform() < imp->reorder) {
+        delay += imp->reorder_us;
+        stats->reordered++;
+        log_event(dir, "reordered", data, len, NULL);
+    }
+    if (imp->corrupt > 0 && rng_uniform() < imp->corrupt) {
+        size_t bit = rng_next() % (len * 8);
+        data[bit / 8] ^= 1 << (bit % 8);
+        stats->corrupted++;
+        char detail[32];
+        snprintf(detail, sizeof(detail), "bit=%zu", bit);
+        log_event(dir, "corrupted", data, len, detail);
+    }
+    uint64_t at = (uint64_t)(sent + delay);
+    int copies = imp->dup > 0 && rng_uniform() < imp->dup ? 2 : 1;
+    if (copies == 2) {
+        stats->duplicated++;
+        log_event(dir, "duplicated", data, len, NULL);
+    }
+    for (int i = 0; i < copies; i++) {
+        if (hold(flow, dir, data, len, at) == -1) {
+            stats->queue_drops++;
+            log_event(dir, "queue-drop", data, len, NULL);
+        }
+    }
+}
+
+// The flow of a Sender, a new one (with its own socket to the Receiver) the first time it sends. Returns -1 if the
+// table is full or on error.
+static int flow_get(flow *flows, int *count, const struct sockaddr_in *client) {
+    for (int i = 0; i < *count; i++) {
+        if (flows[i].client.sin_addr.s_addr == client->sin_addr.s_addr && flows[i].client.sin_port == client->sin_port)
+            return i;
+    }
+    if (*count == MAX_FLOWS)
+        return -1;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == -1) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    flows[*count].client = *client;
+    flows[*count].sock = sock;
+    return (*count)++;
+}
+
+static void print_stats(const char *name, const proxyStats *stats) {
+    printf("- %s: %lu packets (%lu bytes), forwarded %lu, lost %lu (%lu in bursts), queue drops %lu, duplicated %lu, "
+           "corrupted %lu, reordered %lu\n", name, stats->packets, stats->bytes, stats->forwarded, stats->lost,
+           stats->burst_lost, stats->queue_drops, stats->duplicated, stats->corrupted, stats->reordered);
+}
+
+int main(int argc, char *argv[]) {
+
+    // *** Pre-Parts : Get from the user the command from terminal ***
+
+    if (argc < 5 || argc % 2 == 0) {        // ./RUDP_Proxy -p 12346 -dp 12345 [-loss 0.01] [-burst 4] [-delay 10] [-jitter 2] ...
+        fprintf(stderr, "Please provide the correct usage for the program: %s -p PORT -dp RECEIVER_PORT [-ip RECEIVER_IP] "
+                        "[-loss RATE] [-burst PACKETS] [-delay MS] [-jitter MS] [-reorder RATE] [-reorder-delay MS] "
+                        "[-dup RATE] [-corrupt RATE] [-rate MBIT/S] [-queue KB] [-oneway on|off] [-seed SEED] "
+                        "[-log FILE] [-idle SECONDS]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Extract command-line arguments
+    int port = 0;
+    int dest_port = 0;
+    const char *dest_ip = "127.0.0.1";
+    impairment imp = { 0 };
+    imp.burst = 1;
+    imp.reorder_us = DEFAULT_REORDER_MS * 1000;
+    double rate_mbit = 0;
+    double queue_kb = DEFAULT_QUEUE_KB;
+    int oneway = 0; // Only the Sender's datagrams are impaired, the ACKs go back untouched
+    unsigned long seed = (unsigned long)time(NULL);
+    const char *log_path = NULL;
+    int idle = 0; // Exit after this many seconds without a datagram, 0 runs until Ctrl+C
+
+    // Process command-line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-dp") == 0 && i + 1 < argc) {
+            dest_port = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-ip") == 0 && i + 1 < argc) {
+            dest_ip = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-loss") == 0 && i + 1 < argc) {
+            imp.loss = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-burst") == 0 && i + 1 < argc) {
+            imp.burst = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-delay") == 0 && i + 1 < argc) {
+            imp.delay_us = atof(argv[i + 1]) * 1000;
+            i++;
+        } else if (strcmp(argv[i], "-jitter") == 0 && i + 1 < argc) {
+            imp.jitter_us = atof(argv[i + 1]) * 1000;
+            i++;
+        } else if (strcmp(argv[i], "-reorder") == 0 && i + 1 < argc) {
+            imp.reorder = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-reorder-delay") == 0 && i + 1 < argc) {
+            imp.reorder_us = atof(argv[i + 1]) * 1000;
+            i++;
+        } else if (strcmp(argv[i], "-dup") == 0 && i + 1 < argc) {
+            imp.dup = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-corrupt") == 0 && i + 1 < argc) {
+            imp.corrupt = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-rate") == 0 && i + 1 < argc) {
+            rate_mbit = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-queue") == 0 && i + 1 < argc) {
+            queue_kb = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-oneway") == 0 && i + 1 < argc) {
+            oneway = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[i + 1], NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc) {
+            log_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-idle") == 0 && i + 1 < argc) {
+            idle = atoi(argv[i + 1]);
+            i++;
+        }
+    }
+
+    // Check if required arguments are provided
+    if (port == 0 || dest_port == 0 || imp.loss < 0 || imp.loss > 1 || imp.burst < 1 || imp.delay_us < 0 ||
+        imp.jitter_us < 0 || imp.reorder < 0 || imp.reorder_us < 0 || imp.dup < 0 || imp.corrupt < 0 || rate_mbit < 0 ||
+        queue_kb < 0 || idle < 0) {
+        fprintf(stderr, "Invalid arguments. Please provide the correct usage.\n");
+        exit(EXIT_FAILURE);
+    }
+    imp.rate = rate_mbit / 8; // Megabits per second are bytes per microsecond divided by 8
+    imp.queue_us = imp.rate > 0 ? queue_kb * 1024 / imp.rate : 0;
+    impairment none = { 0 };
+    none.burst = 1;
+    const impairment *imps[2] = { &imp, oneway ? &none : &imp };
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 1; // xorshift's state must not be 0
+
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(dest_port);
+    if (inet_pton(AF_INET, dest_ip, &dest.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid Receiver address %s.\n", dest_ip);
+        exit(EXIT_FAILURE);
+    }
+    if (log_path != NULL) {
+        log_file = fopen(log_path, "w");
+        if (log_file == NULL) {
+            perror("Log file open failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // *** Part A: The socket the Senders send to ***
+    int front = socket(AF_INET, SOCK_DGRAM, 0);
+    if (front == -1) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = INADDR_ANY;
+    local.sin_port = htons(port);
+    if (bind(front, (struct sockaddr *)&local, sizeof(local)) == -1) {
+        perror("Bind failed");
+        close(front);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    char rate_text[32] = "unlimited";
+    if (rate_mbit > 0)
+        snprintf(rate_text, sizeof(rate_text), "%.1fMbit/s", rate_mbit);
+    printf("Proxy on port %d to %s:%d (loss %.2f%%, burst %.1f, delay %.1fms, jitter %.1fms, reorder %.2f%%, duplicate %.2f%%, "
+           "corrupt %.3f%%, rate %s, %s, seed %lu)...\n", port, dest_ip, dest_port, imp.loss * 100, imp.burst,
+           imp.delay_us / 1000, imp.jitter_us / 1000, imp.reorder * 100, imp.dup * 100, imp.corrupt * 100, rate_text,
+           oneway ? "one way" : "both ways", seed);
+    fflush(stdout);
+
+    // *** Part B: Forward the datagrams of both directions, every one of them when its time comes ***
+    flow flows[MAX_FLOWS];
+    int flow_count = 0;
+    proxyStats stats[2];
+    memset(stats, 0, sizeof(stats));
+    int in_burst[2] = { 0, 0 };
+    double link_free[2] = { 0, 0 };
+    static unsigned char buffer[MAX_DATAGRAM];
+    start_us = now_us();
+    uint64_t last_active = start_us;
+
+    while (!stop) {
+        uint64_t now = now_us();
+        // Send the datagrams that are due
+        while (heap_count > 0 && heap[0]->at <= now) {
+            held *h = heap_pop();
+            ssize_t sent;
+            if (h->dir == FWD)
+                sent = sendto(flows[h->flow].sock, h->data, h->len, 0, (struct sockaddr *)&dest, sizeof(dest));
+            else
+                sent = sendto(front, h->data, h->len, 0, (struct sockaddr *)&flows[h->flow].client, sizeof(flows[h->flow].client));
+            if (sent == -1)
+                log_event(h->dir, "send-failed", h->data, h->len, strerror(errno));
+            else
+                stats[h->dir].forwarded++;
+            free(h);
+        }
+        if (idle > 0 && now - last_active > (uint64_t)idle * 1000000)
+            break;
+
+        // Wait for a datagram until the next one is due
+        struct pollfd pfds[MAX_FLOWS + 1];
+        pfds[0].fd = front;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < flow_count; i++) {
+            pfds[i + 1].fd = flows[i].sock;
+            pfds[i + 1].events = POLLIN;
+        }
+        uint64_t wait = 1000000; // The idle timeout is checked once a second
+        if (heap_count > 0)
+            wait = heap[0]->at > now ? heap[0]->at - now : 0;
+        struct timespec ts = { wait / 1000000, (wait % 1000000) * 1000 };
+        int ready = ppoll(pfds, flow_count + 1, &ts, NULL);
+        if (ready == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll failed");
+            break;
+        }
+        if (ready == 0)
+            continue;
+        now = now_us();
+        last_active = now;
+
+        // From a Sender
+        if (pfds[0].revents & POLLIN) {
+            struct sockaddr_in client;
+            socklen_t client_len = sizeof(client);
+            ssize_t len;
+            while ((len = recvfrom(front, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&client, &client_len)) > 0) {
+                int f = flow_get(flows, &flow_count, &client);
+                if (f == -1) {
+                    fprintf(stderr, "Too many Senders, a datagram was dropped.\n");
+                    continue;
+                }
+                stats[FWD].bytes += len;
+                impair(imps[FWD], f, FWD, buffer, len, now, &in_burst[FWD], &link_free[FWD], &stats[FWD]);
+                client_len = sizeof(client);
+            }
+        }
+        // From the Receiver, back to a Sender
+        for (int i = 0; i < flow_count; i++) {
+            if (!(pfds[i + 1].revents & POLLIN))
+                continue;
+            ssize_t len;
+            while ((len = recv(flows[i].sock, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+                stats[REV].bytes += len;
+                impair(imps[REV], i, REV, buffer, len, now, &in_burst[REV], &link_free[REV], &stats[REV]);
+            }
+        }
+    }
+
+    // *** Part C: Statistics ***
+    printf("----------------------------------\n");
+    printf("- * Proxy statistics * -\n");
+    print_stats("Sender -> Receiver", &stats[FWD]);
+    print_stats("Receiver -> Sender", &stats[REV]);
+    printf("- %u datagrams were still held\n", heap_count);
+    printf("----------------------------------\n");
+
+    while (heap_count > 0)
+        free(heap_pop());
+    for (int i = 0; i < flow_count; i++)
+        close(flows[i].sock);
+    close(front);
+    if (log_file != NULL)
+        fclose(log_file);
+    return 0;
+}
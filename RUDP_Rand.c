@@ -0,0 +1,136 @@
+#include <string.h>
+#include "RUDP_Rand.h"
+#include "RUDP_Checksum.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define RAND_X86 1
+#endif
+
+#define STEP_BYTES 32 // One output of each of the four generators
+
+// Kernel picked at startup by rand_init
+static void (*rand_kernel)(rudpRand *rng, void *buf, size_t bytes) = rudp_rand_fill_scalar;
+static const char *rand_kernel_label = "scalar";
+
+__attribute__((constructor)) static void rand_init() {
+#ifdef RAND_X86
+    __builtin_cpu_init(); // The constructors of other files may not have run yet
+    if (csum_cpu_supports("avx2")) {
+        rand_kernel = rudp_rand_fill_avx2;
+        rand_kernel_label = "avx2";
+    }
+#endif
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// SplitMix64, spreads a seed over the states
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void rudp_rand_seed(rudpRand *rng, uint64_t seed) {
+    for (int word = 0; word < 4; word++) {
+        for (int lane = 0; lane < 4; lane++)
+            rng->lanes[word][lane] = splitmix64(&seed);
+    }
+    rng->wy = splitmix64(&seed);
+}
+
+uint64_t rudp_rand_next(rudpRand *rng) {
+    rng->wy += 0xA0761D6478BD642Full;
+    __uint128_t product = (__uint128_t)rng->wy * (rng->wy ^ 0xE7037ED1A0B428DBull);
+    return (uint64_t)(product >> 64) ^ (uint64_t)product;
+}
+
+double rudp_rand_double(rudpRand *rng) {
+    return (rudp_rand_next(rng) >> 11) * 0x1.0p-53;
+}
+
+// One step of the four generators, their outputs one after the other
+static void step_scalar(rudpRand *rng, uint64_t out[4]) {
+    uint64_t (*s)[4] = rng->lanes;
+    for (int lane = 0; lane < 4; lane++) {
+        out[lane] = rotl(s[0][lane] + s[3][lane], 23) + s[0][lane];
+        uint64_t t = s[1][lane] << 17;
+        s[2][lane] ^= s[0][lane];
+        s[3][lane] ^= s[1][lane];
+        s[1][lane] ^= s[2][lane];
+        s[0][lane] ^= s[3][lane];
+        s[2][lane] ^= t;
+        s[3][lane] = rotl(s[3][lane], 45);
+    }
+}
+
+void rudp_rand_fill_scalar(rudpRand *rng, void *buf, size_t bytes) {
+    unsigned char *p = (unsigned char *)buf;
+    uint64_t out[4];
+    while (bytes > 0) {
+        step_scalar(rng, out);
+        size_t n = bytes < STEP_BYTES ? bytes : STEP_BYTES;
+        memcpy(p, out, n);
+        p += n;
+        bytes -= n;
+    }
+}
+
+#ifdef RAND_X86
+
+static inline __attribute__((target("avx2"))) __m256i rotl_avx2(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+// The four generators in the four 64-bit lanes of each state register
+__attribute__((target("avx2"))) void rudp_rand_fill_avx2(rudpRand *rng, void *buf, size_t bytes) {
+    unsigned char *p = (unsigned char *)buf;
+    __m256i s0 = _mm256_loadu_si256((const __m256i *)rng->lanes[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i *)rng->lanes[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i *)rng->lanes[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i *)rng->lanes[3]);
+    while (bytes > 0) {
+        __m256i out = _mm256_add_epi64(rotl_avx2(_mm256_add_epi64(s0, s3), 23), s0);
+        __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = rotl_avx2(s3, 45);
+        if (bytes >= STEP_BYTES) {
+            _mm256_storeu_si256((__m256i *)p, out);
+            p += STEP_BYTES;
+            bytes -= STEP_BYTES;
+        } else {
+            uint64_t last[4];
+            _mm256_storeu_si256((__m256i *)last, out);
+            memcpy(p, last, bytes);
+            bytes = 0;
+        }
+    }
+    _mm256_storeu_si256((__m256i *)rng->lanes[0], s0);
+    _mm256_storeu_si256((__m256i *)rng->lanes[1], s1);
+    _mm256_storeu_si256((__m256i *)rng->lanes[2], s2);
+    _mm256_storeu_si256((__m256i *)rng->lanes[3], s3);
+}
+
+#else
+
+void rudp_rand_fill_avx2(rudpRand *rng, void *buf, size_t bytes) {
+    rudp_rand_fill_scalar(rng, buf, bytes);
+}
+
+#endif
+
+void rudp_rand_fill(rudpRand *rng, void *buf, size_t bytes) {
+    rand_kernel(rng, buf, bytes);
+}
+
+const char *rudp_rand_kernel_name() {
+    return rand_kernel_label;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fast pseudo-random numbers for generated payloads and load (not for cryptography).
+ * rudp_rand_fill runs four xoshiro256++ generators side by side, 32 bytes per step: the AVX2 kernel steps the four of
+ * them at once in vector registers, and the scalar kernel gives the same bytes. The fastest kernel the CPU supports
+ * is picked at startup, the others are exported for benchmarks. rudp_rand_next is wyrand, for single draws.
+ */
+
+typedef struct _rudpRand {
+    uint64_t lanes[4][4]; // xoshiro256++ states, lanes[word][generator]
+    uint64_t wy; // wyrand state
+} rudpRand;
+
+/*
+ * Seeds the generators, the same seed gives the same numbers and bytes.
+ */
+void rudp_rand_seed(rudpRand *rng, uint64_t seed);
+
+/*
+ * Returns the next 64 random bits.
+ */
+uint64_t rudp_rand_next(rudpRand *rng);
+
+/*
+ * Returns a random number in [0, 1).
+ */
+double rudp_rand_double(rudpRand *rng);
+
+/*
+ * Fills bytes of buf with random bytes.
+ */
+void rudp_rand_fill(rudpRand *rng, void *buf, size_t bytes);
+
+void rudp_rand_fill_scalar(rudpRand *rng, void *buf, size_t bytes);
+
+void rudp_rand_fill_avx2(rudpRand *rng, void *buf, size_t bytes);
+
+/*
+ * Returns the name of the kernel rudp_rand_fill uses ("avx2" or "scalar").
+ */
+const char *rudp_rand_kernel_name();
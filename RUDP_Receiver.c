@@ -1,55 +1,362 @@
 #include "RUDP_API.h"
-#include "LinkedList.h"
+#include "RUDP_Resume.h"
+#include "RUDP_Session.h"
+#include "RUDP_Stats.h"
+#include "RUDP_Writer.h"
+#include <signal.h>
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <sys/stat.h>
 
-#define MAX_BUFFER_SIZE 2048 
+struct _worker;
 
-//  a function to calculate milliseconds
-double get_time_in_milliseconds(struct timeval start, struct timeval end) {
-    return (double)(end.tv_sec - start.tv_sec) * 1000.0 + (double)(end.tv_usec - start.tv_usec) / 1000.0;
+// The file being received of a transfer that may be resumed is flushed to the disk this often (microseconds), its
+// bitmap is saved when a flush completes
+#define RESUME_FLUSH_US 1000000
+
+struct _transfer;
+
+// A file of a transfer on disk, until the writer closed it (after its End frame, or when the connection closed in the
+// middle of it): its writes complete after the next file began, and may complete after the connection is gone
+typedef struct _transferFile {
+    struct _transfer *t;
+    rudpWriterFile *file;
+    char name[RUDP_SESSION_MAX_NAME + 1];
+    uint64_t base; // Offset of the file in the transfer
+    uint64_t size;
+    int ended; // Its End frame arrived
+    int valid; // The CRC32C of its End frame matched
+} transferFile;
+
+// The session of a connection: files framed by Begin/End frames (see RUDP_Session.h), every file is timed on its own
+typedef struct _transfer {
+    rudpSessionReader *reader;
+    rudpConn *conn;
+    struct _worker *w;
+    char name[RUDP_SESSION_MAX_NAME + 1]; // The current file
+    uint64_t file_size;
+    uint64_t start_time; // Begin frame of the current file (monotonic microseconds)
+    transferFile *file; // The current file on disk, NULL if the data is discarded
+    uint64_t offset; // Of the next data of the current file
+    uint64_t received; // Bytes of the current file that arrived (fewer than its size for a partial file)
+    int failed; // The stream isn't a session, the rest of it is ignored
+    rudpResume *resume; // Chunks of the transfer on disk if the Sender may resume it (see RUDP_Resume.h), NULL if not
+    int resuming; // The files are partly on disk already, they aren't truncated
+    uint64_t base; // Offset of the current file in the transfer
+    uint64_t flushed_at; // The file being received was last flushed (monotonic microseconds)
+    unsigned int files; // Files on disk the writer didn't close yet, the transfer is freed after them
+    int closed; // The connection closed
+} transfer;
+
+// A receive thread: its own SO_REUSEPORT socket, connection table and statistics, so workers share nothing.
+// The kernel picks the socket of a datagram by a hash of its addresses and ports, so every packet of a Sender
+// reaches the same worker.
+typedef struct _worker {
+    int index;
+    int socket;
+    int cpu; // CPU the thread is pinned to, -1 if it isn't
+    int offload; // UDP GSO/GRO
+    int engine; // I/O engine of the socket (RUDP_ENGINE_*)
+    int compress; // Agree to the compressed sessions Senders ask for
+    unsigned int ack_every; // Delayed ACK policy
+    unsigned int ack_delay;
+    rudpWriter *writer; // Of the files to disk, NULL if the data is discarded
+    pthread_t thread;
+    rudpHistogram *times; // Of the files received by this worker (microseconds), merged with the other workers' ones at shutdown
+    rudpHistogram *speeds; // KB/s
+    uint64_t bytes;
+    unsigned int connections; // Connections that ended
+    int failed;
+} worker;
+
+static volatile sig_atomic_t stop = 0;
+static unsigned int max_connections = 0; // Exit once this many Senders are done, 0 serves until Ctrl+C
+static atomic_uint closed_connections; // Over all the workers
+static int progress = 1; // A line per file (off for load tests, where files are many and small)
+static const char *output_dir = NULL; // The files are written there, NULL discards them
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
 }
 
-int main(int argc, char *argv[]) {
-    
-    // *** Pre-Parts : Get from the user the command from terminal ***
+// Monotonic time in microseconds, a file's time doesn't jump with the wall clock
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-    if (argc != 3) {        // ./RUDP_Receiver -p 12345
-        fprintf(stderr, "Please provide the correct usage for the program: %s -ip IP -p PORT -algo ALGO <FILE_PATH>\n", argv[0]);
-        exit(EXIT_FAILURE);
+// Address of the Sender as "ip:port"
+static const char *peer_name(rudpConn *conn, char *name, size_t len) {
+    const struct sockaddr_in *peer = (const struct sockaddr_in *)rudpConn_peer(conn, NULL);
+    char ip[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &peer->sin_addr, ip, sizeof(ip));
+    snprintf(name, len, "%s:%d", ip, ntohs(peer->sin_port));
+    return name;
+}
+
+// The bytes of a file at offset are on the disk: they count for the bitmap
+static void on_file_durable(uint64_t offset, size_t len, void *user) {
+    transferFile *f = (transferFile *)user;
+    if (f->t->resume != NULL)
+        rudpResume_mark(f->t->resume, f->base + offset, len);
+}
+
+// The connection closed and the writer closed its files, nothing refers to the transfer anymore
+static void transfer_release(transfer *t) {
+    if (!t->closed || t->files > 0)
+        return;
+    rudpResume_free(t->resume); // Its bitmap is saved, the next attempt of the Sender resumes from there
+    free(t);
+}
+
+// The chunks the bitmap marks are on the disk already, saving it doesn't wait for the disk
+static void resume_save(transfer *t) {
+    if (rudpResume_save(t->resume) == -1)
+        fprintf(stderr, "Resume state of %s can't be saved: %s\n", t->name, strerror(errno));
+}
+
+// A flush of a file completed, the chunks it completed are marked: the bitmap is saved
+static void on_file_synced(int failed, void *user) {
+    transferFile *f = (transferFile *)user;
+    if (failed)
+        fprintf(stderr, "Flush of %s failed, its last bytes may not be on the disk.\n", f->name);
+    if (f->t->resume != NULL)
+        resume_save(f->t);
+}
+
+static void on_file_closed(int failed, void *user);
+
+static void on_file_begin(const char *name, uint64_t size, void *user) {
+    transfer *t = (transfer *)user;
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    t->file_size = size;
+    t->start_time = now_us();
+    t->offset = 0;
+    t->received = 0;
+    if (t->w->writer == NULL)
+        return;
+
+    // The Sender picks the name: a plain file name, never a path out of the output directory
+    char path[PATH_MAX];
+    if (name[0] == '\0' || strchr(name, '/') != NULL || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        fprintf(stderr, "File name \"%s\" refused, its data is discarded.\n", name);
+        return;
     }
+    snprintf(path, sizeof(path), "%s/%s", output_dir, name);
+    // Only the files of a transfer that may be resumed are flushed, the bitmap says which bytes are on the disk
+    rudpWriterCallbacks callbacks = { t->resume != NULL ? on_file_durable : NULL, on_file_synced, on_file_closed };
+    transferFile *f = (transferFile *)calloc(1, sizeof(transferFile));
+    if (f != NULL) {
+        f->t = t;
+        snprintf(f->name, sizeof(f->name), "%s", name);
+        f->base = t->base;
+        f->size = size;
+        f->file = rudpWriter_open(t->w->writer, path, size, t->resuming, &callbacks, f);
+    }
+    if (f == NULL || f->file == NULL) {
+        fprintf(stderr, "Can't create %s, its data is discarded: %s\n", path, strerror(errno));
+        free(f);
+        return;
+    }
+    t->file = f;
+    t->files++;
+}
 
-    // Extract command-line arguments
-    int port = 0;
+// The bytes of a partial file that follow are at offset
+static void on_file_range(uint64_t offset, uint64_t length, void *user) {
+    (void)length;
+    transfer *t = (transfer *)user;
+    t->offset = offset;
+}
 
-    // Process command-line arguments
-    for (int i = 1; i < argc; i++) {
-         if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
-            port = atoi(argv[i + 1]); // Convert a string representing an integer (ASCII string) to an integer value.
-            i++;
-        } 
+// The data lands at its offset in the file, as it's delivered, and counts for the bitmap once a flush made it durable
+static void on_file_data(const char *data, int len, void *user) {
+    transfer *t = (transfer *)user;
+    if (t->file != NULL && rudpWriter_write(t->w->writer, t->file->file, data, len, t->offset) == -1)
+        fprintf(stderr, "Write of %s at %lu failed: %s\n", t->name, (unsigned long)t->offset, strerror(errno));
+    t->offset += len;
+    t->received += len;
+    if (t->resume != NULL && t->file != NULL && now_us() - t->flushed_at >= RESUME_FLUSH_US) {
+        if (rudpWriter_sync(t->w->writer, t->file->file) == -1)
+            fprintf(stderr, "Flush of %s failed: %s\n", t->name, strerror(errno));
+        t->flushed_at = now_us();
+    }
+}
+
+// The bitmap of a transfer after a file ended: a file that isn't right on disk is sent again by the next attempt, and
+// a transfer whose chunks all arrived needs no bitmap anymore
+static void resume_file_end(transfer *t, uint64_t base, uint64_t size, int ok) {
+    if (!ok)
+        rudpResume_clear(t->resume, base, size);
+    if (rudpResume_complete(t->resume)) {
+        rudpResume_remove(t->resume);
+        rudpResume_free(t->resume);
+        t->resume = NULL;
+        t->resuming = 0;
+        return;
     }
+    resume_save(t);
+}
 
-    // Check if required arguments are provided
-    if (port == 0) {
-        fprintf(stderr, "Invalid arguments. Please provide the correct usage.\n");
-        exit(EXIT_FAILURE);
+// The writer closed a file, its writes all completed and were flushed: the file is right on disk if they all succeeded
+// and its CRC32C matched. A file the connection left in the middle of stays in the bitmap as far as it's durable.
+static void on_file_closed(int failed, void *user) {
+    transferFile *f = (transferFile *)user;
+    transfer *t = f->t;
+    if (failed)
+        fprintf(stderr, "Writes of %s failed, the file on disk is incomplete.\n", f->name);
+    if (f->ended && t->resume != NULL)
+        resume_file_end(t, f->base, f->size, f->valid && !failed);
+    free(f);
+    t->files--;
+    transfer_release(t);
+}
+
+static void on_file_end(int valid, void *user) {
+    transfer *t = (transfer *)user;
+    char name[64];
+    if (t->file != NULL) {
+        transferFile *f = t->file;
+        t->file = NULL;
+        f->ended = 1;
+        f->valid = valid;
+        rudpWriter_close(t->w->writer, f->file); // Its result comes to on_file_closed, the transfer goes on meanwhile
+    } else if (t->resume != NULL) {
+        resume_file_end(t, t->base, t->file_size, 0);
+    }
+    t->base += t->file_size;
+    // The whole file, from its Begin frame to its End frame (only the missing bytes of a partial file arrive)
+    uint64_t time = now_us() - t->start_time;
+    if (time == 0)
+        time = 1;
+    double speed = t->received / 1024.0 / time * 1000000.0; // KB/s
+    if (t->received > 0) { // An empty file has no speed
+        rudpHistogram_record(t->w->times, time);
+        rudpHistogram_record(t->w->speeds, (uint64_t)speed);
+        t->w->bytes += t->received;
     }
+    if (progress && t->received < t->file_size)
+        printf("File transfer resumed (%s, %lu of %lu bytes, CRC32C %s) from %s: Time=%.2fms; Speed=%.2fMB/s\n", t->name,
+               (unsigned long)t->received, (unsigned long)t->file_size, valid ? "ok" : "MISMATCH", peer_name(t->conn, name, sizeof(name)),
+               time / 1000.0, speed / 1024.0);
+    else if (progress)
+        printf("File transfer completed (%s, %lu bytes, CRC32C %s) from %s: Time=%.2fms; Speed=%.2fMB/s\n", t->name,
+               (unsigned long)t->file_size, valid ? "ok" : "MISMATCH", peer_name(t->conn, name, sizeof(name)), time / 1000.0,
+               speed / 1024.0);
+}
 
-    // *** Part A: Create a UDP connection between the Receiver and the Sender ***
-    printf("Starting Receiver...\n");
+// The Sender asked to resume its transfer: load the bitmap of the transfer from the output directory, and answer with
+// the chunks it holds in the ACK of the SYN
+static void resume_accept(transfer *t, rudpConn *conn, const unsigned char *request, size_t len) {
+    char path[PATH_MAX];
+    uint64_t transfer_id = 0;
+    for (int i = 0; i < 8; i++)
+        transfer_id = transfer_id << 8 | request[i];
+    snprintf(path, sizeof(path), "%s/.rudp-resume-%016llx", output_dir, (unsigned long long)transfer_id);
+    t->resume = rudpResume_open(path, request, len);
+    if (t->resume == NULL) {
+        fprintf(stderr, "Resume state allocation failed, the transfer starts over.\n");
+        return;
+    }
+    // The file of the bitmap exists from now on, a connection of the same transfer that comes later loads this one
+    if (rudpResume_save(t->resume) == -1)
+        fprintf(stderr, "Resume state can't be saved: %s\n", strerror(errno));
+    t->flushed_at = now_us();
+    unsigned char state[RUDP_RESUME_MAX_STATE];
+    size_t state_len = rudpResume_state(t->resume, state);
+    if (state_len == 0 || rudpConn_set_resume(conn, state, state_len) == -1)
+        return;
+    t->resuming = 1;
+    printf("Resuming transfer %016llx: %lu bytes are on disk already.\n", (unsigned long long)transfer_id,
+           (unsigned long)rudpResume_received(t->resume));
+}
 
+static int on_accept(rudpConn *conn, void *user) {
+    char name[64];
+    rudpSessionCallbacks callbacks = { on_file_begin, on_file_data, on_file_end, on_file_range };
+    transfer *t = (transfer *)calloc(1, sizeof(transfer));
+    if (t == NULL)
+        return -1; // The Sender retries its SYN
+    t->reader = rudpSessionReader_alloc(&callbacks, t);
+    if (t->reader == NULL) {
+        free(t);
+        return -1;
+    }
+    t->conn = conn;
+    t->w = (worker *)user;
+    rudpConn_set_user(conn, t);
+    printf("Sender %s connected (%s%s), beginning to receive files...\n", peer_name(conn, name, sizeof(name)),
+           rudpConn_integrity(conn) == RUDP_INTEGRITY_CRC32C ? "CRC32C" : "checksum", rudpConn_compression(conn) ? ", compressed" : "");
+    // Files that aren't written can't be resumed
+    const void *request;
+    size_t request_len = rudpConn_resume(conn, &request);
+    if (output_dir != NULL && request_len == RUDP_RESUME_REQUEST_SIZE)
+        resume_accept(t, conn, (const unsigned char *)request, request_len);
+    return 0;
+}
+
+// Parse the session's frames and files out of the data of the connection
+static void on_data(rudpConn *conn, const char *data, int len, void *user) {
+    (void)user;
+    transfer *t = (transfer *)rudpConn_user(conn);
+    char name[64];
+    if (!t->failed && rudpSessionReader_input(t->reader, data, len) == -1) {
+        fprintf(stderr, "Sender %s sent a malformed session, its data is ignored.\n", peer_name(conn, name, sizeof(name)));
+        t->failed = 1;
+    }
+}
+
+static void on_close(rudpConn *conn, int reason, void *user) {
+    worker *w = (worker *)user;
+    char name[64];
+    if (reason == RUDP_CLOSE_FIN)
+        printf("Sender %s sent exit message.\n", peer_name(conn, name, sizeof(name)));
+    else if (reason == RUDP_CLOSE_IDLE)
+        printf("Sender %s timed out.\n", peer_name(conn, name, sizeof(name)));
+    rudpConnStats stats;
+    rudpConn_stats(conn, &stats);
+    if (stats.duplicates > 0)
+        printf("Sender %s: %lu duplicate packets of %lu.\n", peer_name(conn, name, sizeof(name)), stats.duplicates,
+               (unsigned long)stats.packets_received);
+    if (rudpConn_fec_recovered(conn) > 0)
+        printf("FEC rebuilt %lu lost packets of Sender %s.\n", rudpConn_fec_recovered(conn), peer_name(conn, name, sizeof(name)));
+    transfer *t = (transfer *)rudpConn_user(conn);
+    if (t->file != NULL) { // The Sender left in the middle of a file
+        rudpWriter_close(w->writer, t->file->file);
+        t->file = NULL;
+    }
+    rudpSessionReader_free(t->reader);
+    t->reader = NULL;
+    t->closed = 1;
+    transfer_release(t); // Once the writer closed its files
+    w->connections++;
+    atomic_fetch_add(&closed_connections, 1);
+}
+
+// Create a socket on the port, every worker binds its own one to the same port (SO_REUSEPORT)
+static int worker_socket(int port) {
     //Create socket
     int listeningSocket = rudp_socket(); // Create a UDP socket for IPv4
+    if (listeningSocket == -1)
+        return -1;
 
     // The variable to store the socket option for reusing the server's address.
     int opt = 1;
 
     // Set the socket option to reuse the server's address.
     // This is useful to avoid the "Address already in use" error message when restarting the server.
-    if (setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+    // SO_REUSEPORT lets the sockets of all the workers bind the same port, the kernel spreads the Senders over them.
+    if (setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
     {
         perror("Error setting sockopt");
         close(listeningSocket);
-        return 1;
+        return -1;
     }
 
     // Define Receiver's values
@@ -64,98 +371,280 @@ int main(int argc, char *argv[]) {
     if (bind(listeningSocket, (struct sockaddr *)&server_address, sizeof(server_address)) == -1) {
         perror("Bind failed");
         close(listeningSocket);
-        exit(EXIT_FAILURE);
+        return -1;
     }
+    return listeningSocket;
+}
 
-    // *** Part B: Get a connection from the sender ***
+// Serve the Senders the kernel steers to the worker's socket, until Ctrl+C or until enough Senders are done
+static void *worker_run(void *arg) {
+    worker *w = (worker *)arg;
 
-    // Define Sender
-    struct sockaddr_in client_address;
-    socklen_t client_address_len = sizeof(client_address);
-    memset(&client_address, 0, sizeof(client_address));
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+            fprintf(stderr, "Worker %d: CPU affinity failed: %s\n", w->index, strerror(err));
+    }
 
-    // Accept a connection
-    printf("Waiting for RUDP connection...\n");
-    ssize_t recvSYN = rudp_receive(listeningSocket, (struct sockaddr *)&client_address, &client_address_len);
-    if (recvSYN<=0) {
-        exit(EXIT_FAILURE);
+    // The server: a table of connections, each one with its own window and transfer state
+    rudpServerCallbacks callbacks = { on_accept, on_data, on_close };
+    rudpServer *server = rudpServer_alloc(w->socket, RUDP_DEFAULT_WINDOW, &callbacks, w);
+    if (server == NULL) {
+        perror("Server allocation failed");
+        w->failed = 1;
+        return NULL;
     }
-    
-    // *** Part C: Receive the file, measure the time it took to save ***
+    rudpServer_set_delayed_ack(server, w->ack_every, w->ack_delay);
+    rudpServer_set_compression(server, w->compress);
+    if (w->offload) {
+        int supported = rudpServer_set_offload(server, 1);
+        if (w->index == 0)
+            printf("UDP offload: GSO %s, GRO %s\n", supported > 0 && (supported & RUDP_OFFLOAD_GSO) ? "on" : "off",
+                   supported > 0 && (supported & RUDP_OFFLOAD_GRO) ? "on" : "off");
+    }
+    rudpServer_set_engine(server, w->engine);
+
+    // The socket, or the io_uring that receives from it
+    int fd = rudpServer_fd(server);
+    if (w->index == 0 && w->engine == RUDP_ENGINE_URING)
+        printf("I/O engine: %s\n", fd != w->socket ? "io_uring" : "system calls (io_uring unavailable)");
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+    int epollfd = epoll_create1(0);
+    if (epollfd == -1 || epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        perror("epoll failed");
+        rudpServer_free(server);
+        w->failed = 1;
+        return NULL;
+    }
+
+    while (!stop && (max_connections == 0 || atomic_load(&closed_connections) < max_connections)) {
+        // Wake up when packets arrive, or when the server has idle connections to look for
+        // (at least once a second, so the worker notices Ctrl+C and the other workers' Senders)
+        int ready = epoll_wait(epollfd, &event, 1, rudpServer_timeout(server));
+        if (ready == -1 && errno != EINTR) {
+            perror("epoll_wait failed");
+            w->failed = 1;
+            break;
+        }
+        if (rudpServer_poll(server) == -1) {
+            w->failed = 1;
+            break;
+        }
+        // The writes of this round go to the disk together, and the worker goes on receiving while they run
+        if (w->writer != NULL && rudpWriter_poll(w->writer) == -1) {
+            perror("Write submission failed");
+            w->failed = 1;
+            break;
+        }
+    }
+    rudpServer_free(server);
+    close(epollfd);
+    if (w->writer != NULL && rudpWriter_errors(w->writer) > 0) {
+        fprintf(stderr, "Worker %d: %lu writes failed.\n", w->index, rudpWriter_errors(w->writer));
+        w->failed = 1;
+    }
+    rudpWriter_free(w->writer);
+    return NULL;
+}
 
-    struct timeval start_time, end_time;
-    fileList* files = fileList_alloc(); // Start a new null list of files 
+int main(int argc, char *argv[]) {
     
-    // Receive the size of the file from the sender
-    unsigned int file_size;
-    ssize_t size_received = recvfrom(listeningSocket, &file_size, sizeof(file_size), 0, (struct sockaddr *)&client_address, &client_address_len);
-    if (size_received <= 0) {
-        perror("Error receiving file size");
-        close(listeningSocket);
+    // *** Pre-Parts : Get from the user the command from terminal ***
+
+    if (argc < 3 || argc % 2 == 0) {        // ./RUDP_Receiver -p 12345 [-n 1] [-threads 4] [-affinity on] [-offload on] [-ack 16] [-ack-delay 1000] [-log debug] [-progress off] [-o DIR] [-write uring] [-engine uring] [-compress off]
+        fprintf(stderr, "Please provide the correct usage for the program: %s -p PORT [-n CONNECTIONS] [-threads THREADS] "
+                        "[-affinity on|off] [-offload on|off] [-ack PACKETS] [-ack-delay MICROSECONDS] [-log off|error|warn|info|debug] "
+                        "[-progress on|off] [-o DIR] [-write pwrite|uring] [-engine syscall|uring] [-compress on|off]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // Receive the data of the file from the sender 
-    while (1)
-    {
-        int total_received = 0;
-        while(total_received<file_size) {
-            gettimeofday(&start_time,NULL);
-            ssize_t bytes_received = rudp_receive(listeningSocket, (struct sockaddr *)&client_address, &client_address_len);
-            if (bytes_received <= 0) { 
-                exit(EXIT_FAILURE);
-            }
-            total_received+=bytes_received;
+    // Extract command-line arguments
+    int port = 0;
+    int offload = 0; // UDP GSO/GRO
+    long threads = sysconf(_SC_NPROCESSORS_ONLN); // One worker per core by default
+    int affinity = 0; // Pin worker i to CPU i
+    int ack_every = 16; // ACK once every this many packets (1 acknowledges every packet)
+    int ack_delay = 1000; // Or this many microseconds after the first packet that wasn't acknowledged
+    int log_level = RUDP_LOG_INFO; // Messages of the library
+    int write_backend = RUDP_WRITE_PWRITE; // Of the files, with -o
+    int engine = RUDP_ENGINE_SYSCALL; // Of the sockets
+    int compress = 1; // Compressed sessions, when the Sender asks for them
+
+    // Process command-line arguments
+    for (int i = 1; i < argc; i++) {
+         if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[i + 1]); // Convert a string representing an integer (ASCII string) to an integer value.
+            i++;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            max_connections = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-affinity") == 0 && i + 1 < argc) {
+            affinity = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-offload") == 0 && i + 1 < argc) {
+            offload = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-ack") == 0 && i + 1 < argc) {
+            ack_every = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-ack-delay") == 0 && i + 1 < argc) {
+            ack_delay = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc) {
+            log_level = rudp_log_parse_level(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-progress") == 0 && i + 1 < argc) {
+            progress = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_dir = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            engine = strcmp(argv[i + 1], "uring") == 0 ? RUDP_ENGINE_URING : strcmp(argv[i + 1], "syscall") == 0 ? RUDP_ENGINE_SYSCALL : -1;
+            i++;
+        } else if (strcmp(argv[i], "-compress") == 0 && i + 1 < argc) {
+            compress = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-write") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "uring") == 0)
+                write_backend = RUDP_WRITE_URING;
+            else if (strcmp(argv[i + 1], "pwrite") == 0)
+                write_backend = RUDP_WRITE_PWRITE;
+            else
+                write_backend = -1;
+            i++;
         }
-    
-        gettimeofday(&end_time, NULL); // Set the end time before measuring elapsed time
-        double elapsed_time = get_time_in_milliseconds(start_time, end_time);
-        fileList_insertLast (files,elapsed_time,file_size); // Create new file 
-        printf("File transfer completed (%d bytes).\n",total_received);
-        printf("ACK sent.\n");
-        printf("Waiting for Sender response...\n");
-
-        // ** Part D: Wait for Sender Response **
-        char decision[4];
-        ssize_t decision_rec = recvfrom(listeningSocket, decision, sizeof(decision), 0, (struct sockaddr *)&client_address, &client_address_len);
-        if (decision_rec <= 0) {
-            perror("Error receiving decision");
-            close(listeningSocket);
+    }
+
+    // Check if required arguments are provided
+    if (port == 0 || threads <= 0 || ack_every <= 0 || ack_delay < 0 || log_level == -1 || write_backend == -1 || engine == -1) {
+        fprintf(stderr, "Invalid arguments. Please provide the correct usage.\n");
+        exit(EXIT_FAILURE);
+    }
+    rudp_log_set_level(log_level);
+
+    // *** Part A: Create a UDP socket for every worker, all of them on the same port ***
+    printf("Starting Receiver (%ld workers)...\n", threads);
+    if (output_dir != NULL) {
+        struct stat st;
+        if (stat(output_dir, &st) == -1 || !S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "%s isn't a directory.\n", output_dir);
             exit(EXIT_FAILURE);
         }
-        // if user don't want to send the file again, the next time in the loop won't measure time and will get exit message
-        if(decision[0]=='n') {
-            memset(decision, 0, strlen(decision));
-            break;
+    }
+
+    // All the sockets are bound before any worker starts, so the kernel's choice of socket for a Sender never changes
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    worker *workers = (worker *)calloc(threads, sizeof(worker));
+    if (workers == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < threads; i++) {
+        workers[i].index = i;
+        workers[i].cpu = affinity ? i % cpus : -1;
+        workers[i].offload = offload;
+        workers[i].engine = engine;
+        workers[i].compress = compress;
+        workers[i].ack_every = ack_every;
+        workers[i].ack_delay = ack_delay;
+        workers[i].times = rudpHistogram_alloc();
+        workers[i].speeds = rudpHistogram_alloc();
+        if (workers[i].times == NULL || workers[i].speeds == NULL) {
+            perror("Statistics allocation failed");
+            exit(EXIT_FAILURE);
         }
-    }   
-    
-    // Get Exit message from Sender
-    ssize_t Exit = rudp_receive(listeningSocket, (struct sockaddr *)&client_address, &client_address_len);
-        if (Exit <= 0) {
-            perror("Error receiving Exit message");
+        if (output_dir != NULL) {
+            workers[i].writer = rudpWriter_alloc(write_backend);
+            if (workers[i].writer == NULL && write_backend == RUDP_WRITE_URING) {
+                // Old kernels, or a sandbox that forbids io_uring
+                if (i == 0)
+                    fprintf(stderr, "io_uring unavailable (%s), writing with pwrite.\n", strerror(errno));
+                write_backend = RUDP_WRITE_PWRITE;
+                workers[i].writer = rudpWriter_alloc(write_backend);
+            }
+            if (workers[i].writer == NULL) {
+                perror("Writer allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        workers[i].socket = worker_socket(port);
+        if (workers[i].socket == -1)
+            exit(EXIT_FAILURE);
+    }
+
+    // Ctrl+C stops the Receiver and prints the statistics
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // *** Part B + C: Serve the Senders, every file is timed on its own ***
+
+    if (output_dir != NULL)
+        printf("Writing the files to %s (%s).\n", output_dir, write_backend == RUDP_WRITE_URING ? "io_uring" : "pwrite");
+    printf("Waiting for RUDP connections...\n");
+    for (long i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0) {
+            perror("Thread creation failed");
             exit(EXIT_FAILURE);
         }
+    }
+
+    // ** Part E: Merge the statistics of the workers and print them out **
+
+    rudpHistogram *times = workers[0].times;
+    rudpHistogram *speeds = workers[0].speeds;
+    uint64_t bytes = 0;
+    int failed = 0;
+    for (long i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].socket);
+        if (i > 0) {
+            rudpHistogram_merge(times, workers[i].times);
+            rudpHistogram_merge(speeds, workers[i].speeds);
+            rudpHistogram_free(workers[i].times);
+            rudpHistogram_free(workers[i].speeds);
+        }
+        bytes += workers[i].bytes;
+        failed |= workers[i].failed;
+    }
 
-    // ** Part E: Print out statistics **
-    
     printf("----------------------------------\n");
     printf("- * Statistics * -\n");
-    fileList_print(files); //fucntion that prints time and speed for each file
+    if (threads > 1) {
+        for (long i = 0; i < threads; i++)
+            printf("- Worker %ld: %u connections\n", i, workers[i].connections);
+    }
+    if (rudpHistogram_count(times) > 0) {
+        printf("- Files: %lu, %.2fMB\n", (unsigned long)rudpHistogram_count(times), bytes / (1024.0 * 1024.0));
 
-    // ** Part F: Calculate the average time and the total average bandwith **
-    
-    fileList_AverageT_print(files);
-    fileList_AverageBT_print(files);
+        // ** Part F: The distribution of the time and the bandwidth of the files **
+
+        printf("- Time (ms): min=%.2f p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f max=%.2f\n", rudpHistogram_min(times) / 1000.0,
+               rudpHistogram_percentile(times, 0.5) / 1000.0, rudpHistogram_percentile(times, 0.9) / 1000.0,
+               rudpHistogram_percentile(times, 0.99) / 1000.0, rudpHistogram_percentile(times, 0.999) / 1000.0,
+               rudpHistogram_max(times) / 1000.0);
+        printf("- Bandwidth (MB/s): min=%.2f p50=%.2f p90=%.2f p99=%.2f max=%.2f\n", rudpHistogram_min(speeds) / 1024.0,
+               rudpHistogram_percentile(speeds, 0.5) / 1024.0, rudpHistogram_percentile(speeds, 0.9) / 1024.0,
+               rudpHistogram_percentile(speeds, 0.99) / 1024.0, rudpHistogram_max(speeds) / 1024.0);
+        printf("- Average time: %.2fms\n", rudpHistogram_mean(times) / 1000.0);
+        printf("- Average bandwidth: %.2fMB/s\n", rudpHistogram_mean(speeds) / 1024.0);
+    }
     printf("----------------------------------\n");
-    close(listeningSocket);
-    fileList_free(files);
+    rudpHistogram_free(times);
+    rudpHistogram_free(speeds);
+    free(workers);
     
     // ** Part G: Exit **
 
     printf("Receicer end.\n");
-    return 0;
+    return failed ? EXIT_FAILURE : 0;
  }
-
-
-
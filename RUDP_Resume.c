@@ -0,0 +1,244 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "RUDP_Resume.h"
+
+// The file of a bitmap: magic, ID of the transfer, size of the transfer, chunk shift, the bitmap
+#define RESUME_MAGIC "RUDPRSM1"
+#define RESUME_MAGIC_SIZE 8
+#define RESUME_HEADER_SIZE (RESUME_MAGIC_SIZE + 8 + 8 + 1)
+
+struct _rudpResume {
+    char *path;
+    uint64_t transfer_id;
+    uint64_t size; // Bytes of the transfer
+    unsigned int shift; // Chunks are of 1 << shift bytes
+    uint64_t chunks;
+    unsigned char *bits;
+    uint64_t marked; // Chunks whose bit is set
+    uint64_t *written; // Bytes of every chunk written so far, its bit is set once they're all (writes complete in any order)
+    int dirty; // The bitmap changed since it was loaded or saved
+    int removed;
+    int file_exists; // The file as it was loaded or saved: another connection that saves or removes it makes it newer
+    ino_t file_ino;
+    struct timespec file_mtime;
+};
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        p[i] = value >> (56 - 8 * i);
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value = value << 8 | p[i];
+    return value;
+}
+
+size_t rudpResume_request(unsigned char *request, uint64_t transfer_id, uint64_t size) {
+    put_u64(request, transfer_id);
+    put_u64(request + 8, size);
+    return RUDP_RESUME_REQUEST_SIZE;
+}
+
+uint64_t rudpResume_chunk_size(const unsigned char *state, size_t len) {
+    if (len < 1 || state[0] < RUDP_RESUME_MIN_SHIFT || state[0] > 62)
+        return 0;
+    return (uint64_t)1 << state[0];
+}
+
+int rudpResume_has_chunk(const unsigned char *state, size_t len, uint64_t chunk) {
+    // A bitmap shorter than the transfer (it shouldn't be) misses the chunks it doesn't cover
+    if (1 + chunk / 8 >= len)
+        return 0;
+    return state[1 + chunk / 8] >> (chunk % 8) & 1;
+}
+
+static size_t bits_size(const rudpResume *resume) {
+    return (size_t)((resume->chunks + 7) / 8);
+}
+
+// Remember the file of the bitmap as it is now (every save renames a new file over it, so its inode changes)
+static void file_record(rudpResume *resume, int fd) {
+    struct stat st;
+    resume->file_exists = (fd >= 0 ? fstat(fd, &st) : stat(resume->path, &st)) == 0;
+    if (resume->file_exists) {
+        resume->file_ino = st.st_ino;
+        resume->file_mtime = st.st_mtim;
+    }
+}
+
+// 1 if the file isn't the one the bitmap was loaded from or saved to
+static int file_changed(const rudpResume *resume) {
+    struct stat st;
+    if (stat(resume->path, &st) == -1)
+        return resume->file_exists;
+    return !resume->file_exists || st.st_ino != resume->file_ino || st.st_mtim.tv_sec != resume->file_mtime.tv_sec ||
+           st.st_mtim.tv_nsec != resume->file_mtime.tv_nsec;
+}
+
+// Load the bitmap the file at path holds if it's the one of the same transfer, the bitmap stays empty otherwise
+static void resume_load(rudpResume *resume) {
+    int fd = open(resume->path, O_RDONLY);
+    file_record(resume, fd);
+    resume->dirty = 1; // Until it's loaded, the file is created (or replaced) by the first save
+    if (fd == -1)
+        return;
+    unsigned char header[RESUME_HEADER_SIZE];
+    size_t len = bits_size(resume);
+    if (read(fd, header, sizeof(header)) != (ssize_t)sizeof(header) || memcmp(header, RESUME_MAGIC, RESUME_MAGIC_SIZE) != 0 ||
+        get_u64(header + RESUME_MAGIC_SIZE) != resume->transfer_id || get_u64(header + RESUME_MAGIC_SIZE + 8) != resume->size ||
+        header[RESUME_HEADER_SIZE - 1] != resume->shift || read(fd, resume->bits, len) != (ssize_t)len) {
+        memset(resume->bits, 0, len);
+        close(fd);
+        return;
+    }
+    close(fd);
+    resume->dirty = 0;
+    for (uint64_t i = 0; i < resume->chunks; i++)
+        resume->marked += resume->bits[i / 8] >> (i % 8) & 1;
+}
+
+rudpResume *rudpResume_open(const char *path, const void *request, size_t len) {
+    if (len != RUDP_RESUME_REQUEST_SIZE)
+        return NULL;
+    rudpResume *resume = (rudpResume *)calloc(1, sizeof(rudpResume));
+    if (resume == NULL)
+        return NULL;
+    resume->transfer_id = get_u64((const unsigned char *)request);
+    resume->size = get_u64((const unsigned char *)request + 8);
+    // The smallest chunks that keep the bitmap within RUDP_RESUME_MAX_CHUNKS bits
+    resume->shift = RUDP_RESUME_MIN_SHIFT;
+    while (resume->size > 0 && resume->shift < 62 && ((resume->size - 1) >> resume->shift) + 1 > RUDP_RESUME_MAX_CHUNKS)
+        resume->shift++;
+    resume->chunks = resume->size == 0 ? 0 : ((resume->size - 1) >> resume->shift) + 1;
+    resume->path = strdup(path);
+    resume->bits = (unsigned char *)calloc(1, bits_size(resume) + 1);
+    resume->written = (uint64_t *)calloc(resume->chunks + 1, sizeof(uint64_t));
+    if (resume->path == NULL || resume->bits == NULL || resume->written == NULL) {
+        free(resume->path);
+        free(resume->bits);
+        free(resume->written);
+        free(resume);
+        return NULL;
+    }
+    resume_load(resume);
+    return resume;
+}
+
+void rudpResume_free(rudpResume *resume) {
+    if (resume == NULL)
+        return;
+    if (!resume->removed)
+        rudpResume_save(resume);
+    free(resume->path);
+    free(resume->bits);
+    free(resume->written);
+    free(resume);
+}
+
+size_t rudpResume_state(const rudpResume *resume, unsigned char *state) {
+    if (resume->marked == 0)
+        return 0;
+    state[0] = (unsigned char)resume->shift;
+    memcpy(state + 1, resume->bits, bits_size(resume));
+    return 1 + bits_size(resume);
+}
+
+uint64_t rudpResume_received(const rudpResume *resume) {
+    if (resume->marked == 0)
+        return 0;
+    uint64_t bytes = resume->marked << resume->shift;
+    // The last chunk is shorter than the others
+    uint64_t last = resume->chunks - 1;
+    if (resume->bits[last / 8] >> (last % 8) & 1)
+        bytes -= (resume->chunks << resume->shift) - resume->size;
+    return bytes;
+}
+
+void rudpResume_mark(rudpResume *resume, uint64_t offset, uint64_t len) {
+    uint64_t chunk_size = (uint64_t)1 << resume->shift;
+    uint64_t end = offset + len < resume->size ? offset + len : resume->size;
+    while (offset < end) {
+        uint64_t i = offset >> resume->shift;
+        uint64_t chunk_start = i << resume->shift;
+        // The last chunk ends at the end of the transfer
+        uint64_t chunk_end = resume->size - chunk_start > chunk_size ? chunk_start + chunk_size : resume->size;
+        uint64_t n = (end < chunk_end ? end : chunk_end) - offset;
+        offset += n;
+        unsigned char bit = 1 << (i % 8);
+        if (resume->bits[i / 8] & bit)
+            continue;
+        resume->written[i] += n;
+        if (resume->written[i] < chunk_end - chunk_start)
+            continue;
+        resume->bits[i / 8] |= bit;
+        resume->marked++;
+        resume->dirty = 1;
+    }
+}
+
+void rudpResume_clear(rudpResume *resume, uint64_t offset, uint64_t len) {
+    if (len == 0 || offset >= resume->size)
+        return;
+    uint64_t last = (offset + len - 1) >> resume->shift;
+    for (uint64_t i = offset >> resume->shift; i <= last && i < resume->chunks; i++) {
+        resume->written[i] = 0;
+        unsigned char bit = 1 << (i % 8);
+        if (!(resume->bits[i / 8] & bit))
+            continue;
+        resume->bits[i / 8] &= ~bit;
+        resume->marked--;
+        resume->dirty = 1;
+    }
+}
+
+int rudpResume_complete(const rudpResume *resume) {
+    return resume->marked == resume->chunks;
+}
+
+int rudpResume_save(rudpResume *resume) {
+    if (!resume->dirty || resume->removed)
+        return 0;
+    // Another connection of the same transfer (the Sender came back while its old connection lingered) saved a newer
+    // bitmap or completed the transfer: this one is stale and never saved again
+    if (file_changed(resume)) {
+        resume->removed = 1;
+        return 0;
+    }
+    char tmp[strlen(resume->path) + 5];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", resume->path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return -1;
+    unsigned char header[RESUME_HEADER_SIZE];
+    memcpy(header, RESUME_MAGIC, RESUME_MAGIC_SIZE);
+    put_u64(header + RESUME_MAGIC_SIZE, resume->transfer_id);
+    put_u64(header + RESUME_MAGIC_SIZE + 8, resume->size);
+    header[RESUME_HEADER_SIZE - 1] = (unsigned char)resume->shift;
+    size_t len = bits_size(resume);
+    // No fsync: a crash may lose the last saves, or leave a file resume_load refuses, which only sends more again
+    if (write(fd, header, sizeof(header)) != (ssize_t)sizeof(header) || write(fd, resume->bits, len) != (ssize_t)len) {
+        int error = errno;
+        close(fd);
+        unlink(tmp);
+        errno = error;
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp, resume->path) == -1)
+        return -1;
+    file_record(resume, -1);
+    resume->dirty = 0;
+    return 0;
+}
+
+void rudpResume_remove(rudpResume *resume) {
+    unlink(resume->path);
+    resume->removed = 1;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Resumable transfers: a transfer is the bytes of the files of a session one after the other, cut into chunks.
+ * The Receiver keeps a bitmap of the chunks of every transfer it received, and saves it to a file now and then.
+ * A Sender that comes back for the same transfer (the same files) sends a request in its SYN, gets the bitmap in the
+ * ACK of the SYN and sends only the chunks that are missing (see rudpConn_set_resume and rudpSession_resume_files).
+ *   Request (SYN):          ID of the transfer (8 bytes), size of the transfer (8 bytes)
+ *   State (ACK of the SYN): chunk size as a power of 2 (1 byte), then bit i % 8 of byte i / 8 for chunk i
+ * Multi-byte fields are in network byte order. Chunks are of at least 64KB, and a transfer has at most
+ * RUDP_RESUME_MAX_CHUNKS of them, so the state always fits in the ACK of the SYN (RUDP_MAX_RESUME).
+ */
+
+#define RUDP_RESUME_REQUEST_SIZE 16
+#define RUDP_RESUME_MAX_CHUNKS 8192
+#define RUDP_RESUME_MIN_SHIFT 16
+#define RUDP_RESUME_MAX_STATE (1 + RUDP_RESUME_MAX_CHUNKS / 8)
+
+/*
+ * Writes the request of the transfer transfer_id of size bytes to request (RUDP_RESUME_REQUEST_SIZE bytes), returns its size.
+ */
+size_t rudpResume_request(unsigned char *request, uint64_t transfer_id, uint64_t size);
+
+/*
+ * Sender: the chunk size of a state the Receiver sent, 0 if the state is malformed.
+ */
+uint64_t rudpResume_chunk_size(const unsigned char *state, size_t len);
+
+/*
+ * Sender: 1 if the Receiver has chunk i of the state, 0 if it's missing.
+ */
+int rudpResume_has_chunk(const unsigned char *state, size_t len, uint64_t chunk);
+
+struct _rudpResume;
+typedef struct _rudpResume rudpResume;
+
+/*
+ * Receiver: the bitmap of the transfer a request asks for, loaded from the file at path if it holds the bitmap of the
+ * same transfer, or empty (the first rudpResume_save then writes the file). NULL if the request is malformed, or on
+ * allocation error.
+ * It's the user responsibility to free it with rudpResume_free.
+ */
+rudpResume *rudpResume_open(const char *path, const void *request, size_t len);
+
+/*
+ * Saves the bitmap if it changed since it was loaded or saved, and frees it.
+ */
+void rudpResume_free(rudpResume *resume);
+
+/*
+ * Writes the state of the transfer to state (RUDP_RESUME_MAX_STATE bytes at most), for the ACK of the SYN.
+ * Returns its size, 0 if no chunk was received yet (there's nothing to resume).
+ */
+size_t rudpResume_state(const rudpResume *resume, unsigned char *state);
+
+/*
+ * Bytes of the transfer in the chunks that were received.
+ */
+uint64_t rudpResume_received(const rudpResume *resume);
+
+/*
+ * len bytes at offset of the transfer are durable (written and flushed to the disk). A chunk is marked once all its
+ * bytes are, the calls may come in any order (writes complete out of order), but every byte is counted once: it must
+ * be reported once.
+ */
+void rudpResume_mark(rudpResume *resume, uint64_t offset, uint64_t len);
+
+/*
+ * The bytes at offset of the transfer are bad (e.g. a file whose CRC32C doesn't match): every chunk they touch is
+ * unmarked and will be sent again.
+ */
+void rudpResume_clear(rudpResume *resume, uint64_t offset, uint64_t len);
+
+/*
+ * Returns 1 if every chunk of the transfer was received.
+ */
+int rudpResume_complete(const rudpResume *resume);
+
+/*
+ * Saves the bitmap to its file (through a temporary file renamed over it) if it changed, without flushing it to the
+ * disk: a crash may leave an older bitmap, or one rudpResume_open refuses, never one that marks bytes that aren't there.
+ * A file another bitmap of the transfer saved or removed since this one was loaded or saved is newer: it's left alone,
+ * and this bitmap isn't saved anymore. Returns 0, or -1 on error (errno is set).
+ */
+int rudpResume_save(rudpResume *resume);
+
+/*
+ * The transfer is done: removes the file of the bitmap, it isn't saved anymore.
+ */
+void rudpResume_remove(rudpResume *resume);
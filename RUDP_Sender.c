@@ -1,36 +1,426 @@
 #include "RUDP_API.h"
+#include "RUDP_Session.h"
+#include "RUDP_Rand.h"
+#include "RUDP_Resume.h"
+#include "RUDP_Stats.h"
+#include <math.h>
 
-#define MAX_BUFFER_SIZE 2048  
+#define MAX_FILES 64 // -f may be given this many times
 
-char *util_generate_random_data(unsigned int size) {
-    char *buffer = NULL;
-    // Argument check.
-    if (size == 0)
+// Load generation (-load): the messages of a connection that are queued or in flight take about LOAD_BUFFER_BYTES
+// (LOAD_MIN_OUTSTANDING to LOAD_MAX_OUTSTANDING messages), and a late connection may catch up on LOAD_BURST_US of its rate
+#define LOAD_BUFFER_BYTES (8 * 1024 * 1024)
+#define LOAD_MIN_OUTSTANDING 2
+#define LOAD_MAX_OUTSTANDING 256
+#define LOAD_MAX_SIZE (256 * 1024 * 1024)
+#define LOAD_MAX_CONNECTIONS 1024
+#define LOAD_BURST_US 10000
+
+// Size distributions of the load's messages
+#define SIZES_FIXED 0 // fixed:N
+#define SIZES_UNIFORM 1 // uniform:MIN:MAX
+#define SIZES_EXP 2 // exp:MEAN, at most 16 times the mean
+#define SIZES_PARETO 3 // pareto:MIN:ALPHA, at most 1024 times the minimum
+
+// Options of the connections, from the command line
+typedef struct _senderOptions {
+    unsigned int window;
+    const ccOps *cc;
+    int offload;
+    int crc;
+    unsigned int mtu;
+    int fec;
+    unsigned int fec_block;
+    unsigned int fec_parity;
+    int fec_adaptive;
+    int engine; // RUDP_ENGINE_*
+    int compress;
+} senderOptions;
+
+typedef struct _loadSizes {
+    int distribution;
+    double a, b; // Its parameters
+    uint64_t max;
+} loadSizes;
+
+// A message of the load: a file of the session (see RUDP_Session.h), so the Receiver checks its CRC32C and times it
+typedef struct _loadMessage {
+    unsigned char begin[RUDP_SESSION_BEGIN_MAX];
+    unsigned char end[RUDP_SESSION_END_SIZE];
+    char *payload; // Generated again for every message
+    uint64_t size;
+    uint64_t queued_at;
+} loadMessage;
+
+struct _loadRun;
+
+typedef struct _loadConn {
+    rudpConn *conn;
+    int sockfd;
+    int index;
+    struct _loadRun *run;
+    loadMessage *messages; // Ring of slots, message n is in slot n % slots (they complete in order)
+    unsigned int slots;
+    unsigned long queued;
+    unsigned long done;
+    uint64_t next_at; // The rate allows the next message at this time
+    int connected;
+    int closing;
+    int closed;
+    int failed;
+} loadConn;
+
+typedef struct _loadRun {
+    loadSizes sizes;
+    double rate; // Bytes per microsecond of a connection, 0 sends as fast as the window allows
+    rudpRand rng;
+    rudpHistogram *latencies; // Queued to acknowledged (microseconds)
+    uint64_t messages; // Acknowledged
+    uint64_t bytes;
+} loadRun;
+
+// Monotonic time in microseconds
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Write size random bytes to the file at path, a buffer at a time so the file can be larger than the memory
+int util_write_random_file(const char *path, unsigned int size) {
+    char buffer[64 * 1024];
+    FILE *file = fopen(path, "wb"); // wb - write binary
+    if (file == NULL)
+        return -1;
+    rudpRand rng;
+    rudp_rand_seed(&rng, now_us() ^ ((uint64_t)getpid() << 32));
+    while (size > 0) {
+        unsigned int n = size < sizeof(buffer) ? size : sizeof(buffer);
+        rudp_rand_fill(&rng, buffer, n);
+        if (fwrite(buffer, 1, n, file) != n) {
+            fclose(file);
+            return -1;
+        }
+        size -= n;
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+   
+// A connection with the options, on a new socket (stored in sockfd). Returns NULL on error.
+static rudpConn *sender_conn(const senderOptions *options, int *sockfd) {
+    *sockfd = rudp_socket();
+    if (*sockfd == -1)
+        return NULL;
+
+    // Create the state of the connection (window of packets in flight)
+    rudpConn *conn = rudpConn_alloc(*sockfd, options->window);
+    if (conn == NULL) {
+        perror("Connection allocation failed");
+        close(*sockfd);
         return NULL;
-    buffer = (char *)calloc(size, sizeof(char));
-    // Error checking.
-    if (buffer == NULL)
+    }
+    rudpConn_set_engine(conn, options->engine);
+    rudpConn_set_cc(conn, options->cc);
+    rudpConn_set_integrity(conn, options->crc ? RUDP_INTEGRITY_CRC32C : RUDP_INTEGRITY_CHECKSUM);
+    rudpConn_set_compression(conn, options->compress);
+    if (rudpConn_set_mtu(conn, options->mtu) == -1) {
+        fprintf(stderr, "The MTU must be between %d and %d.\n", RUDP_BASE_MTU, RUDP_MAX_MTU);
+        rudpConn_free(conn);
+        close(*sockfd);
+        return NULL;
+    }
+    if (options->fec != RUDP_FEC_OFF &&
+        rudpConn_set_fec(conn, options->fec, options->fec_block, options->fec_parity, options->fec_adaptive) == -1) {
+        fprintf(stderr, "FEC blocks are of 1 to %d packets, with 1 to %d parity packets (1 with XOR).\n", RUDP_FEC_MAX_BLOCK,
+                RUDP_FEC_MAX_PARITY);
+        rudpConn_free(conn);
+        close(*sockfd);
         return NULL;
-    // Randomize the seed of the random number generator.
-    srand(time(NULL));
-    for (unsigned int i = 0; i < size; i++)
-        *(buffer + i) = ((unsigned int)rand() % 256);
-    return buffer;
+    }
+    if (options->offload) {
+        int supported = rudpConn_set_offload(conn, 1);
+        printf("UDP offload: GSO %s, GRO %s\n", supported > 0 && (supported & RUDP_OFFLOAD_GSO) ? "on" : "off",
+               supported > 0 && (supported & RUDP_OFFLOAD_GRO) ? "on" : "off");
+    }
+    return conn;
 }
-   
+
+// Parse a size distribution (fixed:N, uniform:MIN:MAX, exp:MEAN or pareto:MIN:ALPHA), returns -1 if it's invalid
+static int load_parse_sizes(const char *spec, loadSizes *sizes) {
+    double a = 0, b = 0;
+    if (sscanf(spec, "fixed:%lf", &a) == 1) {
+        sizes->distribution = SIZES_FIXED;
+        sizes->max = (uint64_t)a;
+    } else if (sscanf(spec, "uniform:%lf:%lf", &a, &b) == 2 && b >= a) {
+        sizes->distribution = SIZES_UNIFORM;
+        sizes->max = (uint64_t)b;
+    } else if (sscanf(spec, "exp:%lf", &a) == 1) {
+        sizes->distribution = SIZES_EXP;
+        sizes->max = (uint64_t)(16 * a);
+    } else if (sscanf(spec, "pareto:%lf:%lf", &a, &b) == 2 && b > 0) {
+        sizes->distribution = SIZES_PARETO;
+        sizes->max = (uint64_t)(1024 * a);
+    } else {
+        return -1;
+    }
+    sizes->a = a;
+    sizes->b = b;
+    if (a < 1 || sizes->max > LOAD_MAX_SIZE)
+        return -1;
+    return 0;
+}
+
+// The size of the next message, 1 to sizes->max bytes
+static uint64_t load_size(const loadSizes *sizes, rudpRand *rng) {
+    double size;
+    double u = rudp_rand_double(rng);
+    switch (sizes->distribution) {
+    case SIZES_UNIFORM:
+        size = sizes->a + u * (sizes->b - sizes->a + 1);
+        break;
+    case SIZES_EXP:
+        size = -sizes->a * log1p(-u);
+        break;
+    case SIZES_PARETO:
+        size = sizes->a / pow(1 - u, 1 / sizes->b);
+        break;
+    default:
+        size = sizes->a;
+    }
+    if (size < 1)
+        size = 1;
+    return size > sizes->max ? sizes->max : (uint64_t)size;
+}
+
+static void load_on_connect(rudpConn *conn, int status, void *user) {
+    loadConn *c = (loadConn *)user;
+    (void)conn;
+    if (status == 1)
+        c->connected = 1;
+    else
+        c->failed = 1;
+}
+
+static void load_on_send(rudpConn *conn, uint64_t id, int64_t result, void *user) {
+    loadConn *c = (loadConn *)user;
+    loadMessage *message = &c->messages[id % c->slots];
+    (void)conn;
+    c->done++;
+    if (result < 0) {
+        c->failed = 1;
+        return;
+    }
+    c->run->messages++;
+    c->run->bytes += message->size;
+    rudpHistogram_record(c->run->latencies, now_us() - message->queued_at);
+}
+
+static void load_on_close(rudpConn *conn, int status, void *user) {
+    loadConn *c = (loadConn *)user;
+    (void)conn;
+    c->closed = 1;
+    if (status != 1)
+        c->failed = 1;
+}
+
+// Generate the next message of the connection and queue it. Returns -1 on error.
+static int load_queue(loadConn *c, uint64_t now) {
+    loadRun *run = c->run;
+    loadMessage *message = &c->messages[c->queued % c->slots];
+    char name[64];
+    snprintf(name, sizeof(name), "load-%d-%lu", c->index, c->queued);
+    message->size = load_size(&run->sizes, &run->rng);
+    rudp_rand_fill(&run->rng, message->payload, message->size);
+    struct iovec iov[3];
+    iov[0].iov_base = message->begin;
+    iov[0].iov_len = rudpSession_begin_frame(message->begin, name, message->size);
+    iov[1].iov_base = message->payload;
+    iov[1].iov_len = message->size;
+    iov[2].iov_base = message->end;
+    iov[2].iov_len = rudpSession_end_frame(message->end, crc32c(0, message->payload, message->size));
+    message->queued_at = now;
+    if (rudp_sendv_async(c->conn, iov, 3, c->queued) == -1)
+        return -1;
+    c->queued++;
+    if (run->rate > 0) {
+        // A token bucket: a connection that fell behind catches up on at most LOAD_BURST_US of its rate
+        if (c->next_at + LOAD_BURST_US < now)
+            c->next_at = now - LOAD_BURST_US;
+        c->next_at += (uint64_t)((message->size + iov[0].iov_len + iov[2].iov_len) / run->rate);
+    }
+    return 0;
+}
+
+// Load generation: connections parallel connections send generated messages for duration seconds, at rate Mbit/s
+// over all of them (0 is as fast as they can), then the summary is printed. Returns 0, or -1 if a connection failed.
+static int load_run(const senderOptions *options, const struct sockaddr *addr, socklen_t addrlen, const char *size_spec,
+                    double rate, double duration, int connections) {
+    loadRun run;
+    memset(&run, 0, sizeof(run));
+    if (load_parse_sizes(size_spec, &run.sizes) == -1) {
+        fprintf(stderr, "Invalid size distribution %s: fixed:N, uniform:MIN:MAX, exp:MEAN or pareto:MIN:ALPHA, "
+                        "messages of 1 byte to %d MB.\n", size_spec, LOAD_MAX_SIZE / (1024 * 1024));
+        return -1;
+    }
+    run.rate = rate * 1000000 / 8 / connections / 1000000; // Bytes per microsecond of a connection
+    rudp_rand_seed(&run.rng, now_us() ^ ((uint64_t)getpid() << 32));
+    run.latencies = rudpHistogram_alloc();
+    loadConn *conns = (loadConn *)calloc(connections, sizeof(loadConn));
+    struct pollfd *pfds = (struct pollfd *)calloc(connections, sizeof(struct pollfd));
+    if (run.latencies == NULL || conns == NULL || pfds == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    unsigned int slots = LOAD_BUFFER_BYTES / run.sizes.max;
+    slots = slots < LOAD_MIN_OUTSTANDING ? LOAD_MIN_OUTSTANDING : slots > LOAD_MAX_OUTSTANDING ? LOAD_MAX_OUTSTANDING : slots;
+
+    printf("Generating load: %d connection(s), %s, %s, for %.1fs (payload kernel %s)...\n", connections, size_spec,
+           rate > 0 ? "rate-limited" : "as fast as possible", duration, rudp_rand_kernel_name());
+    rudpAsyncCallbacks callbacks = { load_on_connect, load_on_send, load_on_close };
+    uint64_t start = now_us();
+    for (int i = 0; i < connections; i++) {
+        loadConn *c = &conns[i];
+        c->index = i;
+        c->run = &run;
+        c->slots = slots;
+        c->next_at = start;
+        c->messages = (loadMessage *)calloc(slots, sizeof(loadMessage));
+        if (c->messages == NULL) {
+            perror("Allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (unsigned int k = 0; k < slots; k++) {
+            c->messages[k].payload = (char *)malloc(run.sizes.max);
+            if (c->messages[k].payload == NULL) {
+                perror("Allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        c->conn = sender_conn(options, &c->sockfd);
+        if (c->conn == NULL || rudpConn_set_async(c->conn, &callbacks, c) == -1 || rudp_connect_async(c->conn, addr, addrlen) == -1)
+            exit(EXIT_FAILURE);
+        pfds[i].fd = rudpConn_fd(c->conn);
+        pfds[i].events = POLLIN;
+    }
+
+    uint64_t end = start + (uint64_t)(duration * 1000000);
+    int running = connections;
+    while (running > 0) {
+        uint64_t now = now_us();
+        int timeout = -1;
+        running = 0;
+        for (int i = 0; i < connections; i++) {
+            loadConn *c = &conns[i];
+            if (c->closed || c->failed)
+                continue;
+            running++;
+            if (!c->connected)
+                continue;
+            while (!c->closing && now < end && c->queued - c->done < c->slots && c->next_at <= now) {
+                if (load_queue(c, now) == -1) {
+                    c->failed = 1;
+                    break;
+                }
+            }
+            if (!c->closing && !c->failed && now >= end) {
+                // The FIN follows the messages that are still queued
+                c->closing = 1;
+                if (rudp_close_async(c->conn) == -1)
+                    c->failed = 1;
+            }
+            // Wake up for the rate and for the end of the run
+            int wait = -1;
+            if (!c->closing && c->queued - c->done < c->slots)
+                wait = c->next_at > now ? (int)((c->next_at - now + 999) / 1000) : 0;
+            if (!c->closing && (wait == -1 || (end - now + 999) / 1000 < (uint64_t)wait))
+                wait = (int)((end - now + 999) / 1000);
+            int conn_timeout = rudpConn_timeout(c->conn);
+            if (conn_timeout >= 0 && (wait == -1 || conn_timeout < wait))
+                wait = conn_timeout;
+            if (wait >= 0 && (timeout == -1 || wait < timeout))
+                timeout = wait;
+        }
+        if (running == 0)
+            break;
+        poll(pfds, connections, timeout);
+        for (int i = 0; i < connections; i++) {
+            loadConn *c = &conns[i];
+            if (!c->closed && !c->failed && rudpConn_poll(c->conn) == -1)
+                c->failed = 1;
+        }
+    }
+    double seconds = (now_us() - start) / 1000000.0;
+
+    // *** The summary of the run ***
+    unsigned long retransmits = 0, timeouts = 0;
+    int failed = 0;
+    for (int i = 0; i < connections; i++) {
+        loadConn *c = &conns[i];
+        rudpConnStats stats;
+        rudpConn_stats(c->conn, &stats);
+        retransmits += stats.retransmits;
+        timeouts += stats.timeouts;
+        failed += c->failed;
+        rudpConn_free(c->conn);
+        close(c->sockfd);
+        for (unsigned int k = 0; k < c->slots; k++)
+            free(c->messages[k].payload);
+        free(c->messages);
+    }
+    printf("----------------------------------\n");
+    printf("- * Load summary * -\n");
+    printf("- Connections: %d (%d failed), %.2fs\n", connections, failed, seconds);
+    printf("- Messages: %lu, %.2fMB, %.0f messages/s, %.2fMbit/s\n", (unsigned long)run.messages, run.bytes / (1024.0 * 1024.0),
+           run.messages / seconds, run.bytes * 8 / seconds / 1000000);
+    printf("- Retransmits: %lu, timeouts: %lu\n", retransmits, timeouts);
+    if (run.messages > 0)
+        printf("- Message latency (ms): min=%.3f p50=%.3f p99=%.3f p99.9=%.3f max=%.3f\n",
+               rudpHistogram_min(run.latencies) / 1000.0, rudpHistogram_percentile(run.latencies, 0.5) / 1000.0,
+               rudpHistogram_percentile(run.latencies, 0.99) / 1000.0, rudpHistogram_percentile(run.latencies, 0.999) / 1000.0,
+               rudpHistogram_max(run.latencies) / 1000.0);
+    printf("----------------------------------\n");
+    rudpHistogram_free(run.latencies);
+    free(conns);
+    free(pfds);
+    return failed > 0 ? -1 : 0;
+}
+
 int main(int argc, char *argv[]) {
 
     // *** Pre-Parts : Get from the user the command from terminal ***
 
-    // Expecting 6 arguments in total (excluding the program name)
-    if (argc != 5) {       // ./RUDP_Sender -ip 127.0.0.1 -p 12345 
-        fprintf(stderr, "Please provide the correct usage for the program: %s -ip <IP> -p <PORT>\n", argv[0]);
+    // Expecting 4 arguments (excluding the program name), and optionally the window size, the congestion controller
+    // and UDP segmentation offload for the bulk transfer, the files to send, CRC32C instead of the checksum, a fixed MTU
+    // forward error correction, the log level of the library, the I/O engine of the socket, resuming an interrupted transfer and compressing the files. -load generates messages instead of sending files,
+    // without any question, on parallel connections at a target rate
+    if (argc < 5 || argc % 2 == 0) {       // ./RUDP_Sender -ip 127.0.0.1 -p 12345 [-w 64] [-cc newreno] [-offload on] [-f file]... [-crc on] [-mtu 1500] [-fec rs] [-log debug] [-engine uring] [-resume on] [-compress on] [-load exp:65536 -rate 100 -duration 10 -conns 4]
+        fprintf(stderr, "Please provide the correct usage for the program: %s -ip <IP> -p <PORT> [-w <WINDOW>] [-cc newreno|delay] [-offload on|off] [-f <FILE>]... [-crc on|off] [-mtu <MTU>|auto] [-fec off|xor|rs[:<BLOCK>:<PARITY>]] [-log off|error|warn|info|debug] "
+                        "[-engine syscall|uring] [-resume on|off] [-compress on|off] [-load fixed:N|uniform:MIN:MAX|exp:MEAN|pareto:MIN:ALPHA [-rate <MBIT/S>] [-duration <SECONDS>] [-conns <N>]]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
     // Extract command-line arguments
     const char *ip_address = NULL;
     int port = 0;
+    unsigned int window = RUDP_DEFAULT_WINDOW; // Number of packets in flight before waiting for ACKs
+    const ccOps *cc = &cc_newreno; // Congestion controller
+    int offload = 0; // UDP GSO/GRO
+    const char *file_paths[MAX_FILES]; // Files to send back to back, a random file is created if none is given
+    int file_count = 0;
+    int remove_file = 0;
+    int crc = 0; // Ask the Receiver for CRC32C
+    unsigned int mtu = 0; // Size the packets to a fixed MTU, 0 discovers the path MTU
+    int fec = RUDP_FEC_OFF; // FEC blocks of fec_block data packets, with fec_parity parity packets (at most, if adaptive)
+    unsigned int fec_block = 16, fec_parity = 4;
+    int fec_adaptive = 1;
+    int log_level = RUDP_LOG_INFO; // Messages of the library (debug: every retransmission)
+    int engine = RUDP_ENGINE_SYSCALL; // sendmmsg/recvmmsg, or io_uring
+    int resume = 0; // Send only what the Receiver misses of an earlier attempt to send the same files
+    int compress = 0; // Ask the Receiver for compressed chunks
+    const char *load = NULL; // Size distribution of the generated messages, NULL sends files
+    double load_rate = 0; // Mbit/s over all the connections, 0 is as fast as possible
+    double load_duration = 10; // Seconds
+    int load_conns = 1;
    
     // Process command-line arguments
     for (int i = 1; i < argc; i++) {
@@ -40,78 +430,69 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
             port = atoi(argv[i + 1]); // Convert a string representing an integer (ASCII string) to an integer value.
             i++;
-        } 
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            window = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-cc") == 0 && i + 1 < argc) {
+            cc = cc_find(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-offload") == 0 && i + 1 < argc) {
+            offload = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc && file_count < MAX_FILES) {
+            file_paths[file_count++] = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-crc") == 0 && i + 1 < argc) {
+            crc = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-mtu") == 0 && i + 1 < argc) {
+            mtu = strcmp(argv[i + 1], "auto") == 0 ? 0 : atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-fec") == 0 && i + 1 < argc) {
+            // xor and rs: blocks of 16 packets, XOR's single parity packet or up to 4 following the loss rate.
+            // An explicit block and parity are fixed.
+            fec = strncmp(argv[i + 1], "xor", 3) == 0 ? RUDP_FEC_XOR : strncmp(argv[i + 1], "rs", 2) == 0 ? RUDP_FEC_RS : RUDP_FEC_OFF;
+            if (fec == RUDP_FEC_XOR)
+                fec_parity = 1;
+            const char *spec = strchr(argv[i + 1], ':');
+            if (spec != NULL && sscanf(spec, ":%u:%u", &fec_block, &fec_parity) == 2)
+                fec_adaptive = 0;
+            i++;
+        } else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc) {
+            log_level = rudp_log_parse_level(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            engine = strcmp(argv[i + 1], "uring") == 0 ? RUDP_ENGINE_URING : strcmp(argv[i + 1], "syscall") == 0 ? RUDP_ENGINE_SYSCALL : -1;
+            i++;
+        } else if (strcmp(argv[i], "-resume") == 0 && i + 1 < argc) {
+            resume = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-compress") == 0 && i + 1 < argc) {
+            compress = strcmp(argv[i + 1], "on") == 0;
+            i++;
+        } else if (strcmp(argv[i], "-load") == 0 && i + 1 < argc) {
+            load = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-rate") == 0 && i + 1 < argc) {
+            load_rate = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-duration") == 0 && i + 1 < argc) {
+            load_duration = atof(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-conns") == 0 && i + 1 < argc) {
+            load_conns = atoi(argv[i + 1]);
+            i++;
+        }
     }
 
    // Check if required arguments are provided
-    if (ip_address == NULL || port == 0) {
+    if (ip_address == NULL || port == 0 || window == 0 || cc == NULL || log_level == -1 || engine == -1 || load_rate < 0 || load_duration <= 0 ||
+        load_conns <= 0 || load_conns > LOAD_MAX_CONNECTIONS) {
         fprintf(stderr, "Invalid arguments. Please provide the correct usage.\n");
         exit(EXIT_FAILURE);
     }
-
-    
-    // *** Part A: Create file and read it ***
-
-    // Create File 
-    const char *file_path = "random_data.txt"; // Adjust file path as needed
-    unsigned int min_size = 2*1024*1024; // At least file with 2MB size
-    unsigned int size;
-    
-    // Seed the random number generator with the current time
-    srand(time(NULL));
-    // Generate a random size greater than or equal to the minimum size
-    size = min_size + (rand() % (5 * 1024 * 1024)); // Generate between 2MB to 7MB to make sure the file is at least 2MB
-    
-    // Step 1: Generate random data
-    char *data = util_generate_random_data(size);
-    
-    // Step 2: Check if random data generation failed
-    if (data == NULL) {
-        perror("Random data generation failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Step 3: Create and write data to file
-    FILE *file = fopen(file_path, "wb"); // wb - write binary
-    if (!file) {
-        perror("File creation failed");
-        free(data);
-        exit(EXIT_FAILURE);
-    }
-    fwrite(data, 1, size, file);
-    fclose(file);
-    
-    // Read the file
-    // Step 1: open data from file for reading
-    fopen(file_path, "rb"); // rb - read binary
-    if (!file) {
-        perror("File open for reading failed");
-        free(data);
-        exit(EXIT_FAILURE);
-    }
-
-    // Step 2: Read the entire file
-    if (fread(data, 1, size, file) != size) {
-    perror("Error reading file");
-    fclose(file);
-    free(data);
-    exit(EXIT_FAILURE);
-    }
-
-    // *** Part B: Create UDP socket between Sender - Receiver ***
-    
-    printf("Starting Sender...\n");
-
-    //creat socket
-    int _sockfd = rudp_socket();
-    if (_sockfd == -1){
-        free(data);
-        return -1;
-    }
-
-    // Define a timeout for Sender to receive ACK
-    // According to the article you published,the vaild range for Timeout is 0 to 65536 (in ms), so I chose 10000ms randomly
-    struct timeval timeout = {0,15530};
+    rudp_log_set_level(log_level);
+    senderOptions options = { window, cc, offload, crc, mtu, fec, fec_block, fec_parity, fec_adaptive, engine, compress };
 
     //create receiver address struct
     struct sockaddr_in server_address; // Struct sockaddr_in is defined in the <netinet/in.h> header file.
@@ -121,8 +502,6 @@ int main(int argc, char *argv[]) {
     server_address.sin_port = htons(port); // htons() function ensures that the port number is properly formatted for network communication, regardless of the byte order of the host machine.
     int rval = inet_pton(AF_INET, ip_address, &server_address.sin_addr); // inet_pton() is a function that converts an IPv4 address in string format to a binary format 
     if (rval <= 0){
-        close(_sockfd);
-        free(data);
 		printf("inet_pton() failed");
 		return -1;
 	}
@@ -130,71 +509,125 @@ int main(int argc, char *argv[]) {
     // The variable to store the server's address length.
     socklen_t server_len = sizeof(server_address);
 
-    // Since in UDP there is no connection, there isn't a guarantee that the server is up and running.
-    // Therefore, we set a timeout for the recvfrom() call using the setsockopt function.
-    // If the server (RUDP_Receiver) does not respond within the timeout, the client (RUDP_Sender) will drop.
-    if (setsockopt(_sockfd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout)) == -1) {
-        perror("setsockopt() failed");
-        close(_sockfd);
-        free(data);
-        return -1;
+    // Load generation runs on its own, without files or questions
+    if (load != NULL)
+        return load_run(&options, (struct sockaddr *)&server_address, server_len, load, load_rate, load_duration, load_conns) == 0 ?
+               0 : EXIT_FAILURE;
+
+    
+    // *** Part A: Create the file, or use the ones given with -f ***
+
+    uint64_t size = 0; // Of all the files
+    if (file_count == 0) {
+        const char *file_path = "random_data.txt"; // Adjust file path as needed
+        unsigned int min_size = 2*1024*1024; // At least file with 2MB size
+
+        // Generate a random size greater than or equal to the minimum size
+        rudpRand rng;
+        rudp_rand_seed(&rng, now_us());
+        size = min_size + rudp_rand_next(&rng) % (5 * 1024 * 1024); // Generate between 2MB to 7MB to make sure the file is at least 2MB
+
+        // Write random data to the file, it's sent from the file itself and never read back into memory
+        if (util_write_random_file(file_path, size) == -1) {
+            perror("File creation failed");
+            exit(EXIT_FAILURE);
+        }
+        file_paths[file_count++] = file_path;
+        remove_file = 1;
+    } else {
+        for (int i = 0; i < file_count; i++) {
+            struct stat st;
+            if (stat(file_paths[i], &st) == -1) {
+                perror("File open for reading failed");
+                exit(EXIT_FAILURE);
+            }
+            size += st.st_size;
+        }
     }
 
-    // The variable to store the server's address, that responded to the message.
-    // it is required by the recvfrom function (that included in rudp_handshake function)
-    // Note that the target server might be different from the server that responded to the message.
-    struct sockaddr_in respond_server;
+    // *** Part B: Create UDP socket between Sender - Receiver ***
+    
+    printf("Starting Sender...\n");
+
+    // Create the socket and the state of the connection (window of packets in flight)
+    int _sockfd;
+    rudpConn *conn = sender_conn(&options, &_sockfd);
+    if (conn == NULL)
+        return -1;
 
-    // The variable to store the respond server's address length.
-    socklen_t respond_server_len = sizeof(respond_server);
-    memset(&respond_server, 0, sizeof(respond_server));
+    // Since in UDP there is no connection, there isn't a guarantee that the server is up and running.
+    // The RUDP library waits for every ACK until a retransmission timeout that it measures from the RTT of the connection,
+    // if the server (RUDP_Receiver) does not respond after the retransmission attempts, the client (RUDP_Sender) will drop.
+
+    // The SYN asks the Receiver for what it has of these files, the ACK of the SYN tells it
+    if (resume) {
+        unsigned char request[RUDP_RESUME_REQUEST_SIZE];
+        int request_len = rudpSession_resume_request(request, file_paths, NULL, file_count);
+        if (request_len == -1 || rudpConn_set_resume(conn, request, request_len) == -1) {
+            perror("Resume request failed");
+            close(_sockfd);
+            return -1;
+        }
+    }
 
     // Ensure theres a handshake between Sender and Receiver
-    int handshake = handshake_connect(_sockfd, (struct sockaddr*)&server_address, server_len, (struct sockaddr*)&respond_server, &respond_server_len);
+    int handshake = handshake_connect(conn, (struct sockaddr*)&server_address, server_len);
     if (handshake != 1) {
         perror("Handshake failed");
         close(_sockfd);
-        free(data);
         return -1;
     }
 
-    printf("Receiver connected, beginning to send file...\n");
-
-    // *** Part C + D: Send the file via the RUDP protocol + User decision ***
-    
-    // Send the size of the file to the receiver
-    ssize_t size_sent = sendto(_sockfd, &size, sizeof(size),0,(const struct sockaddr *)&server_address, server_len);
-    if (size_sent < 0) {
-        perror("Error sending file size");
-        close(_sockfd);
-        free(data);
-        exit(EXIT_FAILURE);
-    }
+    printf("Receiver connected, beginning to send %d file(s) (window of %u packets, %s%s)...\n", file_count, rudpConn_window(conn),
+           rudpConn_integrity(conn) == RUDP_INTEGRITY_CRC32C ? "CRC32C" : "checksum", rudpConn_compression(conn) ? ", compressed" : "");
+    if (compress && !rudpConn_compression(conn))
+        printf("The Receiver doesn't take compressed files, they're sent as they are.\n");
 
+    // *** Part C + D: Send the files via the RUDP protocol + User decision ***
 
     int send_again = 1; // Flag to control the loop
+    uint64_t bytes_before = 0; // Bytes of the packets sent before the round
      while (send_again>0) {
-        // Send the file in chuncks to minimize packet loss and bad TCP
-        printf("Send the file...\n");
-        unsigned int sent_total = 0;
-        while (sent_total<size) {
-            unsigned int remaining = size - sent_total;
-            unsigned int chunk_size = remaining < MAX_BUFFER_SIZE ? remaining : MAX_BUFFER_SIZE;
-            // ssize_t vab for negtive num for erorrs
-            ssize_t sent = rudp_send(_sockfd, data+sent_total, chunk_size, (struct sockaddr*)&server_address, server_len, (struct sockaddr*)&respond_server, &respond_server_len);
-            if (sent < 0) {
-                perror("Error sending random data");
-                close(_sockfd);
-                free(data);
-                exit(EXIT_FAILURE);
-            }
-            sent_total += sent;
+        // Send the files in one session: every file is framed with its name, size and CRC32C, and the next file
+        // starts while the last packets of the one before it are in flight
+        printf("Send the file(s)...\n");
+        // The files are sent straight from mappings of them, without copying them into memory. The first time, a
+        // resumed transfer sends only the chunks the Receiver misses.
+        int64_t sent_total = resume ? rudpSession_resume_files(conn, file_paths, NULL, file_count) :
+                                      rudpSession_send_files(conn, file_paths, NULL, file_count);
+        if (sent_total == -1 || (!resume && sent_total != (int64_t)size)) {
+            perror("Error sending the file");
+            close(_sockfd);
+            exit(EXIT_FAILURE);
         }
         printf("Got ACK from Receiver.\n");
-        printf("a file with %u bytes has been sent successfully\n", sent_total);
+        printf("%d file(s) with %lu bytes have been sent successfully\n", file_count, (unsigned long)size);
+        if (resume && sent_total < (int64_t)size)
+            printf("Transfer resumed: %lu bytes sent, the Receiver had the other %lu bytes already\n", (unsigned long)sent_total,
+                   (unsigned long)(size - sent_total));
+        resume = 0;
+        rudpCCStats stats;
+        rudpConn_cc_stats(conn, &stats);
+        printf("RTT: %.3fms, RTO: %.3fms, path MTU: %u\n", rudpConn_srtt(conn) / 1000.0, rudpConn_rto(conn) / 1000.0, rudpConn_mtu(conn));
+        printf("Congestion control (%s): cwnd=%u, ssthresh=%u, pacing rate=%.2fMB/s, losses=%lu, timeouts=%lu, retransmits=%lu, ACKs=%lu\n",
+               cc->name, stats.cwnd, stats.ssthresh, stats.pacing_rate / (1024.0 * 1024.0), stats.losses, stats.timeouts, stats.retransmits,
+               stats.acks);
+        rudpConnStats counters;
+        rudpConn_stats(conn, &counters);
+        printf("Packets: sent=%lu (%lu bytes), RTT min/avg/max=%.3f/%.3f/%.3fms over %lu samples\n", (unsigned long)counters.packets_sent,
+               (unsigned long)counters.bytes_sent, counters.rtt_min / 1000.0, counters.rtt_avg / 1000.0, counters.rtt_max / 1000.0,
+               counters.rtt_samples);
+        if (rudpConn_compression(conn))
+            printf("Compression: %lu bytes of files in %lu bytes of packets (%.2fx, retransmissions included)\n",
+                   (unsigned long)sent_total, (unsigned long)(counters.bytes_sent - bytes_before),
+                   counters.bytes_sent > bytes_before ? (double)sent_total / (counters.bytes_sent - bytes_before) : 0.0);
+        bytes_before = counters.bytes_sent;
+        if (fec != RUDP_FEC_OFF)
+            printf("FEC (%s): parity packets=%lu, parity per block=%u\n", fec == RUDP_FEC_RS ? "Reed-Solomon" : "XOR",
+                   stats.parity, stats.fec_parity);
 
         // Ask user for decision
-        printf("Do you want to send the file again? (yes/no): ");
+        printf("Do you want to send the file(s) again? (yes/no): ");
         
         // Get only valid answers - yes or no 
         int valid_char = 0;
@@ -202,13 +635,7 @@ int main(int argc, char *argv[]) {
             char decision[4];
             scanf("%s",decision);
             if(strcmp(decision, "no")==0 || strcmp(decision, "yes")==0) {
-                ssize_t send_decision = sendto(_sockfd, decision, strlen(decision),0, (struct sockaddr*)&server_address, server_len);
-                if(send_decision < 0){
-                    perror("Error sending decision");
-                    close(_sockfd);
-                    free(data);
-                    exit(EXIT_FAILURE);
-                }
+                // The Receiver learns about the next files from their Begin frames, and about the end from the FIN
                 if (strcmp(decision, "no")==0) {
                     send_again = 0; // If decision is not "yes", exit loop
                 }
@@ -221,16 +648,16 @@ int main(int argc, char *argv[]) {
     }
 
     // *** Part E+ F: Send exit message to the receiver + Close the RUDP connection ***
-    int close_connection = rdup_close(_sockfd, (struct sockaddr*)&server_address, server_len, (struct sockaddr*)&respond_server, &respond_server_len);
+    int close_connection = rdup_close(conn);
     if (close_connection != 1) {
         perror("disconnect failed");
         close(_sockfd);
-        free(data);
         return -1;
     }
+    rudpConn_free(conn);
     close(_sockfd);
-    free(data);
-    remove(file_path); // Remove temporary file
+    if (remove_file)
+        remove(file_paths[0]); // Remove temporary file
 
     // *** Part G: Exit ***
     return 0;
@@ -0,0 +1,600 @@
+#include "RUDP_Session.h"
+#include "RUDP_Resume.h"
+#include "RUDP_LZ.h"
+
+#define FRAME_BEGIN 'B'
+#define FRAME_PARTIAL 'P'
+#define FRAME_RANGE 'R'
+#define FRAME_END 'E'
+#define FRAME_CHUNKED_BEGIN 'C'
+#define FRAME_CHUNKED_PARTIAL 'Q'
+#define FRAME_CHUNK 'Z'
+#define BEGIN_HEADER_SIZE 11 // Type, size, length of the name
+#define RANGE_SIZE 17 // Type, offset, length
+#define END_SIZE RUDP_SESSION_END_SIZE // Type, CRC32C
+#define CHUNK_HEADER_SIZE 10 // Type, flags, raw length, stored length
+#define FRAMES_SIZE (END_SIZE + BEGIN_HEADER_SIZE + RUDP_SESSION_MAX_NAME) // The End of a file and the Begin of the next one
+
+#define CHUNK_LZ 0x01 // Flag of a chunk whose bytes are compressed
+#define CHUNK_SIZE RUDP_LZ_MAX_INPUT // Raw bytes compressed at a time
+#define CHUNK_MAX_BACKOFF 64 // Most chunks sent raw without trying them after an incompressible one
+
+// Files sent with one rudp_sendv, all of them are mapped at the same time
+#define SESSION_GROUP 16
+
+// The output of a group: the iovecs rudp_sendv sends, and the buffer of the frames (and of the compressed chunks) they
+// point to, along with the mappings of the files. The group is sent when either of them is full, and when it ends.
+#define OUT_IOV 1024
+#define OUT_BUFFER (64 * 1024)
+#define OUT_COMPRESSED_BUFFER (4 * 1024 * 1024)
+
+// A file of a group: its mapping, the frames in front of it, and the Range frames of a partial file
+typedef struct _sessionFile {
+    char *map;
+    size_t size;
+    unsigned char frames[FRAMES_SIZE];
+    size_t frames_len;
+    unsigned char *ranges; // RANGE_SIZE bytes per range, NULL for a whole file
+    int range_count;
+} sessionFile;
+
+typedef struct _sessionOut {
+    rudpConn *conn;
+    struct iovec iov[OUT_IOV];
+    int iovcnt;
+    unsigned char *buffer;
+    size_t buffer_size;
+    size_t buffer_len;
+    int compress; // The data of the files goes in chunk frames
+    unsigned int backoff; // Chunks sent raw after the last incompressible one
+} sessionOut;
+
+// Parser state: reading a frame, the bytes of a file, or the stored bytes of a compressed chunk
+#define READ_FRAME 0
+#define READ_DATA 1
+#define READ_CHUNK 2
+
+struct _rudpSessionReader {
+    rudpSessionCallbacks callbacks;
+    void *user;
+    int state;
+    unsigned char frame[BEGIN_HEADER_SIZE + RUDP_SESSION_MAX_NAME]; // The frame read so far
+    unsigned int frame_len;
+    uint64_t remaining; // Bytes of the file (or of its range) that didn't arrive yet
+    uint64_t data_left; // Bytes before the next frame (of the file, or of its chunk)
+    uint32_t crc; // CRC32C of the bytes of the file that arrived
+    int in_file; // Between the Begin (or Partial) frame of a file and its End frame
+    int partial; // The file began with a Partial frame, its bytes come in Range frames
+    int chunked; // The file began with a chunked frame, its bytes come in chunk frames
+    uint64_t size; // Size of the file
+    unsigned char *chunk; // The stored bytes of a compressed chunk, and the bytes they decompress to (allocated with the first one)
+    unsigned char *raw;
+    uint32_t chunk_len;
+    uint32_t raw_len;
+};
+
+static void put_u16(unsigned char *p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (24 - 8 * i);
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    put_u32(p, (uint32_t)(value >> 32));
+    put_u32(p + 4, (uint32_t)value);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    return (uint64_t)get_u32(p) << 32 | get_u32(p + 4);
+}
+
+// Write the End frame of a file with the given CRC32C, returns its size
+static size_t frame_end(unsigned char *p, uint32_t crc) {
+    p[0] = FRAME_END;
+    put_u32(p + 1, crc);
+    return END_SIZE;
+}
+
+// Write the Begin frame of a file (or the Partial frame, with type FRAME_PARTIAL), returns its size
+static size_t frame_begin(unsigned char *p, char type, const char *name, uint64_t size) {
+    size_t name_len = strlen(name);
+    p[0] = type;
+    put_u64(p + 1, size);
+    put_u16(p + 9, (uint16_t)name_len);
+    memcpy(p + BEGIN_HEADER_SIZE, name, name_len);
+    return BEGIN_HEADER_SIZE + name_len;
+}
+
+size_t rudpSession_begin_frame(unsigned char *frame, const char *name, uint64_t size) {
+    if (strlen(name) > RUDP_SESSION_MAX_NAME)
+        return 0;
+    return frame_begin(frame, FRAME_BEGIN, name, size);
+}
+
+size_t rudpSession_end_frame(unsigned char *frame, uint32_t crc) {
+    return frame_end(frame, crc);
+}
+
+// Map a file read-only, an empty file isn't mapped. Returns -1 on error.
+static int session_map(sessionFile *file, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "File open failed");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "File stat failed");
+        close(fd);
+        return -1;
+    }
+    file->size = st.st_size;
+    file->map = NULL;
+    if (file->size > 0) {
+        file->map = (char *)mmap(NULL, file->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (file->map == MAP_FAILED) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "File mapping failed");
+            file->map = NULL;
+            close(fd);
+            return -1;
+        }
+        madvise(file->map, file->size, MADV_SEQUENTIAL);
+    }
+    close(fd); // The mapping stays valid
+    return 0;
+}
+
+// The name a file is sent with: its names entry, or the base name of its path
+static const char *session_name(const char *const *paths, const char *const *names, int i) {
+    if (names != NULL)
+        return names[i];
+    const char *name = strrchr(paths[i], '/');
+    return name != NULL ? name + 1 : paths[i];
+}
+
+// Write the Range frames of the bytes of a file at base in the transfer that are in the chunks the Receiver misses
+// (consecutive missing chunks make one range) to file->ranges, or only count them if it's NULL. Returns their number.
+static int session_ranges(sessionFile *file, uint64_t base, const unsigned char *state, size_t state_len) {
+    uint64_t chunk_size = rudpResume_chunk_size(state, state_len);
+    int count = 0;
+    uint64_t start = 0; // Offset in the file of the range being built
+    int open = 0;
+    for (uint64_t offset = 0; offset < file->size;) {
+        uint64_t chunk = (base + offset) / chunk_size;
+        uint64_t end = (chunk + 1) * chunk_size - base; // End of the chunk, in the file
+        if (end > file->size)
+            end = file->size;
+        int missing = !rudpResume_has_chunk(state, state_len, chunk);
+        if (missing && !open) {
+            start = offset;
+            open = 1;
+        }
+        if (open && (!missing || end == file->size)) {
+            uint64_t range_end = missing ? end : offset;
+            if (file->ranges != NULL) {
+                unsigned char *p = file->ranges + (size_t)count * RANGE_SIZE;
+                p[0] = FRAME_RANGE;
+                put_u64(p + 1, start);
+                put_u64(p + 9, range_end - start);
+            }
+            count++;
+            open = 0;
+        }
+        offset = end;
+    }
+    return count;
+}
+
+// Turn a mapped file into a partial one: the ranges the Receiver misses. A file it misses entirely (or an empty one)
+// stays whole. Returns 0, or -1 on allocation error.
+static int session_partial(sessionFile *file, uint64_t base, const unsigned char *state, size_t state_len) {
+    int count = session_ranges(file, base, state, state_len);
+    file->ranges = (unsigned char *)malloc((size_t)count * RANGE_SIZE + 1);
+    if (file->ranges == NULL)
+        return -1;
+    file->range_count = session_ranges(file, base, state, state_len);
+    if (file->size == 0 || (file->range_count == 1 && get_u64(file->ranges + 9) == file->size)) {
+        free(file->ranges);
+        file->ranges = NULL;
+    }
+    return 0;
+}
+
+// Send what was queued, returns -1 on error
+static int out_flush(sessionOut *out) {
+    if (out->iovcnt > 0 && rudp_sendv(out->conn, out->iov, out->iovcnt) == -1)
+        return -1;
+    out->iovcnt = 0;
+    out->buffer_len = 0;
+    return 0;
+}
+
+// Make room for len bytes in the buffer and two iovecs, sending what was queued if there isn't. Returns -1 on error.
+static int out_reserve(sessionOut *out, size_t len) {
+    if (out->buffer_len + len <= out->buffer_size && out->iovcnt + 2 <= OUT_IOV)
+        return 0;
+    return out_flush(out);
+}
+
+// Queue len bytes of memory that stays valid until the next flush
+static void out_iov(sessionOut *out, const void *data, size_t len) {
+    struct iovec *last = out->iovcnt > 0 ? &out->iov[out->iovcnt - 1] : NULL;
+    if (last != NULL && (const char *)last->iov_base + last->iov_len == (const char *)data) {
+        last->iov_len += len; // Right after the bytes queued last (e.g. a frame and the chunk after it), in the same iovec
+        return;
+    }
+    out->iov[out->iovcnt].iov_base = (void *)data;
+    out->iov[out->iovcnt++].iov_len = len;
+}
+
+// Queue the len bytes written at the end of the buffer (after out_reserve)
+static void out_commit(sessionOut *out, size_t len) {
+    out_iov(out, out->buffer + out->buffer_len, len);
+    out->buffer_len += len;
+}
+
+// Queue a copy of a frame, returns -1 on error
+static int out_frame(sessionOut *out, const void *frame, size_t len) {
+    if (out_reserve(out, len) == -1)
+        return -1;
+    memcpy(out->buffer + out->buffer_len, frame, len);
+    out_commit(out, len);
+    return 0;
+}
+
+static void chunk_header(unsigned char *p, unsigned char flags, uint32_t raw_len, uint32_t stored_len) {
+    p[0] = FRAME_CHUNK;
+    p[1] = flags;
+    put_u32(p + 2, raw_len);
+    put_u32(p + 6, stored_len);
+}
+
+// Queue len bytes of a mapped file: as they are, or as chunk frames if the session is compressed. A chunk that doesn't
+// shrink by more than a 16th goes raw, along with the next backoff chunks that aren't even tried: the backoff doubles
+// with every chunk that fails and is cleared by one that compresses, so a file of random data costs next to nothing to
+// try and a file whose content changes compresses again. Returns -1 on error.
+static int out_data(sessionOut *out, const char *data, uint64_t len) {
+    if (!out->compress) {
+        if (len > 0 && out_reserve(out, 0) == -1)
+            return -1;
+        if (len > 0)
+            out_iov(out, data, len);
+        return 0;
+    }
+    while (len > 0) {
+        size_t n = len < CHUNK_SIZE ? (size_t)len : CHUNK_SIZE;
+        if (out_reserve(out, CHUNK_HEADER_SIZE + n) == -1)
+            return -1;
+        unsigned char *p = out->buffer + out->buffer_len;
+        size_t stored = rudp_lz_compress(data, n, p + CHUNK_HEADER_SIZE, n - n / 16 - 1);
+        if (stored > 0) {
+            chunk_header(p, CHUNK_LZ, n, stored);
+            out_commit(out, CHUNK_HEADER_SIZE + stored);
+            out->backoff = 0;
+        } else {
+            uint64_t run = (uint64_t)(1 + out->backoff) * CHUNK_SIZE;
+            n = len < run ? (size_t)len : (size_t)run;
+            out->backoff = out->backoff == 0 ? 1 : out->backoff * 2 > CHUNK_MAX_BACKOFF ? CHUNK_MAX_BACKOFF : out->backoff * 2;
+            chunk_header(p, 0, n, n);
+            out_commit(out, CHUNK_HEADER_SIZE);
+            out_iov(out, data, n); // Straight from the mapping
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Send a group of files: frames, file, frames, file, ..., the End frame of the last file, with one rudp_sendv unless
+// the output fills up. With the Receiver's resume state, the files are at *base in the transfer (it's advanced past
+// them) and the bytes of the chunks it has aren't sent: a file it misses only in part goes as a Partial frame, then
+// Range frames with their bytes. In a compressed session, the bytes of the files (or of the ranges) go in chunk frames.
+static int64_t session_send_group(rudpConn *conn, const char *const *paths, const char *const *names, int count,
+                                  const unsigned char *state, size_t state_len, uint64_t *base) {
+    sessionFile files[SESSION_GROUP + 1];
+    sessionOut out;
+    int64_t bytes = 0;
+    int mapped = 0;
+    uint32_t crc = 0;
+    int compress = rudpConn_compression(conn);
+
+    memset(files, 0, sizeof(files));
+    for (; mapped < count; mapped++) {
+        const char *name = session_name(paths, names, mapped);
+        if (strlen(name) > RUDP_SESSION_MAX_NAME) {
+            RUDP_LOG(RUDP_LOG_ERROR, "File name %s is too long.", name);
+            break;
+        }
+        sessionFile *file = &files[mapped];
+        file->frames_len = mapped > 0 ? frame_end(file->frames, crc) : 0; // The End frame of the file before it
+        if (session_map(file, paths[mapped]) == -1)
+            break;
+        if (state != NULL) {
+            if (session_partial(file, *base, state, state_len) == -1) {
+                RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Range allocation failed");
+                mapped++;
+                break;
+            }
+            *base += file->size;
+        }
+        char type = file->ranges != NULL ? (compress ? FRAME_CHUNKED_PARTIAL : FRAME_PARTIAL) :
+                                           (compress ? FRAME_CHUNKED_BEGIN : FRAME_BEGIN);
+        file->frames_len += frame_begin(file->frames + file->frames_len, type, name, file->size);
+        crc = 0;
+        if (file->ranges == NULL) {
+            crc = crc32c(0, file->map, file->size);
+            bytes += file->size;
+            continue;
+        }
+        // The CRC32C of a partial file is the one of the bytes of its ranges, one after the other
+        for (int r = 0; r < file->range_count; r++) {
+            const unsigned char *range = file->ranges + (size_t)r * RANGE_SIZE;
+            crc = crc32c(crc, file->map + get_u64(range + 1), get_u64(range + 9));
+            bytes += get_u64(range + 9);
+        }
+    }
+
+    out.conn = conn;
+    out.iovcnt = 0;
+    out.buffer_size = compress ? OUT_COMPRESSED_BUFFER : OUT_BUFFER;
+    out.buffer_len = 0;
+    out.compress = compress;
+    out.buffer = mapped == count ? (unsigned char *)malloc(out.buffer_size) : NULL;
+    if (mapped == count && out.buffer == NULL)
+        RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Output buffer allocation failed");
+    if (out.buffer == NULL)
+        bytes = -1;
+    for (int i = 0; i < count && bytes != -1; i++) {
+        sessionFile *file = &files[i];
+        out.backoff = 0; // Every file gets its chance to compress
+        if (out_frame(&out, file->frames, file->frames_len) == -1) {
+            bytes = -1;
+            break;
+        }
+        if (file->ranges == NULL) {
+            if (out_data(&out, file->map, file->size) == -1)
+                bytes = -1;
+            continue;
+        }
+        for (int r = 0; r < file->range_count && bytes != -1; r++) {
+            const unsigned char *range = file->ranges + (size_t)r * RANGE_SIZE;
+            if (out_frame(&out, range, RANGE_SIZE) == -1 ||
+                out_data(&out, file->map + get_u64(range + 1), get_u64(range + 9)) == -1)
+                bytes = -1;
+        }
+    }
+    if (bytes != -1 &&
+        (out_frame(&out, files[count].frames, frame_end(files[count].frames, crc)) == -1 || out_flush(&out) == -1))
+        bytes = -1;
+    free(out.buffer);
+    for (int i = 0; i < mapped; i++) {
+        if (files[i].map != NULL)
+            munmap(files[i].map, files[i].size);
+        free(files[i].ranges);
+    }
+    return bytes;
+}
+
+// Send the files group by group, only what the Receiver misses if state isn't NULL
+static int64_t session_send(rudpConn *conn, const char *const *paths, const char *const *names, int count,
+                            const unsigned char *state, size_t state_len) {
+    uint64_t base = 0;
+    int64_t sent = 0;
+    for (int first = 0; first < count; first += SESSION_GROUP) {
+        int n = count - first < SESSION_GROUP ? count - first : SESSION_GROUP;
+        int64_t bytes = session_send_group(conn, paths + first, names != NULL ? names + first : NULL, n, state, state_len, &base);
+        if (bytes == -1)
+            return -1;
+        sent += bytes;
+    }
+    return sent;
+}
+
+int64_t rudpSession_send_files(rudpConn *conn, const char *const *paths, const char *const *names, int count) {
+    return session_send(conn, paths, names, count, NULL, 0);
+}
+
+int rudpSession_resume_request(unsigned char *request, const char *const *paths, const char *const *names, int count) {
+    // FNV-1a over the name, the size and the modification time of every file: another set of files, or a file that
+    // changed since, is another transfer
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t size = 0;
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        if (stat(paths[i], &st) == -1) {
+            RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "File stat failed");
+            return -1;
+        }
+        const char *name = session_name(paths, names, i);
+        unsigned char fields[24];
+        put_u64(fields, (uint64_t)st.st_size);
+        put_u64(fields + 8, (uint64_t)st.st_mtim.tv_sec);
+        put_u64(fields + 16, (uint64_t)st.st_mtim.tv_nsec);
+        for (size_t j = 0; j <= strlen(name); j++) // The '\0' separates the name from the fields
+            hash = (hash ^ (unsigned char)name[j]) * 0x100000001b3ULL;
+        for (size_t j = 0; j < sizeof(fields); j++)
+            hash = (hash ^ fields[j]) * 0x100000001b3ULL;
+        size += st.st_size;
+    }
+    return (int)rudpResume_request(request, hash, size);
+}
+
+int64_t rudpSession_resume_files(rudpConn *conn, const char *const *paths, const char *const *names, int count) {
+    const void *state;
+    size_t state_len = rudpConn_resume(conn, &state);
+    if (rudpResume_chunk_size((const unsigned char *)state, state_len) == 0)
+        return session_send(conn, paths, names, count, NULL, 0); // The Receiver has nothing to resume
+    return session_send(conn, paths, names, count, (const unsigned char *)state, state_len);
+}
+
+rudpSessionReader *rudpSessionReader_alloc(const rudpSessionCallbacks *callbacks, void *user) {
+    if (callbacks == NULL || callbacks->on_begin == NULL || callbacks->on_end == NULL)
+        return NULL;
+    rudpSessionReader *reader = (rudpSessionReader *)calloc(1, sizeof(rudpSessionReader));
+    if (reader == NULL)
+        return NULL;
+    reader->callbacks = *callbacks;
+    reader->user = user;
+    reader->state = READ_FRAME;
+    return reader;
+}
+
+void rudpSessionReader_free(rudpSessionReader *reader) {
+    if (reader == NULL)
+        return;
+    free(reader->chunk);
+    free(reader);
+}
+
+// Size of the frame being read, as far as the bytes read so far tell it. Returns 0 for an unknown frame, for a
+// Range frame out of a partial file or past its end (a reader without on_range knows neither Partial nor Range frames),
+// for a chunk frame out of the data of a chunked file or that doesn't fit in it, for any other frame in there, for an
+// End frame out of a file, and for the Begin frame of a file before the End frame of the one before it.
+static unsigned int frame_size(const rudpSessionReader *reader) {
+    if (reader->frame_len == 0)
+        return 1;
+    char type = reader->frame[0];
+    if ((type == FRAME_CHUNK) != (reader->chunked && reader->remaining > 0))
+        return 0;
+    if (type == FRAME_CHUNK) {
+        if (reader->frame_len < CHUNK_HEADER_SIZE)
+            return CHUNK_HEADER_SIZE;
+        uint32_t raw_len = get_u32(reader->frame + 2);
+        uint32_t stored_len = get_u32(reader->frame + 6);
+        if (raw_len == 0 || raw_len > reader->remaining)
+            return 0;
+        if (reader->frame[1] == CHUNK_LZ)
+            return raw_len <= CHUNK_SIZE && stored_len > 0 && stored_len < raw_len ? CHUNK_HEADER_SIZE : 0;
+        return reader->frame[1] == 0 && stored_len == raw_len ? CHUNK_HEADER_SIZE : 0;
+    }
+    if (type == FRAME_END)
+        return reader->in_file ? END_SIZE : 0;
+    if (type == FRAME_RANGE) {
+        if (!reader->partial)
+            return 0;
+        if (reader->frame_len < RANGE_SIZE)
+            return RANGE_SIZE;
+        uint64_t offset = get_u64(reader->frame + 1);
+        uint64_t length = get_u64(reader->frame + 9);
+        return offset <= reader->size && length <= reader->size - offset ? RANGE_SIZE : 0;
+    }
+    int partial = type == FRAME_PARTIAL || type == FRAME_CHUNKED_PARTIAL;
+    if (reader->in_file)
+        return 0;
+    if (type != FRAME_BEGIN && type != FRAME_CHUNKED_BEGIN && (!partial || reader->callbacks.on_range == NULL))
+        return 0;
+    if (reader->frame_len < BEGIN_HEADER_SIZE)
+        return BEGIN_HEADER_SIZE;
+    unsigned int name_len = (unsigned int)reader->frame[9] << 8 | reader->frame[10];
+    return name_len <= RUDP_SESSION_MAX_NAME ? BEGIN_HEADER_SIZE + name_len : 0;
+}
+
+// A whole frame was read, returns -1 if the buffers of compressed chunks can't be allocated
+static int frame_done(rudpSessionReader *reader) {
+    reader->frame_len = 0;
+    char type = reader->frame[0];
+    if (type == FRAME_END) {
+        reader->in_file = 0;
+        reader->partial = 0;
+        reader->chunked = 0;
+        reader->callbacks.on_end(get_u32(reader->frame + 1) == reader->crc, reader->user);
+        return 0;
+    }
+    if (type == FRAME_CHUNK) {
+        reader->raw_len = get_u32(reader->frame + 2);
+        reader->chunk_len = get_u32(reader->frame + 6);
+        reader->data_left = reader->chunk_len;
+        reader->state = READ_DATA; // A raw chunk
+        if (reader->frame[1] != CHUNK_LZ)
+            return 0;
+        if (reader->chunk == NULL) {
+            reader->chunk = (unsigned char *)malloc(2 * CHUNK_SIZE);
+            if (reader->chunk == NULL) {
+                RUDP_LOG_ERRNO(RUDP_LOG_ERROR, "Chunk allocation failed");
+                return -1;
+            }
+            reader->raw = reader->chunk + CHUNK_SIZE;
+        }
+        reader->state = READ_CHUNK;
+        return 0;
+    }
+    if (type == FRAME_RANGE) {
+        reader->remaining = get_u64(reader->frame + 9);
+        reader->data_left = reader->chunked ? 0 : reader->remaining;
+        reader->state = reader->data_left > 0 ? READ_DATA : READ_FRAME;
+        reader->callbacks.on_range(get_u64(reader->frame + 1), reader->remaining, reader->user);
+        return 0;
+    }
+    char name[RUDP_SESSION_MAX_NAME + 1];
+    unsigned int name_len = (unsigned int)reader->frame[9] << 8 | reader->frame[10];
+    memcpy(name, reader->frame + BEGIN_HEADER_SIZE, name_len);
+    name[name_len] = '\0';
+    uint64_t size = get_u64(reader->frame + 1);
+    reader->partial = type == FRAME_PARTIAL || type == FRAME_CHUNKED_PARTIAL;
+    reader->chunked = type == FRAME_CHUNKED_BEGIN || type == FRAME_CHUNKED_PARTIAL;
+    reader->size = size;
+    reader->in_file = 1;
+    reader->remaining = reader->partial ? 0 : size; // The bytes of a partial file come after Range frames
+    reader->data_left = reader->chunked ? 0 : reader->remaining; // The bytes of a chunked file come in chunk frames
+    reader->crc = 0;
+    reader->state = reader->data_left > 0 ? READ_DATA : READ_FRAME;
+    reader->callbacks.on_begin(name, size, reader->user);
+    return 0;
+}
+
+// The next bytes of the file
+static void reader_data(rudpSessionReader *reader, const char *data, int len) {
+    reader->crc = crc32c(reader->crc, data, len);
+    if (reader->callbacks.on_data != NULL)
+        reader->callbacks.on_data(data, len, reader->user);
+    reader->remaining -= len;
+}
+
+int rudpSessionReader_input(rudpSessionReader *reader, const char *data, int len) {
+    while (len > 0) {
+        if (reader->state == READ_DATA || reader->state == READ_CHUNK) {
+            int n = reader->data_left < (uint64_t)len ? (int)reader->data_left : len;
+            if (reader->state == READ_DATA)
+                reader_data(reader, data, n);
+            else
+                memcpy(reader->chunk + reader->chunk_len - reader->data_left, data, n);
+            data += n;
+            len -= n;
+            reader->data_left -= n;
+            if (reader->data_left > 0)
+                continue;
+            // A compressed chunk is whole: its bytes are those it decompresses to, exactly as many as its frame said
+            if (reader->state == READ_CHUNK) {
+                if (rudp_lz_decompress(reader->chunk, reader->chunk_len, reader->raw, reader->raw_len) == -1)
+                    return -1;
+                reader_data(reader, (const char *)reader->raw, (int)reader->raw_len);
+            }
+            reader->state = READ_FRAME;
+            continue;
+        }
+
+        // A frame may arrive in pieces, its bytes are collected until its size is known and all of them are there
+        unsigned int size = frame_size(reader);
+        if (size == 0)
+            return -1;
+        int n = size - reader->frame_len < (unsigned int)len ? (int)(size - reader->frame_len) : len;
+        memcpy(reader->frame + reader->frame_len, data, n);
+        reader->frame_len += n;
+        data += n;
+        len -= n;
+        if (reader->frame_len == size && frame_size(reader) == size) {
+            if (frame_done(reader) == -1)
+                return -1;
+        } else if (frame_size(reader) == 0)
+            return -1;
+    }
+    return 0;
+}
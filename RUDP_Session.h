@@ -0,0 +1,92 @@
+#pragma once
+
+#include "RUDP_API.h"
+
+/*
+ * File transfer sessions over a RUDP connection: any number of files are sent one after the other in the stream
+ * of the connection, every file between two typed frames. The frames are part of the stream, so they are as reliable,
+ * ordered and protected by the checksum/CRC32C as the data itself (multi-byte fields in network byte order):
+ *   Begin: 'B', size of the file (8 bytes), length of its name (2 bytes), the name
+ *   then the size bytes of the file,
+ *   End:   'E', CRC32C of the file (4 bytes)
+ * A transfer that resumes (see rudpSession_resume_files) sends the files the Receiver has in part as:
+ *   Partial: 'P', then as Begin,
+ *   any number of Range: 'R', offset in the file (8 bytes), length (8 bytes), then the length bytes at offset,
+ *   End:     'E', CRC32C of the bytes of the ranges, one after the other
+ * When the connection negotiated compression (see rudpConn_set_compression), files are sent chunked instead:
+ *   Begin: 'C' (or Partial: 'Q'), then as Begin,
+ *   the bytes of the file (or of every range) in any number of Chunk: 'Z', flags (1 byte), raw length (4 bytes),
+ *   stored length (4 bytes), then the stored bytes: the raw bytes themselves, or with the flag 0x01 the same bytes
+ *   compressed with RUDP_LZ (64KB of raw bytes at most, stored in fewer bytes),
+ *   End: 'E', CRC32C of the raw bytes
+ * The Sender tries chunks of 64KB and sends the ones that don't compress raw, and with the next chunks without even
+ * trying them, longer and longer runs of them while the file keeps not compressing (e.g. random or already compressed data).
+ */
+
+#define RUDP_SESSION_MAX_NAME 255
+#define RUDP_SESSION_BEGIN_MAX (11 + RUDP_SESSION_MAX_NAME) // Largest Begin frame
+#define RUDP_SESSION_END_SIZE 5
+
+/*
+ * Sends count files back to back over the connection, chunked if it negotiated compression. The frames and the files
+ * of up to a group of files go out with one rudp_sendv (unless the compressed chunks fill a buffer of 4MB first), so a
+ * file starts while the last packets of the one before it are still in flight, without an idle RTT between them.
+ * names are the names sent in the Begin frames (NULL sends the base names of the paths).
+ * Returns the number of bytes of the files that were sent, -1 on error.
+ */
+int64_t rudpSession_send_files(rudpConn *conn, const char *const *paths, const char *const *names, int count);
+
+/*
+ * Writes the resume request of the transfer of count files to request (RUDP_RESUME_REQUEST_SIZE bytes), for
+ * rudpConn_set_resume before the handshake: its ID is a hash of the names, sizes and modification times of the files,
+ * so the Receiver only resumes a transfer of the very same files. Returns its size, -1 if a file can't be read.
+ */
+int rudpSession_resume_request(unsigned char *request, const char *const *paths, const char *const *names, int count);
+
+/*
+ * As rudpSession_send_files, but the chunks the Receiver already has (the state it sent in the ACK of the SYN, see
+ * RUDP_Resume.h) aren't sent again: a file it has in part goes as its missing ranges, and one it has whole as no range
+ * at all. Without a state from the Receiver, every file is sent. Returns the number of bytes of the files that were sent.
+ */
+int64_t rudpSession_resume_files(rudpConn *conn, const char *const *paths, const char *const *names, int count);
+
+/*
+ * Frames of a file that is sent from memory (e.g. generated data) instead of with rudpSession_send_files: the Begin
+ * frame of a file named name of size bytes is written to frame (RUDP_SESSION_BEGIN_MAX bytes at most).
+ * Returns the size of the frame, 0 if the name is too long.
+ */
+size_t rudpSession_begin_frame(unsigned char *frame, const char *name, uint64_t size);
+
+/*
+ * Writes the End frame of a file whose bytes have the CRC32C crc to frame (RUDP_SESSION_END_SIZE bytes), returns its size.
+ */
+size_t rudpSession_end_frame(unsigned char *frame, uint32_t crc);
+
+typedef struct _rudpSessionCallbacks {
+    // The Begin frame of a file
+    void (*on_begin)(const char *name, uint64_t size, void *user);
+    // The next bytes of the file, the buffer is valid only during the call (may be NULL)
+    void (*on_data)(const char *data, int len, void *user);
+    // The End frame of the file, valid is 1 if the CRC32C of the bytes that arrived matches the one the Sender sent
+    void (*on_end)(int valid, void *user);
+    // A Range frame of a partial file: the next length bytes of on_data go at offset in the file (may be NULL, the
+    // reader then refuses resumed files)
+    void (*on_range)(uint64_t offset, uint64_t length, void *user);
+} rudpSessionCallbacks;
+
+struct _rudpSessionReader;
+typedef struct _rudpSessionReader rudpSessionReader;
+
+/*
+ * Allocates the parser of a session's stream, user is passed to every callback.
+ * It's the user responsibility to free it with rudpSessionReader_free.
+ */
+rudpSessionReader *rudpSessionReader_alloc(const rudpSessionCallbacks *callbacks, void *user);
+
+void rudpSessionReader_free(rudpSessionReader *reader);
+
+/*
+ * Parses the next len bytes of the stream (as rudp_receive or a server's on_data got them), in any pieces.
+ * Returns 0, or -1 if the stream isn't a session (an unknown frame, a name that is too long or a malformed chunk).
+ */
+int rudpSessionReader_input(rudpSessionReader *reader, const char *data, int len);
@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <string.h>
+#include "RUDP_Stats.h"
+
+#define SUB_BUCKETS (1u << RUDP_HISTOGRAM_SUB_BITS)
+// Values below SUB_BUCKETS have a bucket each, then every power of 2 from SUB_BUCKETS to 2^63 has SUB_BUCKETS buckets
+#define BUCKETS ((64 - RUDP_HISTOGRAM_SUB_BITS + 1) * SUB_BUCKETS)
+
+struct _rudpHistogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[BUCKETS];
+};
+
+// Bucket of a value: the power of 2 it's in, and the next RUDP_HISTOGRAM_SUB_BITS bits below its leading one
+static unsigned int bucket_index(uint64_t value) {
+    if (value < SUB_BUCKETS)
+        return (unsigned int)value;
+    unsigned int shift = 63 - __builtin_clzll(value) - RUDP_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + (unsigned int)((value >> shift) - SUB_BUCKETS);
+}
+
+// The value a bucket stands for, the middle of the values it counts
+static uint64_t bucket_value(unsigned int index) {
+    if (index < SUB_BUCKETS)
+        return index;
+    unsigned int shift = index / SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return low + ((1ull << shift) >> 1);
+}
+
+rudpHistogram *rudpHistogram_alloc() {
+    return (rudpHistogram *)calloc(1, sizeof(rudpHistogram));
+}
+
+void rudpHistogram_free(rudpHistogram *histogram) {
+    free(histogram);
+}
+
+void rudpHistogram_record(rudpHistogram *histogram, uint64_t value) {
+    if (histogram->count == 0 || value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+    histogram->count++;
+    histogram->sum += value;
+    histogram->buckets[bucket_index(value)]++;
+}
+
+void rudpHistogram_merge(rudpHistogram *dst, const rudpHistogram *src) {
+    if (src->count == 0)
+        return;
+    if (dst->count == 0 || src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (unsigned int i = 0; i < BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+void rudpHistogram_reset(rudpHistogram *histogram) {
+    memset(histogram, 0, sizeof(rudpHistogram));
+}
+
+uint64_t rudpHistogram_count(const rudpHistogram *histogram) {
+    return histogram->count;
+}
+
+uint64_t rudpHistogram_min(const rudpHistogram *histogram) {
+    return histogram->min;
+}
+
+uint64_t rudpHistogram_max(const rudpHistogram *histogram) {
+    return histogram->max;
+}
+
+double rudpHistogram_mean(const rudpHistogram *histogram) {
+    return histogram->count > 0 ? (double)histogram->sum / histogram->count : 0;
+}
+
+uint64_t rudpHistogram_percentile(const rudpHistogram *histogram, double p) {
+    if (histogram->count == 0)
+        return 0;
+    if (p < 0)
+        p = 0;
+    if (p > 1)
+        p = 1;
+    // The rank of the value, 1 to count
+    uint64_t rank = (uint64_t)(p * histogram->count + 0.5);
+    if (rank <= 1)
+        return histogram->min;
+    if (rank >= histogram->count)
+        return histogram->max;
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            // The exact min and max are better than the middle of their buckets
+            uint64_t value = bucket_value(i);
+            if (value < histogram->min)
+                return histogram->min;
+            if (value > histogram->max)
+                return histogram->max;
+            return value;
+        }
+    }
+    return histogram->max;
+}
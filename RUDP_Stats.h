@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming statistics of a series of values (e.g. transfer times, speeds) in constant memory: a log-bucketed histogram
+ * in the style of HdrHistogram. Every power of 2 is split into 2^RUDP_HISTOGRAM_SUB_BITS buckets, so a value is
+ * counted with a relative error below 1/2^RUDP_HISTOGRAM_SUB_BITS, whatever its magnitude, and recording one is O(1).
+ * The count, sum, min and max are exact. Two histograms are merged by adding their counters (e.g. the ones of threads).
+ */
+
+#define RUDP_HISTOGRAM_SUB_BITS 7 // 128 buckets per power of 2, under 1% error
+
+struct _rudpHistogram;
+typedef struct _rudpHistogram rudpHistogram;
+
+/*
+ * Allocates a new empty histogram, NULL on error.
+ * It's the user responsibility to free it with rudpHistogram_free.
+ */
+rudpHistogram *rudpHistogram_alloc();
+
+/*
+ * Frees the histogram. If histogram==NULL does nothing (same as free).
+ */
+void rudpHistogram_free(rudpHistogram *histogram);
+
+/*
+ * Counts a value.
+ */
+void rudpHistogram_record(rudpHistogram *histogram, uint64_t value);
+
+/*
+ * Adds the values of src to dst, src is left as it is.
+ */
+void rudpHistogram_merge(rudpHistogram *dst, const rudpHistogram *src);
+
+/*
+ * Forgets every value.
+ */
+void rudpHistogram_reset(rudpHistogram *histogram);
+
+/*
+ * Returns the number of values counted.
+ */
+uint64_t rudpHistogram_count(const rudpHistogram *histogram);
+
+/*
+ * Returns the smallest and the largest value, 0 if there's none.
+ */
+uint64_t rudpHistogram_min(const rudpHistogram *histogram);
+
+uint64_t rudpHistogram_max(const rudpHistogram *histogram);
+
+/*
+ * Returns the mean of the values, 0 if there's none.
+ */
+double rudpHistogram_mean(const rudpHistogram *histogram);
+
+/*
+ * Returns the value below which the fraction p (0 to 1) of the values are, e.g. 0.99 for the 99th percentile,
+ * within the error of its bucket. 0 if there's no value.
+ */
+uint64_t rudpHistogram_percentile(const rudpHistogram *histogram, double p);
@@ -0,0 +1,325 @@
+#include "RUDP_Session.h"
+#include "RUDP_LZ.h"
+
+// Checks of the parsers of what comes off the wire: every input the LZ codec and the session reader get is written by
+// the peer, so they must give back what was sent, and refuse (never crash on) anything else. And of the FEC matrix
+// inversion, that rebuilds lost packets. Run it with make test.
+
+#define TEST_SIZE (3 * RUDP_LZ_MAX_INPUT + 1000) // A file of a few chunks, the last one short
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// Text-like data that compresses, with a run of noise that doesn't
+static void test_data(unsigned char *data, size_t len) {
+    uint32_t x = 12345;
+    for (size_t i = 0; i < len; i++) {
+        x = x * 1103515245 + 12345;
+        if (i >= RUDP_LZ_MAX_INPUT && i < 2 * RUDP_LZ_MAX_INPUT)
+            data[i] = (unsigned char)(x >> 16);
+        else
+            data[i] = "abcdefgh rudp session "[(i + i / 64 * 3) % 22];
+    }
+}
+
+static void test_lz() {
+    static unsigned char data[RUDP_LZ_MAX_INPUT], packed[RUDP_LZ_MAX_INPUT], out[RUDP_LZ_MAX_INPUT + 1];
+    test_data(data, sizeof(data));
+
+    // Round trips, down to the sizes whose last sequence is all literals
+    size_t sizes[] = { 1, 4, 12, 13, 100, 4096, RUDP_LZ_MAX_INPUT };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t len = sizes[i];
+        size_t stored = rudp_lz_compress(data, len, packed, sizeof(packed));
+        if (stored == 0) // Too small to compress
+            continue;
+        check(rudp_lz_decompress(packed, stored, out, len) == 0 && memcmp(out, data, len) == 0, "LZ round trip");
+    }
+    size_t stored = rudp_lz_compress(data, sizeof(data), packed, sizeof(packed));
+    check(stored > 0 && stored < sizeof(data) / 2, "LZ compresses text");
+    check(rudp_lz_compress(data, sizeof(data), packed, stored - 1) == 0, "LZ gives up past the capacity");
+    unsigned char noise[4096];
+    uint32_t x = 1;
+    for (size_t i = 0; i < sizeof(noise); i++) {
+        x = x * 1103515245 + 12345;
+        noise[i] = (unsigned char)(x >> 16);
+    }
+    check(rudp_lz_compress(noise, sizeof(noise), packed, sizeof(noise) - 1) == 0, "LZ gives up on noise");
+
+    // Malformed data: every cut of a valid block, the wrong output size, and offsets out of the output
+    stored = rudp_lz_compress(data, 4096, packed, sizeof(packed));
+    int refused = 1;
+    for (size_t len = 0; len < stored; len++)
+        refused &= rudp_lz_decompress(packed, len, out, 4096) == -1;
+    check(refused, "LZ refuses a truncated block");
+    check(rudp_lz_decompress(packed, stored, out, 4095) == -1, "LZ refuses a block larger than its size");
+    check(rudp_lz_decompress(packed, stored, out, 4097) == -1, "LZ refuses a block smaller than its size");
+    const unsigned char far[] = { 0x10, 'a', 0x05, 0x00, 0x00 }; // A literal, then a match 5 bytes back
+    check(rudp_lz_decompress(far, sizeof(far), out, 5) == -1, "LZ refuses an offset before the output");
+    const unsigned char zero[] = { 0x10, 'a', 0x00, 0x00, 0x00 };
+    check(rudp_lz_decompress(zero, sizeof(zero), out, 5) == -1, "LZ refuses an offset of 0");
+    const unsigned char endless[] = { 0xF0, 0xFF, 0xFF, 0xFF }; // A literal length that never ends
+    check(rudp_lz_decompress(endless, sizeof(endless), out, sizeof(out)) == -1, "LZ refuses a truncated length");
+
+    // Random bytes must be refused or decode within the buffers (the address sanitizer tells)
+    for (int round = 0; round < 10000; round++) {
+        size_t len = 1 + round % 64;
+        for (size_t i = 0; i < len; i++) {
+            x = x * 1103515245 + 12345;
+            packed[i] = (unsigned char)(x >> 16);
+        }
+        rudp_lz_decompress(packed, len, out, 1 + (x >> 8) % 256);
+    }
+}
+
+// What the session reader reported
+typedef struct _testReader {
+    unsigned char *data;
+    size_t len;
+    int begins;
+    int ends;
+    int valid;
+} testReader;
+
+static void on_test_begin(const char *name, uint64_t size, void *user) {
+    testReader *t = (testReader *)user;
+    t->begins += strcmp(name, "test.bin") == 0 && size == TEST_SIZE;
+}
+
+static void on_test_data(const char *data, int len, void *user) {
+    testReader *t = (testReader *)user;
+    if (t->len + len <= TEST_SIZE)
+        memcpy(t->data + t->len, data, len);
+    t->len += len;
+}
+
+static void on_test_end(int valid, void *user) {
+    testReader *t = (testReader *)user;
+    t->ends++;
+    t->valid = valid;
+}
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (24 - 8 * i);
+}
+
+static size_t chunk_frame(unsigned char *p, unsigned char flags, uint32_t raw_len, uint32_t stored_len) {
+    p[0] = 'Z';
+    p[1] = flags;
+    put_u32(p + 2, raw_len);
+    put_u32(p + 6, stored_len);
+    return 10;
+}
+
+// The stream of a chunked session of one file, as a Sender with compression sends it: compressed chunks, and raw ones
+// for the data that doesn't compress
+static size_t session_stream(unsigned char *stream, const unsigned char *data) {
+    size_t len = rudpSession_begin_frame(stream, "test.bin", TEST_SIZE);
+    stream[0] = 'C';
+    for (size_t offset = 0; offset < TEST_SIZE; offset += RUDP_LZ_MAX_INPUT) {
+        uint32_t n = TEST_SIZE - offset < RUDP_LZ_MAX_INPUT ? TEST_SIZE - offset : RUDP_LZ_MAX_INPUT;
+        unsigned char *frame = stream + len;
+        size_t stored = rudp_lz_compress(data + offset, n, frame + 10, n - 1);
+        if (stored > 0) {
+            len += chunk_frame(frame, 0x01, n, stored) + stored;
+        } else {
+            len += chunk_frame(frame, 0, n, n);
+            memcpy(stream + len, data + offset, n);
+            len += n;
+        }
+    }
+    return len + rudpSession_end_frame(stream + len, crc32c(0, data, TEST_SIZE));
+}
+
+// Feeds the stream to a new reader in pieces of step bytes, returns what rudpSessionReader_input last returned
+static int session_read(const unsigned char *stream, size_t len, size_t step, testReader *t) {
+    rudpSessionCallbacks callbacks = { on_test_begin, on_test_data, on_test_end, NULL };
+    memset(t->data, 0, TEST_SIZE);
+    t->len = 0;
+    t->begins = 0;
+    t->ends = 0;
+    t->valid = 0;
+    rudpSessionReader *reader = rudpSessionReader_alloc(&callbacks, t);
+    if (reader == NULL) {
+        perror("Reader allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int result = 0;
+    for (size_t i = 0; i < len && result == 0; i += step)
+        result = rudpSessionReader_input(reader, (const char *)stream + i, (int)(len - i < step ? len - i : step));
+    rudpSessionReader_free(reader);
+    return result;
+}
+
+static void test_session() {
+    unsigned char *data = (unsigned char *)malloc(TEST_SIZE);
+    unsigned char *stream = (unsigned char *)malloc(2 * TEST_SIZE);
+    unsigned char *bad = (unsigned char *)malloc(2 * TEST_SIZE);
+    testReader t = { (unsigned char *)malloc(TEST_SIZE) };
+    if (data == NULL || stream == NULL || bad == NULL || t.data == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    test_data(data, TEST_SIZE);
+    size_t len = session_stream(stream, data);
+    check(len < TEST_SIZE, "session stream has compressed chunks");
+
+    // Round trip, whole and in pieces that cut every frame
+    size_t steps[] = { 2 * TEST_SIZE, 4096, 7, 1 };
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        int result = session_read(stream, len, steps[i], &t);
+        check(result == 0 && t.begins == 1 && t.ends == 1 && t.valid && t.len == TEST_SIZE &&
+              memcmp(t.data, data, TEST_SIZE) == 0, "session round trip");
+    }
+    memcpy(bad, stream, len);
+    bad[len - 1] ^= 1;
+    check(session_read(bad, len, len, &t) == 0 && t.ends == 1 && !t.valid, "session reports a bad CRC32C");
+
+    // Malformed streams: the frame that breaks the rules follows the Begin frame of the file
+    size_t begin = rudpSession_begin_frame(bad, "test.bin", TEST_SIZE);
+    bad[0] = 'C';
+    unsigned char *p = bad + begin;
+    chunk_frame(p, 0x01, 100, 100);
+    check(session_read(bad, begin + 10, 3, &t) == -1, "session refuses a compressed chunk that isn't smaller");
+    chunk_frame(p, 0, TEST_SIZE + 1, TEST_SIZE + 1);
+    check(session_read(bad, begin + 10, 3, &t) == -1, "session refuses a chunk past the end of the file");
+    chunk_frame(p, 0, 100, 99);
+    check(session_read(bad, begin + 10, 3, &t) == -1, "session refuses a raw chunk of another size");
+    chunk_frame(p, 0x02, 100, 100);
+    check(session_read(bad, begin + 10, 3, &t) == -1, "session refuses unknown chunk flags");
+    chunk_frame(p, 0, 0, 0);
+    check(session_read(bad, begin + 10, 3, &t) == -1, "session refuses an empty chunk");
+    chunk_frame(p, 0x01, 1000, 20);
+    memset(p + 10, 0xFF, 20); // Lengths that run past the chunk
+    check(session_read(bad, begin + 30, 3, &t) == -1, "session refuses a chunk of bad LZ data");
+    p[0] = 'E';
+    check(session_read(bad, begin + 5, 1, &t) == -1, "session refuses an End frame before the data of a chunked file");
+
+    // Chunks out of a chunked file, and frames nobody knows
+    size_t plain = rudpSession_begin_frame(bad, "test.bin", 0);
+    plain += rudpSession_end_frame(bad + plain, 0);
+    check(session_read(bad, plain, 1, &t) == 0 && t.ends == 1 && t.valid, "session reads an empty file");
+    chunk_frame(bad + plain, 0, 10, 10);
+    check(session_read(bad, plain + 10, 1, &t) == -1, "session refuses a chunk between files");
+    size_t raw = rudpSession_begin_frame(bad, "test.bin", 10);
+    chunk_frame(bad + raw, 0, 10, 10);
+    check(session_read(bad, raw + 10, 1, &t) == 0 && t.len == 10 && t.ends == 0, "session reads a chunk frame in a plain file as data");
+    check(session_read((const unsigned char *)"X", 1, 1, &t) == -1, "session refuses an unknown frame");
+
+    // Files must be framed one after the other: no End frame out of a file, no Begin frame before the End of the last one
+    size_t end = rudpSession_end_frame(bad, 0);
+    check(session_read(bad, end, 1, &t) == -1 && t.ends == 0, "session refuses an End frame before any file");
+    end = rudpSession_begin_frame(bad, "test.bin", 0);
+    end += rudpSession_end_frame(bad + end, 0);
+    end += rudpSession_end_frame(bad + end, 0);
+    check(session_read(bad, end, 1, &t) == -1 && t.ends == 1, "session refuses a second End frame of a file");
+    size_t twice = rudpSession_begin_frame(bad, "test.bin", 0);
+    twice += rudpSession_begin_frame(bad + twice, "test.bin", 0);
+    check(session_read(bad, twice, 1, &t) == -1, "session refuses a Begin frame in a file");
+    bad[twice / 2] = 'C';
+    check(session_read(bad, twice, 1, &t) == -1, "session refuses a chunked Begin frame in a file");
+    size_t partial = rudpSession_begin_frame(bad, "test.bin", 10);
+    bad[0] = 'P';
+    check(session_read(bad, partial, 1, &t) == -1, "session refuses a partial file without on_range");
+    rudpSession_begin_frame(bad, "test.bin", 10);
+    bad[9] = 0x01; // A name of 256 bytes and more
+    check(session_read(bad, RUDP_SESSION_BEGIN_MAX, 1, &t) == -1, "session refuses a name that is too long");
+
+    free(data);
+    free(stream);
+    free(bad);
+    free(t.data);
+}
+
+// Lose e of the k data packets of a block, and rebuild them from e of its Reed-Solomon parity packets
+static int fec_rebuild(unsigned int k, const unsigned int *rows, const unsigned int *lost, unsigned int e) {
+    uint8_t data[RUDP_FEC_MAX_BLOCK][32], parity[RUDP_FEC_MAX_PARITY][32], rebuilt[32];
+    uint8_t inverse[RUDP_FEC_MAX_PARITY * RUDP_FEC_MAX_PARITY];
+    for (unsigned int i = 0; i < k; i++)
+        for (unsigned int b = 0; b < 32; b++)
+            data[i][b] = (uint8_t)(i * 37 + b * 11 + 5);
+    // What the parity packets hold of the lost packets: the sums with the received packets taken out
+    for (unsigned int r = 0; r < e; r++) {
+        memset(parity[r], 0, 32);
+        for (unsigned int i = 0; i < k; i++) {
+            int missing = 0;
+            for (unsigned int l = 0; l < e; l++)
+                missing |= lost[l] == i;
+            if (missing)
+                fec_mul_add(parity[r], data[i], fec_coef(RUDP_FEC_RS, rows[r], i), 32);
+        }
+    }
+    if (fec_invert(RUDP_FEC_RS, rows, lost, e, inverse) == -1)
+        return -1;
+    for (unsigned int c = 0; c < e; c++) {
+        memset(rebuilt, 0, 32);
+        for (unsigned int r = 0; r < e; r++)
+            fec_mul_add(rebuilt, parity[r], inverse[c * e + r], 32);
+        if (memcmp(rebuilt, data[lost[c]], 32) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void test_fec() {
+    unsigned int rows[RUDP_FEC_MAX_PARITY], indexes[RUDP_FEC_MAX_PARITY];
+    uint8_t inverse[RUDP_FEC_MAX_PARITY * RUDP_FEC_MAX_PARITY];
+
+    // Any e parity rows invert for any e lost packets: the product with the matrix is the identity
+    int identity = 1, rebuilt = 1;
+    for (unsigned int e = 1; e <= RUDP_FEC_MAX_PARITY; e++) {
+        for (unsigned int shift = 0; shift < RUDP_FEC_MAX_PARITY; shift++) {
+            for (unsigned int stride = 1; stride < RUDP_FEC_MAX_BLOCK && stride * (e - 1) < RUDP_FEC_MAX_BLOCK; stride += 5) {
+                // Distinct rows in any order (3 is prime with RUDP_FEC_MAX_PARITY), distinct packets from the end
+                for (unsigned int i = 0; i < e; i++) {
+                    rows[i] = (shift + i * 3) % RUDP_FEC_MAX_PARITY;
+                    indexes[i] = RUDP_FEC_MAX_BLOCK - 1 - i * stride;
+                }
+                if (fec_invert(RUDP_FEC_RS, rows, indexes, e, inverse) == -1) {
+                    identity = 0;
+                    continue;
+                }
+                for (unsigned int c = 0; c < e; c++) {
+                    for (unsigned int c2 = 0; c2 < e; c2++) {
+                        uint8_t sum = 0;
+                        for (unsigned int r = 0; r < e; r++)
+                            sum ^= gf_mul(inverse[c * e + r], fec_coef(RUDP_FEC_RS, rows[r], indexes[c2]));
+                        identity &= sum == (c == c2);
+                    }
+                }
+                rebuilt &= fec_rebuild(RUDP_FEC_MAX_BLOCK, rows, indexes, e) == 0;
+            }
+        }
+    }
+    check(identity, "fec_invert gives the inverse of square parts of the Reed-Solomon matrix");
+    check(rebuilt, "FEC rebuilds the lost packets of a block");
+
+    // XOR rebuilds one packet, and no matrix is larger than the parity of a block
+    rows[0] = 0;
+    indexes[0] = 5;
+    check(fec_invert(RUDP_FEC_XOR, rows, indexes, 1, inverse) == 0 && inverse[0] == 1, "fec_invert of XOR");
+    rows[1] = 0;
+    indexes[1] = 6;
+    check(fec_invert(RUDP_FEC_XOR, rows, indexes, 2, inverse) == -1, "fec_invert refuses two packets with XOR");
+    check(fec_invert(RUDP_FEC_RS, rows, indexes, 0, inverse) == -1, "fec_invert refuses an empty matrix");
+    check(fec_invert(RUDP_FEC_RS, rows, indexes, RUDP_FEC_MAX_PARITY + 1, inverse) == -1, "fec_invert refuses a matrix too large");
+}
+
+int main() {
+    test_lz();
+    test_session();
+    test_fec();
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        exit(EXIT_FAILURE);
+    }
+    printf("All checks passed\n");
+    return 0;
+}
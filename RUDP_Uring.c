@@ -0,0 +1,219 @@
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "RUDP_Uring.h"
+
+static int uring_setup(unsigned int entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int opcode, void *arg, unsigned int args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, args);
+}
+
+int rudpUring_init(rudpUring *ring, unsigned int entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(rudpUring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = uring_setup(entries, &params);
+    if (ring->fd == -1)
+        return -1;
+
+    // The submission ring, the completion ring (the same mapping on kernels with IORING_FEAT_SINGLE_MMAP), and the requests
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && ring->cq_map_size > ring->sq_map_size)
+        ring->sq_map_size = ring->cq_map_size;
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        rudpUring_exit(ring);
+        return -1;
+    }
+    if (single) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            rudpUring_exit(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                                             IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        rudpUring_exit(ring);
+        return -1;
+    }
+
+    char *sq = (char *)ring->sq_map;
+    char *cq = (char *)ring->cq_map;
+    ring->features = params.features;
+    ring->entries = params.sq_entries;
+    ring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+void rudpUring_exit(rudpUring *ring) {
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map)
+        munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map != NULL)
+        munmap(ring->sq_map, ring->sq_map_size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(rudpUring));
+    ring->fd = -1;
+}
+
+struct io_uring_sqe *rudpUring_sqe(rudpUring *ring) {
+    unsigned int tail = *ring->sq_tail;
+    // The kernel moves the head as it consumes the requests
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->entries) {
+        if (rudpUring_submit(ring, 0) == -1)
+            return NULL;
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->entries) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE); // The request is filled before io_uring_enter reads it
+    ring->queued++;
+    return sqe;
+}
+
+int rudpUring_submit(rudpUring *ring, unsigned int wait) {
+    if (ring->queued == 0 && wait == 0)
+        return 0;
+    int submitted;
+    do {
+        submitted = uring_enter(ring->fd, ring->queued, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+    } while (submitted == -1 && errno == EINTR);
+    if (submitted == -1)
+        return -1;
+    ring->queued -= (unsigned int)submitted < ring->queued ? (unsigned int)submitted : ring->queued;
+    return submitted;
+}
+
+int rudpUring_wait(rudpUring *ring, int64_t timeout_us) {
+    if (rudpUring_cqe(ring) != NULL)
+        return rudpUring_submit(ring, 0) == -1 ? -1 : 1;
+    struct __kernel_timespec ts = { timeout_us / 1000000, (timeout_us % 1000000) * 1000 };
+    struct io_uring_getevents_arg arg = { .sigmask = 0, .sigmask_sz = _NSIG / 8, .ts = (uint64_t)(uintptr_t)&ts };
+    if (timeout_us < 0)
+        arg.ts = 0;
+    int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->queued, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                 &arg, sizeof(arg));
+    if (submitted == -1 && errno != ETIME && errno != EINTR)
+        return -1;
+    if (submitted > 0)
+        ring->queued -= (unsigned int)submitted < ring->queued ? (unsigned int)submitted : ring->queued;
+    if (rudpUring_cqe(ring) != NULL)
+        return 1;
+    if (submitted == -1 && errno == EINTR)
+        return -1;
+    return 0;
+}
+
+struct io_uring_cqe *rudpUring_cqe(rudpUring *ring) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void rudpUring_cqe_seen(rudpUring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int rudpUring_buffers_init(rudpUring *ring, rudpUringBuffers *buffers, uint16_t group, unsigned int count, size_t size) {
+    memset(buffers, 0, sizeof(rudpUringBuffers));
+    // The ring must be page aligned, anonymous memory is
+    buffers->ring_size = count * sizeof(struct io_uring_buf);
+    buffers->ring = (struct io_uring_buf_ring *)mmap(NULL, buffers->ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers->ring == MAP_FAILED) {
+        buffers->ring = NULL;
+        return -1;
+    }
+    buffers->data_size = count * size;
+    buffers->data = (char *)mmap(NULL, buffers->data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers->data == MAP_FAILED) {
+        buffers->data = NULL;
+        rudpUring_buffers_exit(NULL, buffers);
+        return -1;
+    }
+    buffers->count = count;
+    buffers->size = size;
+    buffers->group = group;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)buffers->ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        int error = errno;
+        rudpUring_buffers_exit(NULL, buffers);
+        errno = error;
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        struct io_uring_buf *buf = &buffers->ring->bufs[i];
+        buf->addr = (uint64_t)(uintptr_t)(buffers->data + i * size);
+        buf->len = (uint32_t)size;
+        buf->bid = (uint16_t)i;
+    }
+    __atomic_store_n(&buffers->ring->tail, (uint16_t)count, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void rudpUring_buffers_exit(rudpUring *ring, rudpUringBuffers *buffers) {
+    if (ring != NULL && ring->fd >= 0 && buffers->ring != NULL) {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = buffers->group;
+        uring_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (buffers->ring != NULL)
+        munmap(buffers->ring, buffers->ring_size);
+    if (buffers->data != NULL)
+        munmap(buffers->data, buffers->data_size);
+    memset(buffers, 0, sizeof(rudpUringBuffers));
+}
+
+char *rudpUring_buffer(const rudpUringBuffers *buffers, uint32_t cqe_flags) {
+    return buffers->data + (size_t)(cqe_flags >> IORING_CQE_BUFFER_SHIFT) * buffers->size;
+}
+
+void rudpUring_buffer_recycle(rudpUringBuffers *buffers, uint32_t cqe_flags) {
+    uint16_t id = (uint16_t)(cqe_flags >> IORING_CQE_BUFFER_SHIFT);
+    uint16_t tail = buffers->ring->tail;
+    struct io_uring_buf *buf = &buffers->ring->bufs[tail & (buffers->count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(buffers->data + (size_t)id * buffers->size);
+    buf->len = (uint32_t)buffers->size;
+    buf->bid = id;
+    __atomic_store_n(&buffers->ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/*
+ * A minimal io_uring through the raw system calls (liburing isn't required): a submission queue of requests and a
+ * completion queue of their results, both shared with the kernel, so many I/O requests go to the kernel with one
+ * system call and complete while the caller does other work.
+ */
+
+typedef struct _rudpUring {
+    int fd;
+    unsigned int features; // IORING_FEAT_*
+    unsigned int entries; // Size of the submission queue
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map; // The mappings of the rings
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+    unsigned int queued; // Requests that weren't submitted yet
+} rudpUring;
+
+/*
+ * Sets up a ring of at least entries requests (a power of 2), the completion queue holds twice as many.
+ * Returns 0, or -1 if the kernel has no io_uring or refuses it (errno is set).
+ */
+int rudpUring_init(rudpUring *ring, unsigned int entries);
+
+/*
+ * Frees the ring, requests in flight are cancelled by the kernel.
+ */
+void rudpUring_exit(rudpUring *ring);
+
+/*
+ * Returns the next free request, zeroed, to fill and leave for rudpUring_submit. If the submission queue is full,
+ * the queued requests are submitted first. NULL on error.
+ */
+struct io_uring_sqe *rudpUring_sqe(rudpUring *ring);
+
+/*
+ * Submits the queued requests and waits until at least wait requests completed (0 doesn't wait).
+ * Returns the number of requests submitted, -1 on error (errno is set).
+ */
+int rudpUring_submit(rudpUring *ring, unsigned int wait);
+
+/*
+ * Waits until a completion is ready, or timeout_us microseconds passed (-1 waits with no limit), and submits the queued
+ * requests. Returns 1 if a completion is ready, 0 if the timeout passed, -1 on error (errno is set).
+ */
+int rudpUring_wait(rudpUring *ring, int64_t timeout_us);
+
+/*
+ * Returns the oldest completion that wasn't seen, NULL if there's none. Mark it seen with rudpUring_cqe_seen.
+ */
+struct io_uring_cqe *rudpUring_cqe(rudpUring *ring);
+
+void rudpUring_cqe_seen(rudpUring *ring);
+
+// Buffers the kernel picks from for the requests of a group (IOSQE_BUFFER_SELECT), the buffer of a completion is in its flags
+typedef struct _rudpUringBuffers {
+    struct io_uring_buf_ring *ring; // Shared with the kernel
+    size_t ring_size;
+    char *data;
+    size_t data_size;
+    unsigned int count; // A power of 2
+    size_t size; // Bytes of every buffer
+    uint16_t group;
+} rudpUringBuffers;
+
+/*
+ * Registers count buffers (a power of 2) of size bytes in group, and gives them all to the kernel (kernel 5.19 or later).
+ * Returns 0, or -1 on error (errno is set).
+ */
+int rudpUring_buffers_init(rudpUring *ring, rudpUringBuffers *buffers, uint16_t group, unsigned int count, size_t size);
+
+void rudpUring_buffers_exit(rudpUring *ring, rudpUringBuffers *buffers);
+
+/*
+ * Returns the buffer of a completion (IORING_CQE_F_BUFFER is in its flags).
+ */
+char *rudpUring_buffer(const rudpUringBuffers *buffers, uint32_t cqe_flags);
+
+/*
+ * Gives the buffer of a completion back to the kernel once its content was used.
+ */
+void rudpUring_buffer_recycle(rudpUringBuffers *buffers, uint32_t cqe_flags);
@@ -0,0 +1,410 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // fallocate
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "RUDP_Writer.h"
+#include "RUDP_Uring.h"
+
+// io_uring backend: write-behind buffers, at most WRITE_BUFFERS of them are filled or in flight. The submission queue
+// has room for all of them (an fsync may find it full, it's then submitted first).
+#define WRITE_BUFFER_SIZE (256 * 1024)
+#define WRITE_BUFFERS 64
+
+// The pwrite backend has a ring for its fsyncs only
+#define WRITE_SYNCS 8
+
+// The user_data of an fsync is its file with this bit set (files and buffers are aligned, their low bit is 0)
+#define SYNC_TAG 1
+
+// Bytes of a file that were written
+typedef struct _writeRange {
+    uint64_t offset;
+    uint64_t length;
+} writeRange;
+
+// Ranges of a file, in the order their writes completed
+typedef struct _writeRanges {
+    writeRange *ranges;
+    size_t count;
+    size_t capacity;
+} writeRanges;
+
+typedef struct _writeBuffer {
+    char *data;
+    size_t length; // Bytes in the buffer
+    size_t written; // Bytes the kernel wrote so far (a short write is submitted again for the rest)
+    uint64_t offset; // Offset of data[0] in the file
+    rudpWriterFile *file;
+    struct _writeBuffer *next; // Free list
+} writeBuffer;
+
+struct _rudpWriterFile {
+    int fd;
+    unsigned int pending; // Buffers and fsync in flight
+    int closing; // rudpWriter_close was called, the file is closed once pending is 0
+    int failed;
+    int syncing; // An fsync is in flight
+    writeBuffer *buffer; // The buffer being filled, NULL if none
+    writeRanges written; // Written since the last fsync was submitted (only if on_durable is set)
+    writeRanges flushing; // Written before the fsync in flight was submitted, durable once it completed
+    rudpWriterCallbacks callbacks;
+    void *user;
+};
+
+struct _rudpWriter {
+    int backend;
+    rudpUring ring;
+    writeBuffer buffers[WRITE_BUFFERS];
+    writeBuffer *free_buffers;
+    unsigned int in_flight;
+    unsigned long errors;
+};
+
+rudpWriter *rudpWriter_alloc(int backend) {
+    rudpWriter *writer = (rudpWriter *)calloc(1, sizeof(rudpWriter));
+    if (writer == NULL)
+        return NULL;
+    writer->backend = backend;
+    writer->ring.fd = -1;
+    if (backend != RUDP_WRITE_URING) {
+        // Without io_uring, rudpWriter_sync flushes with fdatasync and waits for it
+        if (rudpUring_init(&writer->ring, WRITE_SYNCS) == -1)
+            writer->ring.fd = -1;
+        return writer;
+    }
+    if (rudpUring_init(&writer->ring, WRITE_BUFFERS) == -1) {
+        free(writer);
+        return NULL;
+    }
+    for (int i = 0; i < WRITE_BUFFERS; i++) {
+        writer->buffers[i].data = (char *)malloc(WRITE_BUFFER_SIZE);
+        if (writer->buffers[i].data == NULL) {
+            rudpWriter_free(writer);
+            return NULL;
+        }
+        writer->buffers[i].next = writer->free_buffers;
+        writer->free_buffers = &writer->buffers[i];
+    }
+    return writer;
+}
+
+// Hand the rest of a buffer to the kernel, it's submitted with the next rudpUring_submit. Returns -1 on error.
+static int buffer_submit(rudpWriter *writer, writeBuffer *buffer) {
+    struct io_uring_sqe *sqe = rudpUring_sqe(&writer->ring);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = buffer->file->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(buffer->data + buffer->written);
+    sqe->len = (uint32_t)(buffer->length - buffer->written);
+    sqe->off = buffer->offset + buffer->written;
+    sqe->user_data = (uint64_t)(uintptr_t)buffer;
+    return 0;
+}
+
+static void file_release(rudpWriterFile *file) {
+    close(file->fd);
+    free(file->written.ranges);
+    free(file->flushing.ranges);
+    free(file);
+}
+
+// len bytes at offset of the file were written, they're durable after the next fsync. Writes mostly complete in the
+// order of their offsets, so a range usually extends the last one. A range that can't be remembered (allocation
+// error) is never reported durable: its bytes are sent again if the transfer is resumed.
+static void file_written(rudpWriterFile *file, uint64_t offset, size_t len) {
+    writeRanges *w = &file->written;
+    if (file->callbacks.on_durable == NULL || len == 0)
+        return;
+    if (w->count > 0) {
+        writeRange *last = &w->ranges[w->count - 1];
+        if (last->offset + last->length == offset) {
+            last->length += len;
+            return;
+        }
+        if (offset + len == last->offset) {
+            last->offset = offset;
+            last->length += len;
+            return;
+        }
+    }
+    if (w->count == w->capacity) {
+        size_t capacity = w->capacity == 0 ? 16 : w->capacity * 2;
+        writeRange *ranges = (writeRange *)realloc(w->ranges, capacity * sizeof(writeRange));
+        if (ranges == NULL)
+            return;
+        w->ranges = ranges;
+        w->capacity = capacity;
+    }
+    w->ranges[w->count].offset = offset;
+    w->ranges[w->count].length = len;
+    w->count++;
+}
+
+// The fsync of the file completed with res (0, or -errno): the ranges written before it was submitted are durable
+static void file_synced(rudpWriter *writer, rudpWriterFile *file, int res) {
+    file->syncing = 0;
+    if (res < 0) {
+        writer->errors++;
+        file->failed = 1;
+    } else {
+        for (size_t i = 0; i < file->flushing.count; i++)
+            file->callbacks.on_durable(file->flushing.ranges[i].offset, file->flushing.ranges[i].length, file->user);
+    }
+    file->flushing.count = 0;
+    if (file->callbacks.on_synced != NULL)
+        file->callbacks.on_synced(res < 0, file->user);
+}
+
+// Flush the ranges of the file written so far to the disk. With a ring the kernel runs the fsync while the caller goes
+// on, and its completion reports them durable, otherwise fdatasync does it now. Returns -1 on error.
+static int file_sync(rudpWriter *writer, rudpWriterFile *file) {
+    struct io_uring_sqe *sqe = NULL;
+    if (writer->ring.fd >= 0) {
+        sqe = rudpUring_sqe(&writer->ring);
+        if (sqe == NULL)
+            return -1;
+    }
+    // The written ranges are the ones this fsync flushes, the ones written meanwhile wait for the next one
+    writeRanges flushing = file->flushing;
+    file->flushing = file->written;
+    file->written = flushing;
+    file->syncing = 1;
+    if (sqe == NULL) {
+        file_synced(writer, file, fdatasync(file->fd) == -1 ? -errno : 0);
+        return 0;
+    }
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = file->fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = (uint64_t)(uintptr_t)file | SYNC_TAG;
+    file->pending++;
+    writer->in_flight++;
+    return 0;
+}
+
+// The last write of a closed file completed: its result is known
+static void file_closed(rudpWriterFile *file) {
+    int failed = file->failed;
+    void (*on_closed)(int, void *) = file->callbacks.on_closed;
+    void *user = file->user;
+    file_release(file);
+    if (on_closed != NULL)
+        on_closed(failed, user);
+}
+
+// Nothing of a closing file is in flight: the ranges it wrote are flushed first if they're to be durable, then it's closed
+static void file_settle(rudpWriter *writer, rudpWriterFile *file) {
+    // A range that can't be flushed isn't reported durable, which is all its failure means
+    if (file->written.count > 0 && file_sync(writer, file) == 0 && file->pending > 0)
+        return;
+    file_closed(file);
+}
+
+// A buffer or an fsync of the file completed
+static void file_done(rudpWriter *writer, rudpWriterFile *file) {
+    writer->in_flight--;
+    if (--file->pending == 0 && file->closing)
+        file_settle(writer, file);
+}
+
+// A buffer is done (written, or failed): it goes back to the free list, and its file is closed if it was the last one
+static void buffer_done(rudpWriter *writer, writeBuffer *buffer) {
+    buffer->next = writer->free_buffers;
+    writer->free_buffers = buffer;
+    file_done(writer, buffer->file);
+}
+
+// Handle the completions the kernel posted, returns their number or -1 on error
+static int writer_reap(rudpWriter *writer) {
+    int completed = 0;
+    struct io_uring_cqe *cqe;
+    while ((cqe = rudpUring_cqe(&writer->ring)) != NULL) {
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        rudpUring_cqe_seen(&writer->ring);
+        completed++;
+        if (user_data & SYNC_TAG) {
+            rudpWriterFile *file = (rudpWriterFile *)(uintptr_t)(user_data & ~(uint64_t)SYNC_TAG);
+            file_synced(writer, file, res);
+            file_done(writer, file);
+            continue;
+        }
+        writeBuffer *buffer = (writeBuffer *)(uintptr_t)user_data;
+        if (res <= 0) {
+            writer->errors++;
+            buffer->file->failed = 1;
+            buffer_done(writer, buffer);
+            continue;
+        }
+        file_written(buffer->file, buffer->offset + buffer->written, (size_t)res);
+        buffer->written += res;
+        if (buffer->written < buffer->length && buffer_submit(writer, buffer) == 0)
+            continue;
+        if (buffer->written < buffer->length) {
+            writer->errors++;
+            buffer->file->failed = 1;
+        }
+        buffer_done(writer, buffer);
+    }
+    return completed;
+}
+
+// A free buffer, after waiting for a write to complete if every one is in flight. NULL on error.
+static writeBuffer *buffer_get(rudpWriter *writer) {
+    while (writer->free_buffers == NULL) {
+        if (rudpUring_submit(&writer->ring, 1) == -1 || writer_reap(writer) == -1)
+            return NULL;
+    }
+    writeBuffer *buffer = writer->free_buffers;
+    writer->free_buffers = buffer->next;
+    return buffer;
+}
+
+// Send the buffer being filled to the kernel
+static int file_flush(rudpWriter *writer, rudpWriterFile *file) {
+    writeBuffer *buffer = file->buffer;
+    file->buffer = NULL;
+    if (buffer == NULL)
+        return 0;
+    file->pending++;
+    writer->in_flight++;
+    if (buffer->length == 0) {
+        buffer_done(writer, buffer);
+        return 0;
+    }
+    if (buffer_submit(writer, buffer) == -1) {
+        writer->errors++;
+        file->failed = 1;
+        buffer_done(writer, buffer);
+        return -1;
+    }
+    return 0;
+}
+
+rudpWriterFile *rudpWriter_open(rudpWriter *writer, const char *path, uint64_t size, int keep,
+                                const rudpWriterCallbacks *callbacks, void *user) {
+    (void)writer;
+    rudpWriterFile *file = (rudpWriterFile *)calloc(1, sizeof(rudpWriterFile));
+    if (file == NULL)
+        return NULL;
+    if (callbacks != NULL)
+        file->callbacks = *callbacks;
+    file->user = user;
+    file->fd = open(path, O_WRONLY | O_CREAT | (keep ? 0 : O_TRUNC), 0644);
+    if (file->fd == -1) {
+        free(file);
+        return NULL;
+    }
+    // A kept file gets the size of the new one, its bytes before that size stay
+    if (keep && ftruncate(file->fd, (off_t)size) == -1) {
+        int error = errno;
+        file_release(file);
+        errno = error;
+        return NULL;
+    }
+    // The blocks of the whole file at once: no allocation on every write, and no surprise when the disk is full
+    if (size > 0 && fallocate(file->fd, 0, 0, (off_t)size) == -1 && errno != EOPNOTSUPP && errno != ENOSYS) {
+        int error = errno;
+        file_release(file);
+        errno = error;
+        return NULL;
+    }
+    return file;
+}
+
+int rudpWriter_write(rudpWriter *writer, rudpWriterFile *file, const void *data, size_t len, uint64_t offset) {
+    const char *p = (const char *)data;
+    if (writer->backend != RUDP_WRITE_URING) {
+        while (len > 0) {
+            ssize_t n = pwrite(file->fd, p, len, (off_t)offset);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                writer->errors++;
+                file->failed = 1;
+                return -1;
+            }
+            file_written(file, offset, (size_t)n);
+            p += n;
+            len -= n;
+            offset += n;
+        }
+        return 0;
+    }
+
+    // The data is appended to the file's buffer if it follows it, or starts a new one
+    while (len > 0) {
+        writeBuffer *buffer = file->buffer;
+        if (buffer != NULL && (buffer->length == WRITE_BUFFER_SIZE || buffer->offset + buffer->length != offset)) {
+            if (file_flush(writer, file) == -1)
+                return -1;
+            buffer = NULL;
+        }
+        if (buffer == NULL) {
+            buffer = buffer_get(writer);
+            if (buffer == NULL)
+                return -1;
+            buffer->file = file;
+            buffer->offset = offset;
+            buffer->length = 0;
+            buffer->written = 0;
+            file->buffer = buffer;
+        }
+        size_t n = WRITE_BUFFER_SIZE - buffer->length < len ? WRITE_BUFFER_SIZE - buffer->length : len;
+        memcpy(buffer->data + buffer->length, p, n);
+        buffer->length += n;
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+int rudpWriter_sync(rudpWriter *writer, rudpWriterFile *file) {
+    // An fsync in flight is left alone, the ranges written since are the next one's
+    if (file->syncing || file->written.count == 0)
+        return 0;
+    return file_sync(writer, file);
+}
+
+void rudpWriter_close(rudpWriter *writer, rudpWriterFile *file) {
+    if (writer->backend == RUDP_WRITE_URING)
+        file_flush(writer, file); // A failure counts for the file
+    // The result is known once the last write of the file completed
+    file->closing = 1;
+    if (file->pending == 0)
+        file_settle(writer, file);
+}
+
+int rudpWriter_poll(rudpWriter *writer) {
+    if (writer->ring.fd < 0)
+        return 0;
+    if (rudpUring_submit(&writer->ring, 0) == -1)
+        return -1;
+    return writer_reap(writer);
+}
+
+unsigned long rudpWriter_errors(const rudpWriter *writer) {
+    return writer->errors;
+}
+
+void rudpWriter_free(rudpWriter *writer) {
+    if (writer == NULL)
+        return;
+    if (writer->ring.fd >= 0) {
+        while (writer->in_flight > 0) {
+            if (rudpUring_submit(&writer->ring, 1) == -1 || writer_reap(writer) == -1)
+                break;
+        }
+        rudpUring_exit(&writer->ring);
+    }
+    for (int i = 0; i < WRITE_BUFFERS; i++)
+        free(writer->buffers[i].data);
+    free(writer);
+}
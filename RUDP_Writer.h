@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Writes received files to disk at the offset of their data, so nothing is ever sought or reordered:
+ * RUDP_WRITE_PWRITE writes every piece with pwrite as it arrives; RUDP_WRITE_URING copies the pieces to write-behind
+ * buffers and hands the full ones to io_uring, so the disk works while the caller keeps receiving (and acknowledging),
+ * even at the end of a file: its result is reported once its last writes completed.
+ * Flushes to the disk (fsync) don't block either: the kernel runs them through io_uring (with either backend), and the
+ * ranges they made durable are reported when they complete.
+ * Files are preallocated to their size with fallocate. A writer is used by one thread.
+ */
+
+#define RUDP_WRITE_PWRITE 0
+#define RUDP_WRITE_URING 1
+
+struct _rudpWriter;
+typedef struct _rudpWriter rudpWriter;
+
+struct _rudpWriterFile;
+typedef struct _rudpWriterFile rudpWriterFile;
+
+typedef struct _rudpWriterCallbacks {
+    // len bytes at offset of the file are durable: they were written, then flushed to the disk by rudpWriter_sync or
+    // rudpWriter_close, and survive a crash. The ranges of a file are reported in any order, every byte once at most
+    // (may be NULL, then the file is never flushed)
+    void (*on_durable)(uint64_t offset, size_t len, void *user);
+    // A flush of the file completed, after the ranges it made durable were reported; failed is 1 if it failed (may be NULL)
+    void (*on_synced)(int failed, void *user);
+    // The file is closed (see rudpWriter_close), failed is 1 if one of its writes failed (may be NULL)
+    void (*on_closed)(int failed, void *user);
+} rudpWriterCallbacks;
+
+/*
+ * Allocates a writer with the backend, NULL on error (e.g. the kernel has no io_uring, errno is set).
+ * It's the user responsibility to free it with rudpWriter_free.
+ */
+rudpWriter *rudpWriter_alloc(int backend);
+
+/*
+ * Waits for the writes in flight and frees the writer, its files must be closed before (the last on_closed calls
+ * may come from here).
+ */
+void rudpWriter_free(rudpWriter *writer);
+
+/*
+ * Creates (or truncates) the file at path and preallocates size bytes for it. With keep, an existing file isn't
+ * truncated (a resumed transfer writes the missing parts of it). The callbacks (may be NULL) get user, they're called
+ * from rudpWriter_write, rudpWriter_poll, rudpWriter_sync, rudpWriter_close and rudpWriter_free.
+ * NULL on error (errno is set).
+ */
+rudpWriterFile *rudpWriter_open(rudpWriter *writer, const char *path, uint64_t size, int keep,
+                                const rudpWriterCallbacks *callbacks, void *user);
+
+/*
+ * Writes len bytes of data at offset of the file, data may be reused as soon as the call returns.
+ * Returns 0, or -1 on error (errno is set).
+ */
+int rudpWriter_write(rudpWriter *writer, rudpWriterFile *file, const void *data, size_t len, uint64_t offset);
+
+/*
+ * Flushes the bytes of the file whose writes completed so far to the disk (fdatasync), without waiting for it:
+ * on_durable and on_synced report it once it's done (from rudpWriter_poll). Bytes still being written are flushed by
+ * the next call, which does nothing while a flush of the file is in flight (and for a file without on_durable).
+ * Without io_uring the flush is done, and reported, before the call returns. Returns 0, or -1 on error (errno is set).
+ */
+int rudpWriter_sync(rudpWriter *writer, rudpWriterFile *file);
+
+/*
+ * The file is complete, it must not be used anymore. It's closed once its writes in flight completed, and its last
+ * bytes were flushed if it has on_durable, without waiting for them: on_closed reports its result then (from this call
+ * if nothing is in flight, or from rudpWriter_poll).
+ */
+void rudpWriter_close(rudpWriter *writer, rudpWriterFile *file);
+
+/*
+ * Submits the writes queued so far and handles the ones that completed, without blocking.
+ * Call it once per event loop iteration. Returns the number of writes completed, -1 on error.
+ */
+int rudpWriter_poll(rudpWriter *writer);
+
+/*
+ * Returns the number of writes that failed so far.
+ */
+unsigned long rudpWriter_errors(const rudpWriter *writer);